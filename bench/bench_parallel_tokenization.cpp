@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tokenization.hpp"
+
+
+// Same shape as the serial benchmark's input, with multi-line block comments so some
+// chunk boundaries land inside a comment and exercise the fix-up path.
+static std::string make_source(size_t statements) {
+    std::string src;
+    src.reserve(statements * 96);
+    for (size_t i = 0; i < statements; i++) {
+        std::string name = "generatedVariableName" + std::to_string(i % 20000);
+        src += "        let " + name + " = (" + std::to_string(i * 7919) + " + previousValue) * 42 / 3;\n";
+        if (i % 8 == 0) {
+            src += "        // checkpoint " + std::to_string(i) + "\n";
+        }
+        if (i % 32 == 0) {
+            src += "        /* block\n           comment */\n";
+        }
+    }
+    return src;
+}
+
+template<typename Fn>
+static double best_seconds(int runs, Fn fn) {
+    double best = 1e300;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    size_t statements = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string src = make_source(statements);
+
+    Tokenizer serial(src);
+    std::vector<Token> expected = serial.tokenize();
+    double serial_time = best_seconds(5, [&] {
+        Tokenizer(src).tokenize();
+    });
+
+    std::cout << "source: " << src.size() / (1024 * 1024) << " MiB, " << expected.size() << " tokens\n";
+    std::cout << "serial:     " << static_cast<size_t>(expected.size() / serial_time) << " tokens/s\n";
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        Tokenizer parallel(src);
+        std::vector<Token> tokens = parallel.tokenize_parallel(threads);
+        bool same = tokens.size() == expected.size() && std::equal(tokens.begin(), tokens.end(), expected.begin(), [](const Token& a, const Token& b) {
+            return a.type == b.type && a.payload == b.payload && a.offset == b.offset;
+        });
+        if (!same) {
+            std::cerr << "Parallel output differs from serial with " << threads << " threads" << std::endl;
+            return EXIT_FAILURE;
+        }
+        double time = best_seconds(5, [&] {
+            Tokenizer(src).tokenize_parallel(threads);
+        });
+        std::cout << threads << " threads: " << static_cast<size_t>(expected.size() / time) << " tokens/s ("
+                  << serial_time / time << "x)\n";
+        if (threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+    return EXIT_SUCCESS;
+}
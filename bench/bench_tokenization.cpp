@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "tokenization.hpp"
+
+
+// The byte-at-a-time tokenizer that the vectorized one replaced, kept here as the
+// baseline the benchmark measures against.
+namespace reference {
+
+struct Token {
+    TokenType type;
+    int line_no;
+    std::optional<std::string_view> value {};
+};
+
+static const std::unordered_map<std::string_view, TokenType> keywords = {
+    {"return", TokenType::_return},
+    {"let", TokenType::let},
+    {"if", TokenType::_if},
+    {"elif", TokenType::_elif},
+    {"else", TokenType::_else},
+    {"exit", TokenType::_exit}
+};
+
+class Tokenizer {
+public:
+    explicit Tokenizer(std::string_view src) : m_src(src) {}
+
+    std::vector<Token> tokenize() {
+        std::vector<Token> tokens;
+        int line_count = 1;
+        auto add = [&](TokenType type, std::optional<std::string_view> value = {}) {
+            tokens.push_back(Token{.type = type, .line_no = line_count, .value = value});
+        };
+        while (inspect().has_value()) {
+            char c = consume();
+            switch (c) {
+                case(';'): add(TokenType::semi); break;
+                case('='): add(TokenType::eq); break;
+                case('+'): add(TokenType::plus); break;
+                case('*'): add(TokenType::star); break;
+                case('-'): add(TokenType::minus); break;
+                case('('): add(TokenType::left_paren); break;
+                case(')'): add(TokenType::right_paren); break;
+                case('{'): add(TokenType::open_curly); break;
+                case('}'): add(TokenType::close_curly); break;
+                case('/'):
+                    if (inspect().has_value() && inspect().value() == '/') {
+                        while (inspect().has_value()) {
+                            if (inspect().value() == '\n') {
+                                consume();
+                                line_count++;
+                                break;
+                            }
+                            consume();
+                        }
+                    }
+                    else if (inspect().has_value() && inspect().value() == '*') {
+                        while (inspect().has_value()) {
+                            if (inspect().value() == '*' && inspect(1).has_value() && inspect(1).value() == '/') {
+                                consume();
+                                consume();
+                                break;
+                            }
+                            if (consume() == '\n') {
+                                line_count++;
+                            }
+                        }
+                    }
+                    else {
+                        add(TokenType::fslash);
+                    }
+                    break;
+                case('\n'):
+                    line_count++;
+                    break;
+                default:
+                    if (std::isalpha(static_cast<unsigned char>(c))) {
+                        size_t start = m_index - 1;
+                        while (inspect().has_value() && std::isalnum(static_cast<unsigned char>(inspect().value()))) {
+                            consume();
+                        }
+                        std::string_view word = m_src.substr(start, m_index - start);
+                        if (auto it = keywords.find(word); it != keywords.end()) {
+                            add(it->second);
+                        }
+                        else {
+                            add(TokenType::ident, word);
+                        }
+                    }
+                    else if (std::isdigit(static_cast<unsigned char>(c))) {
+                        size_t start = m_index - 1;
+                        while (inspect().has_value() && std::isdigit(static_cast<unsigned char>(inspect().value()))) {
+                            consume();
+                        }
+                        add(TokenType::int_lit, m_src.substr(start, m_index - start));
+                    }
+                    break;
+            }
+        }
+        return tokens;
+    }
+
+private:
+    std::optional<char> inspect(int offset = 0) const {
+        if (m_index + offset >= m_src.length()) return {};
+        return m_src.at(m_index + offset);
+    }
+
+    char consume() {
+        return m_src.at(m_index++);
+    }
+
+    std::string_view m_src;
+    size_t m_index = 0;
+};
+
+} // namespace reference
+
+// Builds a program shaped like our generated inputs: long identifiers, deep
+// indentation and a mix of line and block comments.
+static std::string make_source(size_t statements) {
+    std::string src;
+    src.reserve(statements * 96);
+    for (size_t i = 0; i < statements; i++) {
+        std::string name = "generatedVariableName" + std::to_string(i);
+        src += "        let " + name + " = (" + std::to_string(i * 7919) + " + previousValue) * 42 / 3;\n";
+        if (i % 8 == 0) {
+            src += "        // checkpoint " + std::to_string(i) + "\n";
+        }
+        if (i % 32 == 0) {
+            src += "        /* block\n           comment */\n";
+        }
+    }
+    return src;
+}
+
+template<typename Fn>
+static double best_seconds(int runs, size_t& token_count, Fn fn) {
+    double best = 1e300;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        token_count = fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    size_t statements = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 500000;
+    std::string src = make_source(statements);
+
+    size_t reference_tokens = 0;
+    double reference_time = best_seconds(5, reference_tokens, [&] {
+        return reference::Tokenizer(src).tokenize().size();
+    });
+
+    size_t fast_tokens = 0;
+    double fast_time = best_seconds(5, fast_tokens, [&] {
+        return Tokenizer(src).tokenize().size();
+    });
+
+    if (fast_tokens != reference_tokens) {
+        std::cerr << "Token count mismatch: " << fast_tokens << " vs " << reference_tokens << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "source: " << src.size() / (1024 * 1024) << " MiB, " << fast_tokens << " tokens\n";
+    std::cout << "token size: " << sizeof(reference::Token) << " bytes -> " << sizeof(Token) << " bytes\n";
+    std::cout << "reference: " << static_cast<size_t>(reference_tokens / reference_time) << " tokens/s\n";
+    std::cout << "scanner:   " << static_cast<size_t>(fast_tokens / fast_time) << " tokens/s ("
+              << reference_time / fast_time << "x)\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "bytecode.hpp"
+#include "flat_ast.hpp"
+#include "fold.hpp"
+#include "parsing.hpp"
+#include "resolve.hpp"
+#include "tokenization.hpp"
+
+
+// The obvious interpreter: a recursive walk of the tree that looks every variable up
+// by its declaration, kept here as the baseline the benchmark measures against.
+namespace reference {
+
+class AstWalker {
+public:
+    explicit AstWalker(const FlatAst& ast) : m_ast(ast) {}
+
+    int64_t run() {
+        return exec_scope(m_ast.root).value_or(0);
+    }
+
+private:
+    // The value of the exit or return that stopped the statements, if one did.
+    std::optional<int64_t> exec_scope(NodeIndex scope) {
+        for (NodeIndex stmt : m_ast.stmts(scope)) {
+            if (std::optional<int64_t> result = exec(stmt)) {
+                return result;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<int64_t> exec(NodeIndex stmt) {
+        switch (m_ast.kinds[stmt]) {
+            case NodeKind::stmt_return:
+            case NodeKind::stmt_exit:
+                return eval(m_ast.lhs[stmt]);
+            case NodeKind::stmt_let:
+                m_values[stmt] = eval(m_ast.lhs[stmt]);
+                return std::nullopt;
+            case NodeKind::stmt_assign:
+                m_values[m_ast.rhs[stmt]] = eval(m_ast.lhs[stmt]);
+                return std::nullopt;
+            case NodeKind::scope:
+                return exec_scope(stmt);
+            case NodeKind::stmt_if:
+                if (eval(m_ast.lhs[stmt]) != 0) {
+                    return exec_scope(m_ast.rhs[stmt]);
+                }
+                if (m_ast.payloads[stmt] == no_node) {
+                    return std::nullopt;
+                }
+                return exec(m_ast.payloads[stmt]);
+            case NodeKind::pred_else:
+                return exec_scope(m_ast.lhs[stmt]);
+            default:
+                return std::nullopt;
+        }
+    }
+
+    int64_t eval(NodeIndex expr) {
+        switch (m_ast.kinds[expr]) {
+            case NodeKind::int_lit:
+                return m_ast.int_value(expr);
+            case NodeKind::ident:
+                return m_values[m_ast.rhs[expr]];
+            case NodeKind::add:
+                return fold_add(eval(m_ast.lhs[expr]), eval(m_ast.rhs[expr]));
+            case NodeKind::sub:
+                return fold_sub(eval(m_ast.lhs[expr]), eval(m_ast.rhs[expr]));
+            case NodeKind::mul:
+                return fold_mul(eval(m_ast.lhs[expr]), eval(m_ast.rhs[expr]));
+            case NodeKind::div:
+                return fold_div(eval(m_ast.lhs[expr]), eval(m_ast.rhs[expr]));
+            default:
+                return 0;
+        }
+    }
+
+    const FlatAst& m_ast;
+    std::unordered_map<NodeIndex, int64_t> m_values;
+};
+
+} // namespace reference
+
+// Arithmetic on the variables before it in each block, then an if / elif / else
+// chain that takes a different branch from block to block.
+static std::string make_source(size_t blocks) {
+    std::string src = "let acc = 1;\nlet prev = 3;\n";
+    src.reserve(blocks * 160);
+    for (size_t i = 0; i < blocks; i++) {
+        std::string name = "v" + std::to_string(i);
+        std::string n = std::to_string(i % 97 + 1);
+        src += "let " + name + " = (prev * " + n + " + acc) / 3 - (acc - " + n + ") * 2;\n";
+        src += "if (" + name + " - " + name + " / 4 * 4) { acc = acc + " + name + "; } ";
+        src += "elif (acc / 5 - acc / 5 / 2 * 2) { acc = acc - " + n + "; } ";
+        src += "else { prev = " + name + " / 2 + 1; }\n";
+    }
+    src += "exit(acc + prev);\n";
+    return src;
+}
+
+template <typename Fn>
+static double best_seconds(int runs, int64_t& result, Fn fn) {
+    double best = 1e300;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        result = fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    size_t blocks = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    std::string src = make_source(blocks);
+
+    Tokenizer tokenizer(src);
+    Parser parser(tokenizer);
+    FlatAst ast = flatten(parser.parse_program().value());
+    if (!resolve_names(ast, tokenizer.interner()).empty()) {
+        std::cerr << "Generated program doesn't resolve" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int64_t reference_result = 0;
+    double reference_time = best_seconds(5, reference_result, [&] {
+        return reference::AstWalker(ast).run();
+    });
+
+    auto compile_start = std::chrono::steady_clock::now();
+    Bytecode bytecode = compile_bytecode(ast);
+    std::chrono::duration<double> compile_time = std::chrono::steady_clock::now() - compile_start;
+    int64_t vm_result = 0;
+    double vm_time = best_seconds(5, vm_result, [&] {
+        return run_bytecode(bytecode);
+    });
+
+    if (vm_result != reference_result) {
+        std::cerr << "Result mismatch: " << vm_result << " vs " << reference_result << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "program: " << ast.size() << " nodes, " << bytecode.code.size() << " instructions, "
+              << bytecode.registers.size() << " registers\n";
+    std::cout << "compile:    " << compile_time.count() * 1000 << " ms\n";
+    std::cout << "ast walker: " << reference_time * 1000 << " ms\n";
+    std::cout << "bytecode:   " << vm_time * 1000 << " ms (" << reference_time / vm_time << "x)\n";
+    return EXIT_SUCCESS;
+}
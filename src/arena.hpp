@@ -1,28 +1,102 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdlib>
+#include <limits>
 #include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define SEABSY_ARENA_MMAP 1
+#endif
 
+
+// Bump allocator over a chain of blocks. When the current block is full the arena
+// moves on to the next one, allocating a new block twice the size of the last when
+// it runs out, so allocation never fails short of the system running out of memory.
+//
+// Memory is only ever handed back in bulk: rewind() releases everything allocated
+// since a mark() and reset() releases everything. Both keep the blocks for reuse, so
+// an arena that is reset between compilations stops calling malloc once it has
+// grown to the size of the largest input. Destructors are never run, so only
+// trivially destructible objects (or ones whose resources live in the arena) belong
+// here.
 class ArenaAllocator {
 public:
-    ArenaAllocator(size_t capacity)
-        : m_capacity(capacity)
+    struct Mark {
+        size_t block;
+        std::byte* offset;
+    };
+
+    explicit ArenaAllocator(size_t initial_capacity = 64 * 1024)
+        : m_next_capacity(std::max<size_t>(initial_capacity, 64))
     {
-        m_buffer = static_cast<std::byte*>(malloc(m_capacity));
-        m_offset = m_buffer;
+        add_block(m_next_capacity);
+    }
+
+    template<typename T>
+    T* alloc() {
+        static_assert(std::is_trivially_destructible_v<T>, "the arena never runs destructors");
+        return std::construct_at(static_cast<T*>(alloc_bytes(sizeof(T), alignof(T))));
     }
 
+    // Allocates `count` contiguous value-initialized elements. Throws std::bad_alloc,
+    // like running out of memory, if their size does not fit in a size_t.
     template<typename T>
-    T* alloc(){
-        size_t space = m_capacity - static_cast<std::size_t>(m_offset - m_buffer);
-        void* aligned_ptr = m_offset;
-        if (std::align(alignof(T), sizeof(T), aligned_ptr, space) == nullptr) {
-            return nullptr;
+    std::span<T> alloc_array(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "the arena never runs destructors");
+        if (count == 0) {
+            return {};
+        }
+        if (count > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        T* items = static_cast<T*>(alloc_bytes(sizeof(T) * count, alignof(T)));
+        std::uninitialized_value_construct_n(items, count);
+        return std::span<T>(items, count);
+    }
+
+    Mark mark() const {
+        return Mark{.block = m_current, .offset = m_offset};
+    }
+
+    // Releases everything allocated since `mark` was taken.
+    void rewind(Mark mark) {
+        m_current = mark.block;
+        m_offset = mark.offset;
+        for (size_t i = m_current + 1; i < m_blocks.size(); i++) {
+            m_blocks[i].used = 0;
+        }
+    }
+
+    // Releases every allocation but keeps the blocks for reuse.
+    void reset() {
+        rewind(Mark{.block = 0, .offset = m_blocks.front().data});
+    }
+
+    size_t bytes_used() const {
+        size_t used = static_cast<size_t>(m_offset - m_blocks[m_current].data);
+        for (size_t i = 0; i < m_current; i++) {
+            used += m_blocks[i].used;
         }
-        m_offset = static_cast<std::byte*>(aligned_ptr) + sizeof(T);
-        return std::construct_at(static_cast<T*>(aligned_ptr));
+        return used;
+    }
+
+    size_t bytes_reserved() const {
+        size_t reserved = 0;
+        for (const Block& block : m_blocks) {
+            reserved += block.capacity;
+        }
+        return reserved;
+    }
+
+    size_t block_count() const {
+        return m_blocks.size();
     }
 
     ArenaAllocator(const ArenaAllocator&) = delete;
@@ -30,11 +104,102 @@ public:
 
     ~ArenaAllocator()
     {
-        free(m_buffer);
+        for (const Block& block : m_blocks) {
+            release_block(block);
+        }
     }
 
 private:
-    size_t m_capacity;
-    std::byte* m_buffer;
-    std::byte* m_offset;
-};
\ No newline at end of file
+    struct Block {
+        std::byte* data;
+        size_t capacity;
+        // Bytes in use when the arena moved past this block.
+        size_t used;
+        bool mapped;
+    };
+
+    // Blocks at least this large are mapped directly and, where the platform allows,
+    // backed by transparent huge pages to cut TLB misses on very large inputs.
+    static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+    void* alloc_bytes(size_t size, size_t alignment) {
+        while (true) {
+            Block& block = m_blocks[m_current];
+            size_t space = block.capacity - static_cast<size_t>(m_offset - block.data);
+            void* aligned_ptr = m_offset;
+            if (std::align(alignment, size, aligned_ptr, space) != nullptr) {
+                m_offset = static_cast<std::byte*>(aligned_ptr) + size;
+                return aligned_ptr;
+            }
+            // A size this close to the limit could never be allocated anyway.
+            if (size > std::numeric_limits<size_t>::max() - alignment) {
+                throw std::bad_alloc();
+            }
+            next_block(size + alignment);
+        }
+    }
+
+    void next_block(size_t min_capacity) {
+        m_blocks[m_current].used = static_cast<size_t>(m_offset - m_blocks[m_current].data);
+        // Reuse a block kept from before a rewind or reset when the request fits.
+        if (m_current + 1 < m_blocks.size() && m_blocks[m_current + 1].capacity >= min_capacity) {
+            m_current++;
+            m_offset = m_blocks[m_current].data;
+            return;
+        }
+        while (m_next_capacity < min_capacity) {
+            if (m_next_capacity > std::numeric_limits<size_t>::max() / 2) {
+                m_next_capacity = min_capacity;
+                break;
+            }
+            m_next_capacity *= 2;
+        }
+        add_block(m_next_capacity, m_current + 1);
+        m_current++;
+        m_offset = m_blocks[m_current].data;
+    }
+
+    void add_block(size_t capacity, size_t position = 0) {
+        Block block {.data = nullptr, .capacity = capacity, .used = 0, .mapped = false};
+#ifdef SEABSY_ARENA_MMAP
+        if (capacity >= huge_page_size) {
+            block.capacity = (capacity + huge_page_size - 1) / huge_page_size * huge_page_size;
+            void* data = mmap(nullptr, block.capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+                madvise(data, block.capacity, MADV_HUGEPAGE);
+#endif
+                block.data = static_cast<std::byte*>(data);
+                block.mapped = true;
+            }
+        }
+#endif
+        if (block.data == nullptr) {
+            block.data = static_cast<std::byte*>(malloc(block.capacity));
+            if (block.data == nullptr) {
+                throw std::bad_alloc();
+            }
+        }
+        m_blocks.insert(m_blocks.begin() + static_cast<std::ptrdiff_t>(std::min(position, m_blocks.size())), block);
+        m_next_capacity = std::max(m_next_capacity, block.capacity * 2);
+        if (m_blocks.size() == 1) {
+            m_current = 0;
+            m_offset = block.data;
+        }
+    }
+
+    static void release_block(const Block& block) {
+#ifdef SEABSY_ARENA_MMAP
+        if (block.mapped) {
+            munmap(block.data, block.capacity);
+            return;
+        }
+#endif
+        free(block.data);
+    }
+
+    std::vector<Block> m_blocks;
+    size_t m_current = 0;
+    std::byte* m_offset = nullptr;
+    size_t m_next_capacity;
+};
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+#include "bytecode.hpp"
+#include "fold.hpp"
+#include "frame.hpp"
+
+
+// GCC and Clang can take the address of a label, so each handler ends in its own
+// indirect jump to the next one instead of going back to a shared switch. Every
+// jump then has a branch history of its own, which predicts the interpreted
+// program far better.
+#if defined(__GNUC__) || defined(__clang__)
+#define SEABSY_COMPUTED_GOTO
+#endif
+
+namespace {
+
+// While compiling, temporaries and constants are numbered from 0 in spaces of their
+// own, marked by these bits, and are only placed after the variables at the end.
+constexpr uint32_t temp_bit = 1u << 30;
+constexpr uint32_t const_bit = 1u << 31;
+constexpr uint32_t no_jump = UINT32_MAX;
+constexpr uint32_t no_target = UINT32_MAX;
+
+class BytecodeCompiler {
+public:
+    explicit BytecodeCompiler(const FlatAst& ast)
+        : m_ast(ast)
+        , m_layout(layout_frame(ast, {}))
+    {
+    }
+
+    Bytecode run() {
+        push_scope(m_ast.root);
+        run_tasks();
+        emit(BcOp::halt, constant(0));
+        return finish();
+    }
+
+private:
+    // Work left for after a block, as in the generator. The jumps to the end of an
+    // if chain are linked through their targets until the end is known.
+    struct Task {
+        enum class Action : uint8_t {
+            stmt,
+            after_if_block,
+            end_chain,
+        };
+        Action action;
+        NodeIndex node = no_node;
+        uint32_t jz = no_jump;
+        uint32_t chain = no_jump;
+    };
+
+    void run_tasks() {
+        while (!m_tasks.empty()) {
+            Task task = m_tasks.back();
+            m_tasks.pop_back();
+            switch (task.action) {
+                case Task::Action::stmt:
+                    run_stmt(task.node);
+                    break;
+                case Task::Action::after_if_block:
+                    after_if_block(task);
+                    break;
+                case Task::Action::end_chain:
+                    patch_chain(task.chain);
+                    break;
+            }
+        }
+    }
+
+    void run_stmt(NodeIndex stmt) {
+        switch (m_ast.kinds[stmt]) {
+            case NodeKind::stmt_return:
+            case NodeKind::stmt_exit:
+                emit(BcOp::halt, gen_expr(m_ast.lhs[stmt], no_target));
+                break;
+            case NodeKind::stmt_let:
+                gen_expr(m_ast.lhs[stmt], variable(stmt));
+                break;
+            case NodeKind::stmt_assign:
+                gen_expr(m_ast.lhs[stmt], variable(m_ast.rhs[stmt]));
+                break;
+            case NodeKind::scope:
+                push_scope(stmt);
+                break;
+            case NodeKind::stmt_if:
+                start_if(stmt, no_jump);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void start_if(NodeIndex stmt, uint32_t chain) {
+        uint32_t jz = emit(BcOp::jz, gen_expr(m_ast.lhs[stmt], no_target), no_jump);
+        m_tasks.push_back(Task{.action = Task::Action::after_if_block, .node = stmt, .jz = jz, .chain = chain});
+        push_scope(m_ast.rhs[stmt]);
+    }
+
+    void after_if_block(const Task& task) {
+        NodeIndex pred = m_ast.payloads[task.node];
+        if (pred == no_node) {
+            m_code[task.jz].b = pc();
+            patch_chain(task.chain);
+            return;
+        }
+        uint32_t chain = emit(BcOp::jmp, 0, task.chain);
+        m_code[task.jz].b = pc();
+        if (m_ast.kinds[pred] == NodeKind::stmt_if) {
+            start_if(pred, chain);
+            return;
+        }
+        m_tasks.push_back(Task{.action = Task::Action::end_chain, .chain = chain});
+        push_scope(m_ast.lhs[pred]);
+    }
+
+    void patch_chain(uint32_t chain) {
+        while (chain != no_jump) {
+            uint32_t next = m_code[chain].b;
+            m_code[chain].b = pc();
+            chain = next;
+        }
+    }
+
+    void push_scope(NodeIndex scope) {
+        auto stmts = m_ast.stmts(scope);
+        for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+            m_tasks.push_back(Task{.action = Task::Action::stmt, .node = *it});
+        }
+    }
+
+    // Operands are evaluated left first into temporaries taken and released in stack
+    // order, and the outermost operator writes to `target` if there is one. Returns
+    // the register that holds the value.
+    uint32_t gen_expr(NodeIndex expr, uint32_t target) {
+        m_work.emplace_back(expr, false);
+        while (!m_work.empty()) {
+            auto [node, operands_done] = m_work.back();
+            m_work.pop_back();
+            switch (m_ast.kinds[node]) {
+                case NodeKind::int_lit:
+                    m_values.push_back(constant(m_ast.int_value(node)));
+                    continue;
+                case NodeKind::ident:
+                    m_values.push_back(variable(m_ast.rhs[node]));
+                    continue;
+                default:
+                    break;
+            }
+            if (!operands_done) {
+                m_work.emplace_back(node, true);
+                m_work.emplace_back(m_ast.rhs[node], false);
+                m_work.emplace_back(m_ast.lhs[node], false);
+                continue;
+            }
+            uint32_t rhs = m_values.back();
+            m_values.pop_back();
+            uint32_t lhs = m_values.back();
+            m_values.pop_back();
+            m_next_temp -= (rhs & temp_bit ? 1 : 0) + (lhs & temp_bit ? 1 : 0);
+            uint32_t result = node == expr && target != no_target ? target : temp();
+            static constexpr BcOp ops[] = {BcOp::add, BcOp::sub, BcOp::mul, BcOp::div};
+            emit(ops[static_cast<int>(m_ast.kinds[node]) - static_cast<int>(NodeKind::add)], result, lhs, rhs);
+            m_values.push_back(result);
+        }
+        uint32_t value = m_values.back();
+        m_values.pop_back();
+        if (value & temp_bit) {
+            m_next_temp--;
+        }
+        if (target != no_target && value != target) {
+            emit(BcOp::mov, target, value);
+            return target;
+        }
+        return value;
+    }
+
+    uint32_t temp() {
+        m_temps = std::max(m_temps, m_next_temp + 1);
+        return temp_bit | m_next_temp++;
+    }
+
+    uint32_t constant(int64_t value) {
+        auto [it, added] = m_constant_of.try_emplace(value, static_cast<uint32_t>(m_constants.size()));
+        if (added) {
+            m_constants.push_back(value);
+        }
+        return const_bit | it->second;
+    }
+
+    uint32_t variable(NodeIndex decl) const {
+        return m_layout.location(decl).index;
+    }
+
+    uint32_t emit(BcOp op, uint32_t a, uint32_t b = 0, uint32_t c = 0) {
+        m_code.push_back(BcInst{.op = op, .a = a, .b = b, .c = c});
+        return pc() - 1;
+    }
+
+    uint32_t pc() const {
+        return static_cast<uint32_t>(m_code.size());
+    }
+
+    // Now that every space has its size, the registers are numbered variables first,
+    // then temporaries, then constants.
+    Bytecode finish() {
+        const uint32_t temps_base = m_layout.slots;
+        const uint32_t constants_base = temps_base + m_temps;
+        auto place = [&](uint32_t& reg) {
+            if (reg & const_bit) {
+                reg = constants_base + (reg & ~const_bit);
+            }
+            else if (reg & temp_bit) {
+                reg = temps_base + (reg & ~temp_bit);
+            }
+        };
+        for (BcInst& inst : m_code) {
+            switch (inst.op) {
+                case BcOp::jmp:
+                    break;
+                case BcOp::mov:
+                    place(inst.a);
+                    place(inst.b);
+                    break;
+                case BcOp::jz:
+                case BcOp::halt:
+                    place(inst.a);
+                    break;
+                default:
+                    place(inst.a);
+                    place(inst.b);
+                    place(inst.c);
+                    break;
+            }
+        }
+        Bytecode bytecode;
+        bytecode.code = std::move(m_code);
+        bytecode.registers.assign(constants_base, 0);
+        bytecode.registers.insert(bytecode.registers.end(), m_constants.begin(), m_constants.end());
+        return bytecode;
+    }
+
+    const FlatAst& m_ast;
+    FrameLayout m_layout;
+    std::vector<BcInst> m_code;
+    std::vector<Task> m_tasks;
+    std::vector<std::pair<NodeIndex, bool>> m_work;
+    std::vector<uint32_t> m_values;
+    uint32_t m_next_temp = 0;
+    uint32_t m_temps = 0;
+    std::vector<int64_t> m_constants;
+    std::unordered_map<int64_t, uint32_t> m_constant_of;
+};
+
+} // namespace
+
+Bytecode compile_bytecode(const FlatAst& ast) {
+    return BytecodeCompiler(ast).run();
+}
+
+int64_t run_bytecode(const Bytecode& bytecode) {
+    std::vector<int64_t> registers = bytecode.registers;
+    int64_t* r = registers.data();
+    const BcInst* const code = bytecode.code.data();
+    const BcInst* ip = code;
+
+#ifdef SEABSY_COMPUTED_GOTO
+    static const void* const handlers[] = {&&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mov, &&op_jz, &&op_jmp, &&op_halt};
+#define HANDLER(name) op_##name:
+#define DISPATCH() goto *handlers[static_cast<size_t>(ip->op)]
+    DISPATCH();
+#else
+#define HANDLER(name) case BcOp::name:
+#define DISPATCH() continue
+    for (;;) {
+        switch (ip->op) {
+#endif
+    HANDLER(add)
+        r[ip->a] = fold_add(r[ip->b], r[ip->c]);
+        ip++;
+        DISPATCH();
+    HANDLER(sub)
+        r[ip->a] = fold_sub(r[ip->b], r[ip->c]);
+        ip++;
+        DISPATCH();
+    HANDLER(mul)
+        r[ip->a] = fold_mul(r[ip->b], r[ip->c]);
+        ip++;
+        DISPATCH();
+    HANDLER(div)
+        r[ip->a] = fold_div(r[ip->b], r[ip->c]);
+        ip++;
+        DISPATCH();
+    HANDLER(mov)
+        r[ip->a] = r[ip->b];
+        ip++;
+        DISPATCH();
+    HANDLER(jz)
+        ip = r[ip->a] == 0 ? code + ip->b : ip + 1;
+        DISPATCH();
+    HANDLER(jmp)
+        ip = code + ip->b;
+        DISPATCH();
+    HANDLER(halt)
+        return r[ip->a];
+#ifndef SEABSY_COMPUTED_GOTO
+        }
+    }
+#endif
+#undef HANDLER
+#undef DISPATCH
+}
+
+std::string dump_bytecode(const Bytecode& bytecode) {
+    static constexpr const char* names[] = {"add", "sub", "mul", "div", "mov", "jz", "jmp", "halt"};
+    std::stringstream output;
+    for (size_t i = 0; i < bytecode.code.size(); i++) {
+        const BcInst& inst = bytecode.code[i];
+        output << i << ": " << names[static_cast<size_t>(inst.op)];
+        switch (inst.op) {
+            case BcOp::jmp:
+                output << " " << inst.b;
+                break;
+            case BcOp::mov:
+                output << " r" << inst.a << ", r" << inst.b;
+                break;
+            case BcOp::jz:
+                output << " r" << inst.a << ", " << inst.b;
+                break;
+            case BcOp::halt:
+                output << " r" << inst.a;
+                break;
+            default:
+                output << " r" << inst.a << ", r" << inst.b << ", r" << inst.c;
+                break;
+        }
+        output << "\n";
+    }
+    return output.str();
+}
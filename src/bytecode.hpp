@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "flat_ast.hpp"
+
+
+// Register-based bytecode for running a program without assembling it. Every
+// operand is a register: variables come first, sharing registers the way
+// layout_frame shares slots, then the temporaries of expressions, then one register
+// per distinct constant, which is filled in before the program starts. Operators
+// therefore read variables and constants where they are and write straight to the
+// variable being assigned.
+enum class BcOp : uint8_t {
+    add,   // a = b + c
+    sub,
+    mul,
+    div,
+    mov,   // a = b
+    jz,    // if a == 0, jump to b
+    jmp,   // jump to b
+    halt,  // stop with the value of a
+};
+
+struct BcInst {
+    BcOp op;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+};
+
+struct Bytecode {
+    std::vector<BcInst> code;
+    // The register file as the program starts: zeros, then the constants.
+    std::vector<int64_t> registers;
+};
+
+// `ast` must have been through resolve_names without diagnostics. Like the
+// generator, the compiler keeps nesting on work stacks rather than the call stack.
+Bytecode compile_bytecode(const FlatAst& ast);
+
+// Runs `bytecode` to its halt and returns the value of the exit or return that
+// stopped it, with the generated code's arithmetic (see fold_add).
+int64_t run_bytecode(const Bytecode& bytecode);
+
+// One instruction per line, as `add r3, r0, r5`, with the jump targets' indices.
+std::string dump_bytecode(const Bytecode& bytecode);
@@ -0,0 +1,198 @@
+#include <utility>
+
+#include "elf.hpp"
+
+
+namespace {
+
+enum Section : uint16_t {
+    null_section,
+    text_section,
+    rela_section,
+    symtab_section,
+    strtab_section,
+    shstrtab_section,
+    section_count,
+};
+
+constexpr size_t header_bytes = 64;
+constexpr size_t section_header_bytes = 64;
+constexpr size_t symbol_bytes = 24;
+constexpr size_t rela_bytes = 24;
+
+// Appends fields in little-endian order whatever the host.
+class ElfWriter {
+public:
+    void u8(uint8_t value) {
+        m_out.push_back(value);
+    }
+
+    void u16(uint16_t value) {
+        little_endian(value, 2);
+    }
+
+    void u32(uint32_t value) {
+        little_endian(value, 4);
+    }
+
+    void u64(uint64_t value) {
+        little_endian(value, 8);
+    }
+
+    void bytes(const std::vector<uint8_t>& data) {
+        m_out.insert(m_out.end(), data.begin(), data.end());
+    }
+
+    void string(const std::string& text) {
+        m_out.insert(m_out.end(), text.begin(), text.end());
+    }
+
+    void align(size_t alignment) {
+        m_out.resize((m_out.size() + alignment - 1) / alignment * alignment, 0);
+    }
+
+    size_t size() const {
+        return m_out.size();
+    }
+
+    std::vector<uint8_t> take() {
+        return std::move(m_out);
+    }
+
+private:
+    void little_endian(uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            m_out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    std::vector<uint8_t> m_out;
+};
+
+struct SectionHeader {
+    uint32_t name = 0;
+    uint32_t type = 0;
+    uint64_t flags = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t link = 0;
+    uint32_t info = 0;
+    uint64_t align = 0;
+    uint64_t entsize = 0;
+};
+
+// Appends `name` to a string table and returns its offset there.
+uint32_t add_string(std::string& table, const std::string& name) {
+    auto offset = static_cast<uint32_t>(table.size());
+    table += name;
+    table += '\0';
+    return offset;
+}
+
+} // namespace
+
+// The file is laid out as the header, the sections in order, then the section
+// header table. Symbol 0 is the null symbol, 1 is main and the externs follow, all
+// of them global, so the first non-local symbol is 1.
+std::vector<uint8_t> write_elf_object(const ObjectCode& code, uint16_t machine) {
+    std::string shstrtab(1, '\0');
+    SectionHeader headers[section_count] = {};
+    headers[text_section] = {.name = add_string(shstrtab, ".text"), .type = 1, .flags = 0x6, .align = 4};
+    headers[rela_section] = {.name = add_string(shstrtab, ".rela.text"), .type = 4, .flags = 0x40, .link = symtab_section, .info = text_section, .align = 8, .entsize = rela_bytes};
+    headers[symtab_section] = {.name = add_string(shstrtab, ".symtab"), .type = 2, .link = strtab_section, .info = 1, .align = 8, .entsize = symbol_bytes};
+    headers[strtab_section] = {.name = add_string(shstrtab, ".strtab"), .type = 3, .align = 1};
+    headers[shstrtab_section] = {.name = add_string(shstrtab, ".shstrtab"), .type = 3, .align = 1};
+
+    std::string strtab(1, '\0');
+    const uint32_t main_name = add_string(strtab, "main");
+    std::vector<uint32_t> extern_names;
+    for (const std::string& name : code.externs) {
+        extern_names.push_back(add_string(strtab, name));
+    }
+
+    ElfWriter w;
+    w.string("\x7f" "ELF");
+    w.u8(2);  // ELFCLASS64
+    w.u8(1);  // ELFDATA2LSB
+    w.u8(1);  // EV_CURRENT
+    w.align(16);
+    w.u16(1);  // ET_REL
+    w.u16(machine);
+    w.u32(1);
+    w.u64(0);  // entry
+    w.u64(0);  // program headers
+    const size_t shoff_at = w.size();
+    w.u64(0);  // section headers, patched below
+    w.u32(0);
+    w.u16(header_bytes);
+    w.u16(0);
+    w.u16(0);
+    w.u16(section_header_bytes);
+    w.u16(section_count);
+    w.u16(shstrtab_section);
+
+    auto begin_section = [&](Section section) {
+        w.align(headers[section].align);
+        headers[section].offset = w.size();
+    };
+    auto end_section = [&](Section section) {
+        headers[section].size = w.size() - headers[section].offset;
+    };
+
+    begin_section(text_section);
+    w.bytes(code.text);
+    end_section(text_section);
+
+    begin_section(rela_section);
+    for (const Relocation& relocation : code.relocations) {
+        w.u64(relocation.offset);
+        w.u64(static_cast<uint64_t>(relocation.symbol + 2) << 32 | relocation.type);
+        w.u64(static_cast<uint64_t>(relocation.addend));
+    }
+    end_section(rela_section);
+
+    begin_section(symtab_section);
+    auto symbol = [&](uint32_t name, uint8_t info, uint16_t section, uint64_t size) {
+        w.u32(name);
+        w.u8(info);
+        w.u8(0);
+        w.u16(section);
+        w.u64(0);
+        w.u64(size);
+    };
+    symbol(0, 0, 0, 0);
+    symbol(main_name, 0x12, text_section, code.text.size());  // STB_GLOBAL, STT_FUNC
+    for (uint32_t name : extern_names) {
+        symbol(name, 0x10, 0, 0);  // STB_GLOBAL, STT_NOTYPE, undefined
+    }
+    end_section(symtab_section);
+
+    begin_section(strtab_section);
+    w.string(strtab);
+    end_section(strtab_section);
+
+    begin_section(shstrtab_section);
+    w.string(shstrtab);
+    end_section(shstrtab_section);
+
+    w.align(8);
+    const size_t shoff = w.size();
+    for (const SectionHeader& header : headers) {
+        w.u32(header.name);
+        w.u32(header.type);
+        w.u64(header.flags);
+        w.u64(0);  // address
+        w.u64(header.offset);
+        w.u64(header.size);
+        w.u32(header.link);
+        w.u32(header.info);
+        w.u64(header.align);
+        w.u64(header.entsize);
+    }
+
+    std::vector<uint8_t> out = w.take();
+    for (int i = 0; i < 8; i++) {
+        out[shoff_at + i] = static_cast<uint8_t>(shoff >> (8 * i));
+    }
+    return out;
+}
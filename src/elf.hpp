@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+inline constexpr uint16_t elf_machine_aarch64 = 183;
+
+// A place in the code that the linker patches with the address of an external
+// symbol, as an ELF RELA entry.
+struct Relocation {
+    uint64_t offset;
+    uint32_t type;
+    // Index into ObjectCode::externs.
+    uint32_t symbol;
+    int64_t addend = 0;
+};
+
+// Encoded machine code for main, with every label already resolved, and the
+// references it still makes to symbols defined elsewhere.
+struct ObjectCode {
+    std::vector<uint8_t> text;
+    std::vector<std::string> externs;
+    std::vector<Relocation> relocations;
+};
+
+// A relocatable ELF64 little-endian object holding `code` in .text, with `main` as a
+// global function at its start and every extern as an undefined global.
+std::vector<uint8_t> write_elf_object(const ObjectCode& code, uint16_t machine);
@@ -0,0 +1,175 @@
+#include <string>
+
+#include "encoder.hpp"
+
+
+namespace {
+
+constexpr uint32_t no_offset = UINT32_MAX;
+
+// A branch whose target's offset was not known when it was encoded.
+struct Fixup {
+    uint32_t offset;
+    LabelId label;
+    // Width of the signed word displacement: 19 for cbz and cbnz, 26 for b.
+    uint8_t bits;
+};
+
+class Arm64Encoder {
+public:
+    Arm64Encoder(ObjectCode& object, std::vector<std::string>& diagnostics)
+        : m_object(object)
+        , m_diagnostics(diagnostics)
+    {
+    }
+
+    void run(const MachineCode& code) {
+        m_object.text.reserve(code.insts.size() * 4);
+        for (const MInst& inst : code.insts) {
+            if (inst.op == MOp::label) {
+                bind(inst.imm);
+            }
+            else {
+                encode(inst);
+            }
+        }
+        for (const Fixup& fixup : m_fixups) {
+            uint32_t target = fixup.label < m_labels.size() ? m_labels[fixup.label] : no_offset;
+            if (target == no_offset) {
+                m_diagnostics.push_back("LBB0_" + std::to_string(fixup.label) + " is never defined");
+                continue;
+            }
+            const int64_t distance = (static_cast<int64_t>(target) - fixup.offset) / 4;
+            if (!fits_signed(distance, fixup.bits)) {
+                m_diagnostics.push_back("LBB0_" + std::to_string(fixup.label) + " is out of branch range");
+                continue;
+            }
+            const uint32_t mask = (1u << fixup.bits) - 1;
+            const uint32_t shift = fixup.bits == 19 ? 5 : 0;
+            patch(fixup.offset, (static_cast<uint32_t>(distance) & mask) << shift);
+        }
+    }
+
+private:
+    void encode(const MInst& inst) {
+        const uint32_t rd = inst.rd;
+        const uint32_t rn = inst.rn;
+        const uint32_t rm = inst.rm;
+        switch (inst.op) {
+            case MOp::movz:
+            case MOp::movk:
+                check(inst.rn % 16 == 0 && inst.rn < 64 && inst.imm <= 0xffff, "move-wide immediate", inst.imm);
+                word((inst.op == MOp::movz ? 0xd2800000 : 0xf2800000) | rn / 16 << 21 | inst.imm << 5 | rd);
+                break;
+            case MOp::mov:
+                // ORR with xzr, unless sp is involved, which only ADD can reach.
+                if (inst.rd == sp_reg || inst.rn == sp_reg) {
+                    word(0x91000000 | rn << 5 | rd);
+                }
+                else {
+                    word(0xaa0003e0 | rn << 16 | rd);
+                }
+                break;
+            case MOp::add:
+                word(0x8b000000 | rm << 16 | rn << 5 | rd);
+                break;
+            case MOp::sub:
+                word(0xcb000000 | rm << 16 | rn << 5 | rd);
+                break;
+            case MOp::mul:
+                // MADD with xzr as the addend.
+                word(0x9b007c00 | rm << 16 | rn << 5 | rd);
+                break;
+            case MOp::sdiv:
+                word(0x9ac00c00 | rm << 16 | rn << 5 | rd);
+                break;
+            case MOp::add_imm:
+            case MOp::sub_imm:
+                check(inst.imm <= 0xfff, "add/sub immediate", inst.imm);
+                word((inst.op == MOp::add_imm ? 0x91000000 : 0xd1000000) | (inst.imm & 0xfff) << 10 | rn << 5 | rd);
+                break;
+            case MOp::ldr:
+            case MOp::str:
+                // Unsigned offsets scaled by 8, from sp.
+                check(inst.imm % 8 == 0 && inst.imm / 8 <= 0xfff, "stack offset", inst.imm);
+                word((inst.op == MOp::ldr ? 0xf9400000 : 0xf9000000) | (inst.imm / 8 & 0xfff) << 10 | uint32_t(sp_reg) << 5 | rd);
+                break;
+            case MOp::cbz:
+            case MOp::cbnz:
+                branch(inst.op == MOp::cbz ? 0xb4000000 | rd : 0xb5000000 | rd, inst.imm, 19);
+                break;
+            case MOp::b:
+                branch(0x14000000, inst.imm, 26);
+                break;
+            case MOp::bl_exit:
+                m_object.relocations.push_back(Relocation{.offset = offset(), .type = r_aarch64_call26, .symbol = exit_symbol()});
+                word(0x94000000);
+                break;
+            default:
+                word(0xd65f03c0);
+                break;
+        }
+    }
+
+    void bind(LabelId label) {
+        if (label >= m_labels.size()) {
+            m_labels.resize(label + 1, no_offset);
+        }
+        m_labels[label] = offset();
+    }
+
+    // Backward branches could be finished here, but every branch goes through the
+    // fixup list so that there is one place that checks ranges.
+    void branch(uint32_t bits, LabelId label, uint8_t width) {
+        m_fixups.push_back(Fixup{.offset = offset(), .label = label, .bits = width});
+        word(bits);
+    }
+
+    uint32_t exit_symbol() {
+        if (m_object.externs.empty()) {
+            m_object.externs.emplace_back("exit");
+        }
+        return 0;
+    }
+
+    void check(bool fits, const char* what, uint32_t value) {
+        if (!fits) {
+            m_diagnostics.push_back(std::string(what) + " " + std::to_string(value) + " does not fit its field");
+        }
+    }
+
+    static bool fits_signed(int64_t value, uint8_t bits) {
+        return value >= -(int64_t(1) << (bits - 1)) && value < int64_t(1) << (bits - 1);
+    }
+
+    uint32_t offset() const {
+        return static_cast<uint32_t>(m_object.text.size());
+    }
+
+    // Instructions are little-endian.
+    void word(uint32_t bits) {
+        for (int i = 0; i < 4; i++) {
+            m_object.text.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+        }
+    }
+
+    void patch(uint32_t at, uint32_t bits) {
+        for (int i = 0; i < 4; i++) {
+            m_object.text[at + i] |= static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+
+    ObjectCode& m_object;
+    std::vector<std::string>& m_diagnostics;
+    // Offset of each label by id, or no_offset until it is bound.
+    std::vector<uint32_t> m_labels;
+    std::vector<Fixup> m_fixups;
+};
+
+} // namespace
+
+ObjectCode encode_arm64(const MachineCode& code, std::vector<std::string>& diagnostics) {
+    ObjectCode object;
+    Arm64Encoder(object, diagnostics).run(code);
+    return object;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "elf.hpp"
+#include "machine.hpp"
+
+
+inline constexpr uint32_t r_aarch64_call26 = 283;
+
+// AArch64 machine code for `code`, without going through an assembler. Branches to
+// labels are resolved here once every label's offset is known, and each bl _exit
+// becomes a bl to the extern `exit` with a CALL26 relocation. An immediate or
+// branch distance that does not fit its field is reported in `diagnostics`.
+ObjectCode encode_arm64(const MachineCode& code, std::vector<std::string>& diagnostics);
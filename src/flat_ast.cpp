@@ -0,0 +1,222 @@
+#include <utility>
+
+#include "flat_ast.hpp"
+
+
+NodeIndex FlatAst::add_node(NodeKind kind, NodeIndex lhs_index, NodeIndex rhs_index, uint32_t payload) {
+    kinds.push_back(kind);
+    lhs.push_back(lhs_index);
+    rhs.push_back(rhs_index);
+    payloads.push_back(payload);
+    return static_cast<NodeIndex>(kinds.size() - 1);
+}
+
+NodeIndex FlatAst::add_int_lit(int64_t value) {
+    auto bits = static_cast<uint64_t>(value);
+    return add_node(NodeKind::int_lit, static_cast<uint32_t>(bits), static_cast<uint32_t>(bits >> 32));
+}
+
+int64_t FlatAst::int_value(NodeIndex int_lit) const {
+    return static_cast<int64_t>(static_cast<uint64_t>(rhs[int_lit]) << 32 | lhs[int_lit]);
+}
+
+std::span<const NodeIndex> FlatAst::stmts(NodeIndex scope) const {
+    return std::span<const NodeIndex>(extra).subspan(lhs[scope], rhs[scope]);
+}
+
+size_t FlatAst::size() const {
+    return kinds.size();
+}
+
+size_t FlatAst::memory_bytes() const {
+    return kinds.size() * sizeof(NodeKind)
+        + lhs.size() * sizeof(NodeIndex)
+        + rhs.size() * sizeof(NodeIndex)
+        + payloads.size() * sizeof(uint32_t)
+        + extra.size() * sizeof(NodeIndex);
+}
+
+namespace {
+
+// Walks the pointer tree with an explicit task stack. Finished subtrees leave their
+// node index on m_values, so a scope's statements sit there contiguously and an if
+// finds its condition, block and elif/else below one another.
+class Flattener {
+public:
+    explicit Flattener(FlatAst& ast)
+        : m_ast(ast)
+    {
+    }
+
+    NodeIndex flatten_program(std::span<NodeStmt* const> stmts) {
+        push_scope(stmts);
+        run();
+        NodeIndex root = m_values.back();
+        m_values.pop_back();
+        return root;
+    }
+
+private:
+    struct Task {
+        enum class Action : uint8_t {
+            stmt,
+            ifpred,
+            end_scope,
+            end_if,
+            end_else,
+        };
+        Action action;
+        const NodeStmt* stmt = nullptr;
+        const NodeIfPred* ifpred = nullptr;
+        size_t first_value = 0;
+        bool has_pred = false;
+    };
+
+    static NodeKind bin_kind(TokenType op) {
+        switch (op) {
+            case TokenType::plus:
+                return NodeKind::add;
+            case TokenType::minus:
+                return NodeKind::sub;
+            case TokenType::star:
+                return NodeKind::mul;
+            default:
+                return NodeKind::div;
+        }
+    }
+
+    NodeIndex flatten_expr(const NodeExpr* root) {
+        const size_t base = m_exprs.size();
+        m_exprs.push_back({root, false});
+        while (m_exprs.size() > base) {
+            auto [expr, operands_done] = m_exprs.back();
+            m_exprs.pop_back();
+            if (operands_done) {
+                NodeIndex rhs = m_values.back();
+                m_values.pop_back();
+                m_values.back() = m_ast.add_node(bin_kind(std::get<NodeBinExpr*>(expr->variant)->op.type), m_values.back(), rhs);
+                continue;
+            }
+            // Parentheses only shaped the tree; the flat form drops them.
+            const NodeTerm* const* term = std::get_if<NodeTerm*>(&expr->variant);
+            while (term != nullptr && std::holds_alternative<NodeTermParen*>((*term)->variant)) {
+                expr = std::get<NodeTermParen*>((*term)->variant)->expr;
+                term = std::get_if<NodeTerm*>(&expr->variant);
+            }
+            if (term == nullptr) {
+                const NodeBinExpr* bin_expr = std::get<NodeBinExpr*>(expr->variant);
+                m_exprs.push_back({expr, true});
+                m_exprs.push_back({bin_expr->rhs, false});
+                m_exprs.push_back({bin_expr->lhs, false});
+            }
+            else if (auto int_lit = std::get_if<NodeTermIntLit*>(&(*term)->variant)) {
+                m_values.push_back(m_ast.add_int_lit((*int_lit)->int_lit));
+            }
+            else {
+                m_values.push_back(m_ast.add_node(NodeKind::ident, no_node, no_node, std::get<NodeTermIdent*>((*term)->variant)->ident));
+            }
+        }
+        NodeIndex result = m_values.back();
+        m_values.pop_back();
+        return result;
+    }
+
+    void push_scope(std::span<NodeStmt* const> stmts) {
+        m_tasks.push_back(Task{.action = Task::Action::end_scope, .first_value = m_values.size()});
+        for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+            m_tasks.push_back(Task{.action = Task::Action::stmt, .stmt = *it});
+        }
+    }
+
+    // The condition is flattened right away; the block and the rest of the chain follow.
+    void push_if(const NodeStmtIf* stmt_if) {
+        m_values.push_back(flatten_expr(stmt_if->expr));
+        bool has_pred = stmt_if->pred.has_value();
+        m_tasks.push_back(Task{.action = Task::Action::end_if, .has_pred = has_pred});
+        if (has_pred) {
+            m_tasks.push_back(Task{.action = Task::Action::ifpred, .ifpred = stmt_if->pred.value()});
+        }
+        push_scope(stmt_if->scope->stmts);
+    }
+
+    void run_stmt(const NodeStmt* stmt) {
+        if (auto stmt_return = std::get_if<NodeStmtReturn*>(&stmt->variant)) {
+            m_values.push_back(m_ast.add_node(NodeKind::stmt_return, flatten_expr((*stmt_return)->expr)));
+        }
+        else if (auto stmt_exit = std::get_if<NodeStmtExit*>(&stmt->variant)) {
+            m_values.push_back(m_ast.add_node(NodeKind::stmt_exit, flatten_expr((*stmt_exit)->expr)));
+        }
+        else if (auto stmt_let = std::get_if<NodeStmtLet*>(&stmt->variant)) {
+            NodeIndex expr = flatten_expr((*stmt_let)->expr);
+            m_values.push_back(m_ast.add_node(NodeKind::stmt_let, expr, no_node, (*stmt_let)->ident));
+        }
+        else if (auto stmt_assign = std::get_if<NodeStmtAssign*>(&stmt->variant)) {
+            NodeIndex expr = flatten_expr((*stmt_assign)->expr);
+            m_values.push_back(m_ast.add_node(NodeKind::stmt_assign, expr, no_node, (*stmt_assign)->ident));
+        }
+        else if (auto scope = std::get_if<NodeScope*>(&stmt->variant)) {
+            push_scope((*scope)->stmts);
+        }
+        else {
+            push_if(std::get<NodeStmtIf*>(stmt->variant));
+        }
+    }
+
+    void run() {
+        while (!m_tasks.empty()) {
+            Task task = m_tasks.back();
+            m_tasks.pop_back();
+            switch (task.action) {
+                case Task::Action::stmt:
+                    run_stmt(task.stmt);
+                    break;
+                case Task::Action::ifpred:
+                    if (auto elif = std::get_if<NodeStmtIf*>(&task.ifpred->variant)) {
+                        push_if(*elif);
+                    }
+                    else {
+                        m_tasks.push_back(Task{.action = Task::Action::end_else});
+                        push_scope(std::get<NodeIfPredElse*>(task.ifpred->variant)->scope->stmts);
+                    }
+                    break;
+                case Task::Action::end_scope: {
+                    auto begin = static_cast<NodeIndex>(m_ast.extra.size());
+                    auto count = static_cast<NodeIndex>(m_values.size() - task.first_value);
+                    m_ast.extra.insert(m_ast.extra.end(), m_values.begin() + static_cast<std::ptrdiff_t>(task.first_value), m_values.end());
+                    m_values.resize(task.first_value);
+                    m_values.push_back(m_ast.add_node(NodeKind::scope, begin, count));
+                    break;
+                }
+                case Task::Action::end_if: {
+                    NodeIndex pred = no_node;
+                    if (task.has_pred) {
+                        pred = m_values.back();
+                        m_values.pop_back();
+                    }
+                    NodeIndex scope = m_values.back();
+                    m_values.pop_back();
+                    m_values.back() = m_ast.add_node(NodeKind::stmt_if, m_values.back(), scope, pred);
+                    break;
+                }
+                case Task::Action::end_else:
+                    m_values.back() = m_ast.add_node(NodeKind::pred_else, m_values.back());
+                    break;
+            }
+        }
+    }
+
+    FlatAst& m_ast;
+    std::vector<Task> m_tasks;
+    // Expressions still to visit; the flag is set once the operands have been visited.
+    std::vector<std::pair<const NodeExpr*, bool>> m_exprs;
+    std::vector<NodeIndex> m_values;
+};
+
+} // namespace
+
+FlatAst flatten(const NodeProgram& prog) {
+    FlatAst ast;
+    Flattener flattener(ast);
+    ast.root = flattener.flatten_program(prog.stmts);
+    return ast;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "grammar.hpp"
+
+
+using NodeIndex = uint32_t;
+
+constexpr NodeIndex no_node = UINT32_MAX;
+
+// What each kind keeps in its lhs / rhs / payload slots.
+enum class NodeKind : uint8_t {
+    int_lit,      // lhs, rhs: low and high halves of the value (see int_value)
+    ident,        // payload: SymbolId, rhs: the declaring stmt_let (see resolve_names)
+    add,          // lhs, rhs: operands
+    sub,
+    mul,
+    div,
+    stmt_return,  // lhs: expression
+    stmt_exit,    // lhs: expression
+    stmt_let,     // lhs: expression, payload: SymbolId
+    stmt_assign,  // lhs: expression, rhs: the declaring stmt_let, payload: SymbolId
+    scope,        // lhs: first statement in `extra`, rhs: statement count
+    stmt_if,      // lhs: condition, rhs: scope, payload: elif/else node or no_node
+    pred_else,    // lhs: scope
+};
+
+// The program as parallel arrays indexed by 32-bit node indices, instead of a graph
+// of variant nodes. Parentheses and the Expr/Term wrapper nodes disappear, and a
+// node costs 13 bytes spread over cache-dense arrays.
+//
+// Nodes are stored in post-order: every child has a smaller index than its parent,
+// and the program's top-level scope is the last node. A single forward loop over
+// the arrays therefore visits operands before the operators that use them.
+struct FlatAst {
+    std::vector<NodeKind> kinds;
+    std::vector<NodeIndex> lhs;
+    std::vector<NodeIndex> rhs;
+    std::vector<uint32_t> payloads;
+    // Statement lists of scopes, each one contiguous.
+    std::vector<NodeIndex> extra;
+    NodeIndex root = no_node;
+
+    NodeIndex add_node(NodeKind kind, NodeIndex lhs_index = no_node, NodeIndex rhs_index = no_node, uint32_t payload = 0);
+    NodeIndex add_int_lit(int64_t value);
+    int64_t int_value(NodeIndex int_lit) const;
+    std::span<const NodeIndex> stmts(NodeIndex scope) const;
+    size_t size() const;
+    size_t memory_bytes() const;
+};
+
+FlatAst flatten(const NodeProgram& prog);
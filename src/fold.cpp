@@ -0,0 +1,65 @@
+#include "fold.hpp"
+
+
+int64_t fold_add(int64_t lhs, int64_t rhs) {
+    return static_cast<int64_t>(static_cast<uint64_t>(lhs) + static_cast<uint64_t>(rhs));
+}
+
+int64_t fold_sub(int64_t lhs, int64_t rhs) {
+    return static_cast<int64_t>(static_cast<uint64_t>(lhs) - static_cast<uint64_t>(rhs));
+}
+
+int64_t fold_mul(int64_t lhs, int64_t rhs) {
+    return static_cast<int64_t>(static_cast<uint64_t>(lhs) * static_cast<uint64_t>(rhs));
+}
+
+int64_t fold_div(int64_t lhs, int64_t rhs) {
+    if (rhs == 0) {
+        return 0;
+    }
+    if (rhs == -1) {
+        return fold_sub(0, lhs);
+    }
+    return lhs / rhs;
+}
+
+size_t fold_constants(FlatAst& ast) {
+    size_t folded = 0;
+    for (NodeIndex node = 0; node < ast.size(); node++) {
+        NodeKind kind = ast.kinds[node];
+        if (kind != NodeKind::add && kind != NodeKind::sub && kind != NodeKind::mul && kind != NodeKind::div) {
+            continue;
+        }
+        // Operands come earlier in the arrays, so they are already folded as far as
+        // they go.
+        NodeIndex lhs = ast.lhs[node];
+        NodeIndex rhs = ast.rhs[node];
+        if (ast.kinds[lhs] != NodeKind::int_lit || ast.kinds[rhs] != NodeKind::int_lit) {
+            continue;
+        }
+        int64_t lhs_value = ast.int_value(lhs);
+        int64_t rhs_value = ast.int_value(rhs);
+        int64_t value;
+        switch (kind) {
+            case NodeKind::add:
+                value = fold_add(lhs_value, rhs_value);
+                break;
+            case NodeKind::sub:
+                value = fold_sub(lhs_value, rhs_value);
+                break;
+            case NodeKind::mul:
+                value = fold_mul(lhs_value, rhs_value);
+                break;
+            default:
+                value = fold_div(lhs_value, rhs_value);
+                break;
+        }
+        auto bits = static_cast<uint64_t>(value);
+        ast.kinds[node] = NodeKind::int_lit;
+        ast.lhs[node] = static_cast<uint32_t>(bits);
+        ast.rhs[node] = static_cast<uint32_t>(bits >> 32);
+        ast.payloads[node] = 0;
+        folded++;
+    }
+    return folded;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+#include "flat_ast.hpp"
+
+
+// Arithmetic as the generated code performs it: two's complement wrap-around on
+// overflow, and sdiv's results for the cases C++ leaves undefined, x / 0 == 0 and
+// INT64_MIN / -1 == INT64_MIN.
+int64_t fold_add(int64_t lhs, int64_t rhs);
+int64_t fold_sub(int64_t lhs, int64_t rhs);
+int64_t fold_mul(int64_t lhs, int64_t rhs);
+int64_t fold_div(int64_t lhs, int64_t rhs);
+
+// Rewrites every operator whose operands are both constant into an int_lit, in one
+// forward pass over the post-order arrays. Operand nodes of a folded operator are left
+// in place but are no longer referenced. Returns the number of operators folded.
+size_t fold_constants(FlatAst& ast);
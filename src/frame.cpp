@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <utility>
+
+#include "frame.hpp"
+
+
+const Location& FrameLayout::location(NodeIndex decl) const {
+    return locations[variable_of[decl]];
+}
+
+FrameLayout layout_frame(const FlatAst& ast, std::span<const PhysReg> regs) {
+    FrameLayout layout;
+    layout.variable_of.assign(ast.size(), UINT32_MAX);
+    // Variables are numbered in the order of their lets, so the intervals come out
+    // sorted by start as linear scan needs.
+    std::vector<LiveInterval> intervals;
+    for (NodeIndex node = 0; node < ast.size(); node++) {
+        switch (ast.kinds[node]) {
+            case NodeKind::stmt_let:
+                layout.variable_of[node] = static_cast<uint32_t>(intervals.size());
+                intervals.push_back(LiveInterval{.start = node, .end = node});
+                break;
+            case NodeKind::ident:
+            case NodeKind::stmt_assign:
+                intervals[layout.variable_of[ast.rhs[node]]].end = node;
+                break;
+            default:
+                break;
+        }
+    }
+
+    RegAllocation allocation = linear_scan(intervals, regs);
+    layout.locations = std::move(allocation.locations);
+    layout.slots = allocation.spill_slots;
+    for (PhysReg reg : regs) {
+        bool used = std::any_of(layout.locations.begin(), layout.locations.end(), [&](const Location& location) {
+            return !location.spilled && location.index == reg;
+        });
+        if (used) {
+            layout.used_regs.push_back(reg);
+        }
+    }
+    return layout;
+}
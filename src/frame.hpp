@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "flat_ast.hpp"
+#include "regalloc.hpp"
+
+
+// Where every variable lives for the whole program, decided before any code is
+// generated so that the frame is set up once on entry.
+//
+// A variable is live from its let to the last node that reads or assigns it. The
+// language has no loops, so every path through the program visits nodes in index
+// order, and that one span covers every point where the variable may still be
+// needed. Variables whose spans do not overlap, such as those of sibling scopes,
+// share a register or an 8-byte slot.
+struct FrameLayout {
+    // Variable number of every stmt_let node, indexing `locations`.
+    std::vector<uint32_t> variable_of;
+    std::vector<Location> locations;
+    uint32_t slots = 0;
+    // Registers held by at least one variable, in the order they were offered.
+    std::vector<PhysReg> used_regs;
+
+    const Location& location(NodeIndex decl) const;
+};
+
+// `ast` must have been through resolve_names. Variables are placed in `regs` while
+// any are free and in stack slots after that.
+FrameLayout layout_frame(const FlatAst& ast, std::span<const PhysReg> regs);
@@ -1,352 +1,367 @@
 #include "generator.hpp"
 
-#include <iomanip>
-#include <iostream>
-#include <optional>
+#include <algorithm>
+#include <utility>
 
 
-Generator::Generator(NodeProgram prog)
-    : m_prog(prog)
+Generator::Generator(FlatAst ast, bool promote_variables, Target target)
+    : m_ast(std::move(ast))
+    , m_regs(target_regs(target))
 {
-    // Available temporary registers. x0 is kept free for return/exit hand-off.
-    m_free_regs = {"x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8"};
+    m_returns = std::find(m_ast.kinds.begin(), m_ast.kinds.end(), NodeKind::stmt_return) != m_ast.kinds.end();
+    m_layout = layout_frame(m_ast, promote_variables ? m_regs.variables : std::span<const PhysReg>());
+    for (PhysReg reg : m_layout.used_regs) {
+        m_written_regs |= 1u << reg;
+    }
+    for (PhysReg reg : m_regs.allocatable) {
+        if (std::find(m_layout.used_regs.begin(), m_layout.used_regs.end(), reg) == m_layout.used_regs.end()) {
+            m_temp_regs.push_back(reg);
+        }
+    }
 }
 
-std::string handle_int64_immediates(const uint64_t immediate, const std::string& target_reg) {
-    std::stringstream output;
-    bool started = false;
+void Generator::emit_bin_op(NodeIndex bin_expr, MReg result_reg, MReg lhs_reg, MReg rhs_reg) {
+    switch (m_ast.kinds[bin_expr]) {
+        case NodeKind::add:
+            m_code.emit(MOp::add, result_reg, lhs_reg, rhs_reg);
+            break;
+        case NodeKind::sub:
+            m_code.emit(MOp::sub, result_reg, lhs_reg, rhs_reg);
+            break;
+        case NodeKind::div:
+            m_code.emit(MOp::sdiv, result_reg, lhs_reg, rhs_reg);
+            break;
+        default:
+            m_code.emit(MOp::mul, result_reg, lhs_reg, rhs_reg);
+            break;
+    }
+}
 
-    auto emit_hex16 = [&output](uint16_t chunk) {
-        // Always print exactly 4 hex digits for a 16-bit chunk.
-        output << "0x"
-               << std::hex
-               << std::setw(4) << std::setfill('0')
-               << chunk
-               << std::dec;
-    };
+// Lowers the tree to straight-line code over virtual registers, left operand first,
+// then lets linear scan place every value. Each instruction defines the virtual
+// register with its own index, so the intervals come out sorted by start. Variables
+// held in registers are read where they live and take no register of their own.
+MReg Generator::gen_expr(NodeIndex expr, MReg target_reg) {
+    m_expr_code.clear();
+    m_expr_work.emplace_back(expr, false);
+    while (!m_expr_work.empty()) {
+        auto [node, operands_done] = m_expr_work.back();
+        m_expr_work.pop_back();
+        if (operands_done) {
+            uint32_t rhs = m_expr_vregs.back();
+            m_expr_vregs.pop_back();
+            uint32_t lhs = m_expr_vregs.back();
+            m_expr_vregs.back() = static_cast<uint32_t>(m_expr_code.size());
+            m_expr_code.push_back(ExprInst{.node = node, .lhs = lhs, .rhs = rhs});
+            continue;
+        }
+        if (m_ast.kinds[node] == NodeKind::int_lit || m_ast.kinds[node] == NodeKind::ident) {
+            m_expr_vregs.push_back(static_cast<uint32_t>(m_expr_code.size()));
+            m_expr_code.push_back(ExprInst{.node = node});
+            continue;
+        }
+        m_expr_work.emplace_back(node, true);
+        m_expr_work.emplace_back(m_ast.rhs[node], false);
+        m_expr_work.emplace_back(m_ast.lhs[node], false);
+    }
+    m_expr_vregs.pop_back();
 
-    auto add_shift = [&](int shift) {
-        output << ", lsl #" << shift;
+    const auto count = static_cast<uint32_t>(m_expr_code.size());
+    auto variable_reg = [&](uint32_t vreg) {
+        const ExprInst& inst = m_expr_code[vreg];
+        if (m_ast.kinds[inst.node] != NodeKind::ident) {
+            return std::optional<PhysReg>();
+        }
+        const Location& location = m_layout.location(m_ast.rhs[inst.node]);
+        return location.spilled ? std::optional<PhysReg>() : static_cast<PhysReg>(location.index);
     };
-
-    for (int i = 0; i < 4; i++) {
-        uint16_t chunk = static_cast<uint16_t>((immediate >> (i * 16)) & 0xFFFF);
-        int shift = i * 16;
-        if (!started) {
-            if (chunk != 0) {
-                output << "    movz " << target_reg << ", #";
-                emit_hex16(chunk);
-                if (shift != 0) add_shift(shift);
-                output << "\n";
-                started = true;
-            }
+    m_intervals.clear();
+    m_interval_of.resize(count);
+    for (uint32_t vreg = 0; vreg < count; vreg++) {
+        m_interval_of[vreg] = no_vreg;
+        if (!variable_reg(vreg)) {
+            m_interval_of[vreg] = static_cast<uint32_t>(m_intervals.size());
+            m_intervals.push_back(LiveInterval{.start = vreg, .end = vreg});
         }
-        else if (chunk != 0) {
-            output << "    movk " << target_reg << ", #";
-            emit_hex16(chunk);
-            add_shift(shift);
-            output << "\n";
+        const ExprInst& inst = m_expr_code[vreg];
+        for (uint32_t operand : {inst.lhs, inst.rhs}) {
+            if (operand != no_vreg && m_interval_of[operand] != no_vreg) {
+                m_intervals[m_interval_of[operand]].end = vreg;
+            }
         }
     }
-
-    if (!started) {
-        output << "    movz " << target_reg << ", #";
-        emit_hex16(0);
-        output << "\n";
+    // The result outlives the expression until its statement uses it.
+    if (m_interval_of.back() != no_vreg) {
+        m_intervals.back().end = count;
     }
+    RegAllocation allocation = linear_scan(m_intervals, m_temp_regs);
+    auto location_of = [&](uint32_t vreg) {
+        if (auto reg = variable_reg(vreg)) {
+            return Location{.spilled = false, .index = reg.value()};
+        }
+        return allocation.locations[m_interval_of[vreg]];
+    };
 
-    return output.str();
-}
+    // Spill slots sit above the variables' slots in the frame, and are free again
+    // once the expression is done.
+    m_spill_slots = std::max(m_spill_slots, allocation.spill_slots);
+    for (const Location& location : allocation.locations) {
+        if (!location.spilled) {
+            m_written_regs |= 1u << location.index;
+        }
+    }
+    auto spill_offset = [&](const Location& location) {
+        return (m_layout.slots + location.index) * 8;
+    };
 
-std::optional<int64_t> Generator::eval_const_expr(const NodeExpr* expr) {
-    if (auto term_expr = std::get_if<NodeTerm*>(&expr->variant)) {
-        const NodeTerm* term = *term_expr;
-        if (auto int_lit_term = std::get_if<NodeTermIntLit*>(&term->variant)) {
-            return std::stoll((*int_lit_term)->int_lit.value.value());
+    const MReg scratch[] = {m_regs.spill_scratch[0], m_regs.spill_scratch[1]};
+    auto operand = [&](uint32_t vreg, MReg scratch_reg) {
+        const Location location = location_of(vreg);
+        if (!location.spilled) {
+            return static_cast<MReg>(location.index);
         }
-        if (auto paren_term = std::get_if<NodeTermParen*>(&term->variant)) {
-            return eval_const_expr((*paren_term)->expr);
+        load(scratch_reg, spill_offset(location));
+        return scratch_reg;
+    };
+    for (uint32_t vreg = 0; vreg < count; vreg++) {
+        if (variable_reg(vreg)) {
+            continue;
         }
-        return {};
-    }
-    if (auto bin_expr = std::get_if<NodeBinExpr*>(&expr->variant)) {
-        const NodeBinExpr* bin = *bin_expr;
-        auto lhs = eval_const_expr(bin->lhs);
-        auto rhs = eval_const_expr(bin->rhs);
-        if (!lhs.has_value() || !rhs.has_value()) {
-            return {};
+        const ExprInst& inst = m_expr_code[vreg];
+        const Location location = location_of(vreg);
+        // Nothing reads the result inside the expression, so the last instruction may
+        // write it straight to where the caller wants it.
+        MReg dest_reg = location.spilled ? scratch[0] : static_cast<MReg>(location.index);
+        if (vreg == count - 1 && target_reg != no_reg && !location.spilled) {
+            dest_reg = target_reg;
         }
-        switch (bin->op.type) {
-            case TokenType::plus:
-                return lhs.value() + rhs.value();
-            case TokenType::minus:
-                return lhs.value() - rhs.value();
-            case TokenType::star:
-                return lhs.value() * rhs.value();
-            case TokenType::fslash:
-                return lhs.value() / rhs.value();
-            default:
-                return {};
+        switch (m_ast.kinds[inst.node]) {
+            case NodeKind::int_lit:
+                m_code.mov_imm(dest_reg, static_cast<uint64_t>(m_ast.int_value(inst.node)));
+                break;
+            case NodeKind::ident:
+                load(dest_reg, variable_offset(m_ast.rhs[inst.node]));
+                break;
+            default: {
+                MReg lhs_reg = operand(inst.lhs, scratch[0]);
+                MReg rhs_reg = operand(inst.rhs, scratch[1]);
+                emit_bin_op(inst.node, dest_reg, lhs_reg, rhs_reg);
+                break;
+            }
         }
-    }
-    return {};
-}
-
-std::string Generator::gen_term(const NodeTerm* term) {
-    if (auto int_lit_term = std::get_if<NodeTermIntLit*>(&term->variant)) {
-        Token token = (*int_lit_term)->int_lit;
-        uint64_t int_value = std::stoll(token.value.value());
-        std::string target_reg = acquire_reg();
-        m_output << handle_int64_immediates(int_value, target_reg);
-        return target_reg;
-    }
-    if (auto ident_term = std::get_if<NodeTermIdent*>(&term->variant)) {
-        Token token = (*ident_term)->ident;
-        std::string ident = token.value.value();
-        std::optional<Var> var = m_symbol_handler.findSymbol(ident);
-        if (!var.has_value()) {
-            std::cerr << "Undefined symbol " << ident << std::endl;
-            exit(EXIT_FAILURE);
+        if (location.spilled) {
+            store(dest_reg, spill_offset(location));
         }
-        std::string target_reg = acquire_reg();
-        load(target_reg, 8 + (m_stack_position - var.value().stack_position) * 16);
-        return target_reg;
-    }
-    if (auto paren_term = std::get_if<NodeTermParen*>(&term->variant)) {
-        return gen_expr((*paren_term)->expr);
     }
-    return "";
-}
 
-std::string Generator::gen_bin_expr(const NodeBinExpr* bin_expr) {
-    std::string lhs_reg = gen_expr(bin_expr->lhs);
-    std::string rhs_reg = gen_expr(bin_expr->rhs);
-    switch (bin_expr->op.type) {
-        case TokenType::plus:
-            add(lhs_reg, lhs_reg, rhs_reg);
-            break;
-        case TokenType::minus:
-            sub(lhs_reg, lhs_reg, rhs_reg);
-            break;
-        case TokenType::fslash:
-            div(lhs_reg, lhs_reg, rhs_reg);
-            break;
-        case TokenType::star:
-            mul(lhs_reg, lhs_reg, rhs_reg);
-            break;
-        default:
-            return "";
+    if (target_reg != no_reg && m_interval_of.back() != no_vreg && !location_of(count - 1).spilled) {
+        return target_reg;
     }
-    if (lhs_reg != rhs_reg) {
-        release_reg(rhs_reg);
+    MReg result_reg = operand(count - 1, target_reg == no_reg ? scratch[0] : target_reg);
+    if (target_reg != no_reg && result_reg != target_reg) {
+        m_code.emit(MOp::mov, target_reg, result_reg);
+        result_reg = target_reg;
     }
-    return lhs_reg;
+    return result_reg;
 }
 
-std::string Generator::gen_expr(const NodeExpr* expr) {
-    if (auto const_val = eval_const_expr(expr)) {
-        std::string target_reg = acquire_reg();
-        m_output << handle_int64_immediates(static_cast<uint64_t>(const_val.value()), target_reg);
-        return target_reg;
-    }
-    if (auto term_expr = std::get_if<NodeTerm*>(&expr->variant)) {
-        return gen_term((*term_expr));
-    }
-    if (auto bin_expr = std::get_if<NodeBinExpr*>(&expr->variant)) {
-        return gen_bin_expr((*bin_expr));
+void Generator::push_scope(NodeIndex scope) {
+    auto stmts = m_ast.stmts(scope);
+    for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+        m_tasks.push_back(Task{.action = Task::Action::stmt, .node = *it});
     }
-    return "";
 }
 
-void Generator::gen_scope(const NodeScope* scope) {
-    m_symbol_handler.enterScope();
-    size_t enter_stack_position = m_stack_position;
-    for (NodeStmt* stmt : scope->stmts) {
-        gen_stmt(stmt);
-    }
-    m_stack_position = enter_stack_position;
-    m_symbol_handler.exitScope();
+void Generator::gen_scope(NodeIndex scope) {
+    const size_t depth = m_tasks.size();
+    push_scope(scope);
+    run_tasks(depth);
 }
 
-void Generator::gen_ifstmt(const NodeStmtIf* ifstmt) {
-    std::string cond_reg = gen_expr(ifstmt->expr);
-    std::string false_label = get_branch_label();
-    cbz(cond_reg, false_label);
-    release_reg(cond_reg);
-    gen_scope(ifstmt->scope);
-    if (ifstmt->pred.has_value()) {
-        const std::string end_label = get_branch_label();
-        branch(end_label);
-        add_branch(false_label);
-        gen_ifpred(ifstmt->pred.value(), end_label);
-        add_branch(end_label);
-    }
-    else {
-        branch(false_label);
-        add_branch(false_label);
-    }
+void Generator::gen_stmt(NodeIndex stmt) {
+    const size_t depth = m_tasks.size();
+    m_tasks.push_back(Task{.action = Task::Action::stmt, .node = stmt});
+    run_tasks(depth);
 }
 
-void Generator::gen_ifpred(const NodeIfPred* ifpred, const std::string end_label) {
-    if (auto ifpred_elif = std::get_if<NodeStmtIf*>(&ifpred->variant)) {
-        auto ifstmt = (*ifpred_elif);
-        std::string cond_reg = gen_expr(ifstmt->expr);
-        if (ifstmt->pred.has_value()) {
-            std::string false_label = get_branch_label();
-            cbz(cond_reg, false_label);
-            release_reg(cond_reg);
-            gen_scope(ifstmt->scope);
-            branch(end_label);
-            add_branch(false_label);
-            gen_ifpred(ifstmt->pred.value(), end_label);
-        }
-        else {
-            cbz(cond_reg, end_label);
-            release_reg(cond_reg);
-            gen_scope(ifstmt->scope);
-            branch(end_label);
+void Generator::run_tasks(size_t depth) {
+    while (m_tasks.size() > depth) {
+        Task task = std::move(m_tasks.back());
+        m_tasks.pop_back();
+        switch (task.action) {
+            case Task::Action::stmt:
+                run_stmt(task.node);
+                break;
+            case Task::Action::after_if_block: {
+                NodeIndex pred = m_ast.payloads[task.node];
+                if (pred != no_node) {
+                    LabelId end_label = get_branch_label();
+                    branch(end_label);
+                    add_branch(task.false_label);
+                    m_tasks.push_back(Task{.action = Task::Action::label, .label = end_label});
+                    m_tasks.push_back(Task{.action = Task::Action::ifpred, .node = pred, .label = end_label});
+                }
+                else {
+                    branch(task.false_label);
+                    add_branch(task.false_label);
+                }
+                break;
+            }
+            case Task::Action::after_elif_block:
+                branch(task.label);
+                add_branch(task.false_label);
+                m_tasks.push_back(Task{.action = Task::Action::ifpred, .node = task.node, .label = task.label});
+                break;
+            case Task::Action::ifpred:
+                run_ifpred(task.node, task.label);
+                break;
+            case Task::Action::branch:
+                branch(task.label);
+                break;
+            case Task::Action::label:
+                add_branch(task.label);
+                break;
         }
     }
-    else if (auto ifpred_else = std::get_if<NodeIfPredElse*>(&ifpred->variant)) {
-        gen_scope((*ifpred_else)->scope);
-        branch(end_label);
-    }
 }
 
-void Generator::gen_stmt(const NodeStmt* stmt) {
-    if (auto stmt_return = std::get_if<NodeStmtReturn*>(&stmt->variant)) {
-        std::string result_reg = gen_expr((*stmt_return)->expr);
-        decrement_stack(m_stack_position);
-        if (result_reg != "x0") {
-            m_output << "    mov x0, " << result_reg << "\n";
-        }
-        release_reg(result_reg);
-        m_output << "    ret\n";
-        return;
-    }
-    if (auto stmt_exit = std::get_if<NodeStmtExit*>(&stmt->variant)) {
-        std::string result_reg = gen_expr((*stmt_exit)->expr);
-        if (result_reg != "x0") {
-            m_output << "    mov x0, " << result_reg << "\n";
-        }
-        decrement_stack(m_stack_position);
-        release_reg(result_reg);
-        _exit();
-        return;
-    }
-    if (auto stmt_let = std::get_if<NodeStmtLet*>(&stmt->variant)) {
-        std::string ident = (*stmt_let)->ident.value.value();
-        std::string result_reg = gen_expr((*stmt_let)->expr);
-        increment_stack();
-        store(result_reg, 8);
-        m_symbol_handler.declareSymbol(ident, m_stack_position);
-        release_reg(result_reg);
-        return;
-    }
-    if (auto stmt_assign = std::get_if<NodeStmtAssign*>(&stmt->variant)) {
-        std::string ident = (*stmt_assign)->ident.value.value();
-        if (auto var = m_symbol_handler.findSymbol(ident)) {
-            std::string result_reg = gen_expr((*stmt_assign)->expr);
-            store(result_reg, 8 + (m_stack_position - var.value().stack_position) * 16);
-            release_reg(result_reg);
-        }
-        else {
-            std::cerr << "Undeclared identifier " << ident << std::endl;
-            exit(EXIT_FAILURE);
-        }
+// Each link of an elif chain is generated once the block before it is done, so a
+// chain of any length needs only a few tasks at a time.
+void Generator::run_ifpred(NodeIndex ifpred, LabelId end_label) {
+    if (m_ast.kinds[ifpred] != NodeKind::stmt_if) {
+        m_tasks.push_back(Task{.action = Task::Action::branch, .label = end_label});
+        push_scope(m_ast.lhs[ifpred]);
         return;
     }
-    if (auto scope = std::get_if<NodeScope*>(&stmt->variant)) {
-        gen_scope((*scope));
-        return;
+    MReg cond_reg = gen_expr(m_ast.lhs[ifpred]);
+    NodeIndex pred = m_ast.payloads[ifpred];
+    if (pred != no_node) {
+        LabelId false_label = get_branch_label();
+        cbz(cond_reg, false_label);
+        m_tasks.push_back(Task{.action = Task::Action::after_elif_block, .node = pred, .label = end_label, .false_label = false_label});
     }
-    if (auto stmt_if = std::get_if<NodeStmtIf*>(&stmt->variant)) {
-        gen_ifstmt((*stmt_if));
+    else {
+        cbz(cond_reg, end_label);
+        m_tasks.push_back(Task{.action = Task::Action::branch, .label = end_label});
     }
+    push_scope(m_ast.rhs[ifpred]);
 }
 
-std::string Generator::gen_program() {
-    m_output << ".globl _main\n.p2align 2\n_main:\n";
-    for (NodeStmt* stmt : m_prog.stmts) {
-        gen_stmt(stmt);
+void Generator::run_stmt(NodeIndex stmt) {
+    switch (m_ast.kinds[stmt]) {
+        case NodeKind::stmt_return:
+            gen_expr(m_ast.lhs[stmt], 0);
+            if (m_return_label == 0) {
+                m_return_label = get_branch_label();
+            }
+            branch(m_return_label);
+            break;
+        case NodeKind::stmt_exit:
+            gen_expr(m_ast.lhs[stmt], 0);
+            _exit();
+            break;
+        case NodeKind::stmt_let:
+            assign_variable(stmt, m_ast.lhs[stmt]);
+            break;
+        case NodeKind::stmt_assign:
+            assign_variable(m_ast.rhs[stmt], m_ast.lhs[stmt]);
+            break;
+        case NodeKind::scope:
+            push_scope(stmt);
+            break;
+        case NodeKind::stmt_if: {
+            MReg cond_reg = gen_expr(m_ast.lhs[stmt]);
+            LabelId false_label = get_branch_label();
+            cbz(cond_reg, false_label);
+            m_tasks.push_back(Task{.action = Task::Action::after_if_block, .node = stmt, .false_label = false_label});
+            push_scope(m_ast.rhs[stmt]);
+            break;
+        }
+        default:
+            break;
     }
-    m_output << "    mov x0, #0\n";
-    _exit();
-    return m_output.str();
-}
-
-void Generator::increment_stack(int positions) {
-    m_output << "    sub sp, sp, #" << positions * 16 << "\n";
-    m_stack_position += positions;
-}
-
-void Generator::decrement_stack(int positions) {
-    m_output << "    add sp, sp, #" << positions * 16 << "\n";
-    m_stack_position -= positions;
 }
 
-size_t Generator::store(std::string reg, int stack_offset) {
-    m_output << "    str " << reg << ", [sp, #" << stack_offset << "]\n";
-    return m_stack_position;
-}
-
-void Generator::load(std::string reg, int stack_offset) {
-    m_output << "    ldr " << reg << ", [sp, #" << stack_offset << "]\n";
+void Generator::assign_variable(NodeIndex decl, NodeIndex expr) {
+    const Location& location = m_layout.location(decl);
+    if (!location.spilled) {
+        gen_expr(expr, static_cast<MReg>(location.index));
+        return;
+    }
+    store(gen_expr(expr), variable_offset(decl));
 }
 
-void Generator::add(std::string result_reg, std::string lhs_reg, std::string rhs_reg) {
-    m_output << "    add " << result_reg << ", " << lhs_reg << ", " << rhs_reg << "\n";
+uint32_t Generator::variable_offset(NodeIndex decl) const {
+    return m_layout.location(decl).index * 8;
 }
 
-void Generator::mul(std::string result_reg, std::string lhs_reg, std::string rhs_reg) {
-    m_output << "    mul " << result_reg << ", " << lhs_reg << ", " << rhs_reg << "\n";
-}
+// The frame is only known once every expression has been allocated, so the prologue
+// is put in front of the body afterwards. From sp up it holds the variables' slots,
+// the spill slots shared by all expressions, and the caller's callee-saved registers.
+// Those only need saving if the program can return; _exit never gives them back.
+MachineCode Generator::gen_program() {
+    auto stmts = m_ast.stmts(m_ast.root);
+    for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+        m_tasks.push_back(Task{.action = Task::Action::stmt, .node = *it});
+    }
+    run_tasks(0);
+    m_code.mov_imm(0, 0);
+    _exit();
+    std::vector<MInst> body = std::move(m_code.insts);
 
-void Generator::sub(std::string result_reg, std::string lhs_reg, std::string rhs_reg, bool with_flags) {
-    if (with_flags) {
-        m_output << "    subs ";
+    std::vector<PhysReg> saved;
+    if (m_returns) {
+        for (PhysReg reg : m_regs.allocatable) {
+            if (m_regs.is_callee_saved(reg) && (m_written_regs & 1u << reg) != 0) {
+                saved.push_back(reg);
+            }
+        }
     }
-    else {
-        m_output << "    sub ";
+    const size_t saved_offset = (m_layout.slots + m_spill_slots) * 8;
+    const size_t frame_bytes = (saved_offset + saved.size() * 8 + 15) / 16 * 16;
+
+    m_code.insts.clear();
+    m_code.insts.reserve(body.size() + saved.size() * 2 + 8);
+    m_code.adjust_sp(MOp::sub_imm, frame_bytes);
+    for (size_t i = 0; i < saved.size(); i++) {
+        store(saved[i], static_cast<uint32_t>(saved_offset + i * 8));
     }
-    m_output << result_reg << ", " << lhs_reg << ", " << rhs_reg << "\n";
-}
-
-void Generator::div(std::string result_reg, std::string lhs_reg, std::string rhs_reg) {
-    m_output << "    sdiv " << result_reg << ", " << lhs_reg << ", " << rhs_reg << "\n";
+    m_code.insts.insert(m_code.insts.end(), body.begin(), body.end());
+    if (m_return_label != 0) {
+        add_branch(m_return_label);
+        for (size_t i = 0; i < saved.size(); i++) {
+            load(saved[i], static_cast<uint32_t>(saved_offset + i * 8));
+        }
+        m_code.adjust_sp(MOp::add_imm, frame_bytes);
+        m_code.emit(MOp::ret);
+    }
+    return std::move(m_code);
 }
 
-void Generator::cbz(std::string cond_reg, std::string branch_label) {
-    m_output << "    cbz " << cond_reg << ", " << branch_label << "\n";
+void Generator::store(MReg reg, uint32_t stack_offset) {
+    m_code.emit(MOp::str, reg, 0, 0, stack_offset);
 }
 
-std::string Generator::acquire_reg() {
-    if (m_free_regs.empty()) {
-        std::cerr << "Register exhaustion during code generation" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    std::string reg = m_free_regs.back();
-    m_free_regs.pop_back();
-    return reg;
+void Generator::load(MReg reg, uint32_t stack_offset) {
+    m_code.emit(MOp::ldr, reg, 0, 0, stack_offset);
 }
 
-void Generator::release_reg(const std::string& reg) {
-    m_free_regs.push_back(reg);
+void Generator::cbz(MReg cond_reg, LabelId branch_label) {
+    m_code.emit(MOp::cbz, cond_reg, 0, 0, branch_label);
 }
 
-std::string Generator::get_branch_label() {
-    m_branch_number++;
-    return "LBB0_" + std::to_string(m_branch_number);
+LabelId Generator::get_branch_label() {
+    return ++m_branch_number;
 }
 
-void Generator::branch(std::string branch_label) {
-    m_output << "    b " << branch_label << "\n";
+void Generator::branch(LabelId branch_label) {
+    m_code.emit(MOp::b, 0, 0, 0, branch_label);
 }
 
-void Generator::add_branch(std::string branch_label) {
-    m_output << branch_label << ":\n";
+void Generator::add_branch(LabelId branch_label) {
+    m_code.emit(MOp::label, 0, 0, 0, branch_label);
 }
 
 void Generator::_exit() {
-    m_output << "    bl _exit\n";
+    m_code.emit(MOp::bl_exit);
 }
@@ -3,51 +3,94 @@
 #include <cstdint>
 #include <cstddef>
 #include <optional>
-#include <sstream>
-#include <string>
+#include <utility>
 #include <vector>
 
-#include "grammar.hpp"
-#include "scopes.hpp"
+#include "flat_ast.hpp"
+#include "frame.hpp"
+#include "machine.hpp"
+#include "regalloc.hpp"
+#include "target.hpp"
 
 
-std::string handle_int64_immediates(const uint64_t immediate, const std::string& target_reg);
-
 class Generator {
 public:
-    explicit Generator(NodeProgram prog);
+    // `ast` must have been through resolve_names without diagnostics. Constant
+    // subexpressions are only emitted as immediates once fold_constants has run.
+    // With `promote_variables`, variables live in callee-saved registers instead of
+    // stack slots for as long as there are registers left (see layout_frame).
+    // Registers are chosen among those of `target`.
+    explicit Generator(FlatAst ast, bool promote_variables = true, Target target = Target::arm64);
 
-    std::string gen_term(const NodeTerm* term);
-    std::string gen_bin_expr(const NodeBinExpr* bin_expr);
-    std::string gen_expr(const NodeExpr* expr);
-    void gen_scope(const NodeScope* scope);
-    void gen_ifstmt(const NodeStmtIf* ifstmt);
-    void gen_ifpred(const NodeIfPred* ifpred, const std::string end_label);
-    void gen_stmt(const NodeStmt* stmt);
-    std::string gen_program();
+    // Like the parser, these keep nesting on heap-allocated work stacks rather than
+    // the call stack.
+    // Leaves the value in `target_reg`, or in whichever register is convenient when
+    // none is given, and returns that register.
+    MReg gen_expr(NodeIndex expr, MReg target_reg = no_reg);
+    void gen_scope(NodeIndex scope);
+    void gen_stmt(NodeIndex stmt);
+    MachineCode gen_program();
 
 private:
-    void increment_stack(int positions = 1);
-    void decrement_stack(int positions = 1);
-    size_t store(std::string reg, int stack_offset);
-    void load(std::string reg, int stack_offset);
-    void add(std::string result_reg, std::string lhs_reg, std::string rhs_reg);
-    void mul(std::string result_reg, std::string lhs_reg, std::string rhs_reg);
-    void sub(std::string result_reg, std::string lhs_reg, std::string rhs_reg, bool with_flags = false);
-    void div(std::string result_reg, std::string lhs_reg, std::string rhs_reg);
-    void cbz(std::string cond_reg, std::string branch_label);
-    std::optional<int64_t> eval_const_expr(const NodeExpr* expr);
-    std::string acquire_reg();
-    void release_reg(const std::string& reg);
-    std::string get_branch_label();
-    void branch(std::string branch_label);
-    void add_branch(std::string branch_label);
+    // Work left for later, such as emitting the branch and label that follow the
+    // block of an if.
+    struct Task {
+        enum class Action : uint8_t {
+            stmt,
+            after_if_block,
+            after_elif_block,
+            ifpred,
+            branch,
+            label,
+        };
+        Action action;
+        NodeIndex node = no_node;
+        LabelId label = 0;
+        LabelId false_label = 0;
+    };
+
+    static constexpr uint32_t no_vreg = UINT32_MAX;
+
+    // One instruction of the expression being generated. It defines the virtual
+    // register numbered by its position; operators also read two earlier ones.
+    struct ExprInst {
+        NodeIndex node;
+        uint32_t lhs = no_vreg;
+        uint32_t rhs = no_vreg;
+    };
+
+    void run_tasks(size_t depth);
+    void run_stmt(NodeIndex stmt);
+    void run_ifpred(NodeIndex ifpred, LabelId end_label);
+    void push_scope(NodeIndex scope);
+    void emit_bin_op(NodeIndex bin_expr, MReg result_reg, MReg lhs_reg, MReg rhs_reg);
+    void assign_variable(NodeIndex decl, NodeIndex expr);
+    uint32_t variable_offset(NodeIndex decl) const;
+    void store(MReg reg, uint32_t stack_offset);
+    void load(MReg reg, uint32_t stack_offset);
+    void cbz(MReg cond_reg, LabelId branch_label);
+    LabelId get_branch_label();
+    void branch(LabelId branch_label);
+    void add_branch(LabelId branch_label);
     void _exit();
 
-    NodeProgram m_prog;
-    std::stringstream m_output;
-    size_t m_stack_position = 0;
-    size_t m_branch_number = 0;
-    SymbolManager m_symbol_handler;
-    std::vector<std::string> m_free_regs;
+    FlatAst m_ast;
+    const TargetRegs& m_regs;
+    MachineCode m_code;
+    LabelId m_branch_number = 0;
+    std::vector<Task> m_tasks;
+    std::vector<std::pair<NodeIndex, bool>> m_expr_work;
+    std::vector<uint32_t> m_expr_vregs;
+    std::vector<ExprInst> m_expr_code;
+    std::vector<LiveInterval> m_intervals;
+    // Interval index of each instruction's result, or no_vreg for variables read from
+    // their register.
+    std::vector<uint32_t> m_interval_of;
+    FrameLayout m_layout;
+    std::vector<PhysReg> m_temp_regs;
+    uint32_t m_spill_slots = 0;
+    // Bit n is set once register n has been written, to know which registers to save.
+    uint32_t m_written_regs = 0;
+    bool m_returns = false;
+    LabelId m_return_label = 0;
 };
@@ -1,19 +1,21 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
+#include <span>
 #include <variant>
-#include <vector>
 
+#include "interner.hpp"
 #include "tokenization.hpp"
 
 struct NodeExpr;
 
 struct NodeTermIdent {
-    Token ident;
+    SymbolId ident;
 };
 
 struct NodeTermIntLit {
-    Token int_lit;
+    int64_t int_lit;
 };
 
 struct NodeTermParen {
@@ -41,12 +43,14 @@ struct NodeStmtExit {
 };
 
 struct NodeStmtLet {
-    Token ident;
+    SymbolId ident;
     NodeExpr* expr;
 };
 
+// Child statements live in one contiguous array in the parser's arena, so the whole
+// tree can be dropped with the arena and nothing needs destroying.
 struct NodeScope {
-    std::vector<NodeStmt*> stmts;
+    std::span<NodeStmt*> stmts;
 };
 
 struct NodeIfPredElse {
@@ -66,7 +70,7 @@ struct NodeStmtIf {
 };
 
 struct NodeStmtAssign {
-    Token ident;
+    SymbolId ident;
     NodeExpr* expr;
 };
 
@@ -75,7 +79,7 @@ struct NodeStmt {
 };
 
 struct NodeProgram {
-    std::vector<NodeStmt*> stmts;
+    std::span<NodeStmt*> stmts;
 };
 
 struct NodeBinExpr {
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+#include "incremental.hpp"
+
+
+IncrementalParser::IncrementalParser(std::string src)
+    : m_src(std::move(src))
+    , m_tokenizer(m_src)
+{
+    // Edits rewrite the source in place, so identifiers cannot borrow their spelling
+    // from it.
+    m_tokenizer.interner().own_spellings();
+    m_tokens = m_tokenizer.tokenize();
+    m_relexed = m_tokens.size();
+    reparse_program();
+}
+
+void IncrementalParser::apply(const TextEdit& edit) {
+    if (edit.offset > m_src.size() || edit.removed > m_src.size() - edit.offset) {
+        std::cerr << "[Edit Error] Edit outside of the source" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    size_t removed = 0;
+    size_t added = 0;
+    size_t first = relex(edit, removed, added);
+
+    // Old scope indices still describe the token array from before the splice. The
+    // innermost scope whose braces sit outside the replaced tokens is the candidate,
+    // as long as the new tokens between its braces still balance.
+    auto candidate = std::partition_point(m_scopes.begin(), m_scopes.end(), [&](const ScopeSpan& scope) {
+        return scope.open < first;
+    });
+    for (auto index = static_cast<size_t>(candidate - m_scopes.begin()); index-- > 0;) {
+        const ScopeSpan& scope = m_scopes[index];
+        if (scope.close < first + removed) {
+            continue;
+        }
+        if (braces_match(scope.open, scope.close + added - removed)) {
+            reparse_scope(index, removed, added);
+            return;
+        }
+    }
+    reparse_program();
+}
+
+size_t IncrementalParser::relex(const TextEdit& edit, size_t& removed, size_t& added) {
+    // Every token that ends at or after the edit may change, since text inserted right
+    // after a word extends it. Lexing restarts where the token before those ends, so a
+    // comment that the edit opens or closes is seen again too.
+    auto after = std::partition_point(m_tokens.begin(), m_tokens.end(), [&](const Token& token) {
+        return token.offset <= edit.offset;
+    });
+    auto first = static_cast<size_t>(after - m_tokens.begin());
+    while (first > 0 && m_tokenizer.end_of(m_tokens[first - 1]) >= edit.offset) {
+        first--;
+    }
+    size_t restart = first > 0 ? m_tokenizer.end_of(m_tokens[first - 1]) : 0;
+
+    m_src.replace(edit.offset, edit.removed, edit.inserted);
+    m_tokenizer.set_source(m_src, restart);
+    const auto shift = static_cast<int64_t>(edit.inserted.size()) - static_cast<int64_t>(edit.removed);
+    const size_t edit_end = edit.offset + edit.inserted.size();
+
+    // Past the edit the text is unchanged, so a new token that starts where an old one
+    // did (after shifting) is that same token, and so is everything after it.
+    std::vector<Token> fresh;
+    size_t resync = m_tokens.size();
+    while (auto token = m_tokenizer.next()) {
+        if (token->offset >= edit_end) {
+            auto old_offset = static_cast<uint32_t>(token->offset - shift);
+            auto old = std::partition_point(m_tokens.begin() + static_cast<std::ptrdiff_t>(first), m_tokens.end(), [&](const Token& t) {
+                return t.offset < old_offset;
+            });
+            if (old != m_tokens.end() && old->offset == old_offset && old->type == token->type) {
+                resync = static_cast<size_t>(old - m_tokens.begin());
+                break;
+            }
+        }
+        fresh.push_back(token.value());
+    }
+
+    removed = resync - first;
+    added = fresh.size();
+    m_relexed = added;
+    auto begin = m_tokens.begin() + static_cast<std::ptrdiff_t>(first);
+    m_tokens.erase(begin, begin + static_cast<std::ptrdiff_t>(removed));
+    m_tokens.insert(m_tokens.begin() + static_cast<std::ptrdiff_t>(first), fresh.begin(), fresh.end());
+    for (size_t i = first + added; i < m_tokens.size(); i++) {
+        m_tokens[i].offset = static_cast<uint32_t>(m_tokens[i].offset + shift);
+    }
+    return first;
+}
+
+bool IncrementalParser::braces_match(size_t open, size_t close) const {
+    if (close >= m_tokens.size() || m_tokens[open].type != TokenType::open_curly) {
+        return false;
+    }
+    size_t depth = 0;
+    for (size_t i = open; i <= close; i++) {
+        if (m_tokens[i].type == TokenType::open_curly) {
+            depth++;
+        }
+        else if (m_tokens[i].type == TokenType::close_curly) {
+            if (--depth == 0) {
+                return i == close;
+            }
+        }
+    }
+    return false;
+}
+
+void IncrementalParser::reparse_scope(size_t index, size_t removed, size_t added) {
+    const uint32_t open = m_scopes[index].open;
+    const uint32_t old_close = m_scopes[index].close;
+    const auto new_close = static_cast<uint32_t>(old_close + added - removed);
+    const auto shift = static_cast<int64_t>(added) - static_cast<int64_t>(removed);
+
+    std::vector<ScopeSpan> inner;
+    Parser parser(m_tokenizer, std::span<const Token>(m_tokens).subspan(open, new_close - open + 1), &m_arena);
+    parser.record_scopes(&inner);
+    NodeScope* reparsed = parser.parse_scope().value();
+    // Parents point at the existing node, so it takes over the new statements.
+    m_scopes[index].scope->stmts = reparsed->stmts;
+    m_scopes[index].close = new_close;
+    m_reparsed = new_close - open + 1;
+
+    // The scope itself closes last; the rest are its new descendants.
+    inner.pop_back();
+    for (ScopeSpan& scope : inner) {
+        scope.open += open;
+        scope.close += open;
+    }
+    std::sort(inner.begin(), inner.end(), [](const ScopeSpan& a, const ScopeSpan& b) {
+        return a.open < b.open;
+    });
+
+    for (size_t i = 0; i < index; i++) {
+        if (m_scopes[i].close > old_close) {
+            m_scopes[i].close = static_cast<uint32_t>(m_scopes[i].close + shift);
+        }
+    }
+    size_t end = index + 1;
+    while (end < m_scopes.size() && m_scopes[end].open < old_close) {
+        end++;
+    }
+    for (size_t i = end; i < m_scopes.size(); i++) {
+        m_scopes[i].open = static_cast<uint32_t>(m_scopes[i].open + shift);
+        m_scopes[i].close = static_cast<uint32_t>(m_scopes[i].close + shift);
+    }
+    auto descendants = m_scopes.begin() + static_cast<std::ptrdiff_t>(index + 1);
+    m_scopes.erase(descendants, m_scopes.begin() + static_cast<std::ptrdiff_t>(end));
+    m_scopes.insert(m_scopes.begin() + static_cast<std::ptrdiff_t>(index + 1), inner.begin(), inner.end());
+}
+
+void IncrementalParser::reparse_program() {
+    m_scopes.clear();
+    Parser parser(m_tokenizer, std::span<const Token>(m_tokens), &m_arena);
+    parser.record_scopes(&m_scopes);
+    m_prog = parser.parse_program().value();
+    std::sort(m_scopes.begin(), m_scopes.end(), [](const ScopeSpan& a, const ScopeSpan& b) {
+        return a.open < b.open;
+    });
+    m_reparsed = m_tokens.size();
+}
+
+const NodeProgram& IncrementalParser::program() const {
+    return m_prog;
+}
+
+std::string_view IncrementalParser::source() const {
+    return m_src;
+}
+
+std::span<const Token> IncrementalParser::tokens() const {
+    return m_tokens;
+}
+
+const Tokenizer& IncrementalParser::tokenizer() const {
+    return m_tokenizer;
+}
+
+size_t IncrementalParser::relexed_tokens() const {
+    return m_relexed;
+}
+
+size_t IncrementalParser::reparsed_tokens() const {
+    return m_reparsed;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arena.hpp"
+#include "grammar.hpp"
+#include "parsing.hpp"
+
+
+// Replaces `removed` bytes at `offset` of the current source with `inserted`.
+struct TextEdit {
+    size_t offset;
+    size_t removed;
+    std::string_view inserted;
+};
+
+// A source file kept parsed across edits, for editors and watch mode.
+//
+// An edit re-lexes only from the token before it until the new tokens line up with
+// the old ones again, then re-parses the innermost `{}` block that still encloses
+// every changed token. That block's NodeScope is updated in place, so its parents and
+// every untouched scope elsewhere in the program keep their nodes. Edits that unbalance
+// braces widen to the next enclosing block, up to the whole program.
+//
+// Replaced nodes stay in the arena until the document is destroyed.
+class IncrementalParser {
+public:
+    explicit IncrementalParser(std::string src);
+
+    void apply(const TextEdit& edit);
+
+    const NodeProgram& program() const;
+    std::string_view source() const;
+    std::span<const Token> tokens() const;
+    const Tokenizer& tokenizer() const;
+
+    // What the last apply() had to redo.
+    size_t relexed_tokens() const;
+    size_t reparsed_tokens() const;
+
+    IncrementalParser(const IncrementalParser&) = delete;
+    IncrementalParser& operator=(const IncrementalParser&) = delete;
+
+private:
+    // Re-lexes around the edit and splices the result into m_tokens. Returns the index of
+    // the first replaced token, with `removed` and `added` set to how many old tokens were
+    // dropped and new ones put in their place.
+    size_t relex(const TextEdit& edit, size_t& removed, size_t& added);
+    bool braces_match(size_t open, size_t close) const;
+    void reparse_scope(size_t index, size_t removed, size_t added);
+    void reparse_program();
+
+    std::string m_src;
+    Tokenizer m_tokenizer;
+    std::vector<Token> m_tokens;
+    ArenaAllocator m_arena;
+    NodeProgram m_prog;
+    // Every scope in the program, ordered by the index of its opening brace.
+    std::vector<ScopeSpan> m_scopes;
+    size_t m_relexed = 0;
+    size_t m_reparsed = 0;
+};
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "interner.hpp"
+
+
+static uint32_t hash_spelling(std::string_view spelling) {
+    // Mixes eight bytes at a time; identifiers are short, so most take one or two rounds.
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ spelling.size();
+    size_t i = 0;
+    for (; i + 8 <= spelling.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, spelling.data() + i, 8);
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 31;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, spelling.data() + i, spelling.size() - i);
+    hash = (hash ^ tail) * 0x94D049BB133111EBull;
+    hash ^= hash >> 29;
+    return static_cast<uint32_t>(hash);
+}
+
+Interner::Interner()
+    : m_slots(64, Slot{.hash = 0, .id = empty_slot})
+{
+}
+
+SymbolId Interner::intern(std::string_view spelling) {
+    uint32_t hash = hash_spelling(spelling);
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot& slot = m_slots[i];
+        if (slot.id == empty_slot) {
+            SymbolId id = static_cast<SymbolId>(m_spellings.size());
+            slot = Slot{.hash = hash, .id = id};
+            m_spellings.push_back(m_storage ? store(spelling) : spelling);
+            // Keep the table at most half full so probe sequences stay short.
+            if (m_spellings.size() * 2 > m_slots.size()) {
+                grow();
+            }
+            return id;
+        }
+        if (slot.hash == hash && m_spellings[slot.id] == spelling) {
+            return slot.id;
+        }
+    }
+}
+
+void Interner::own_spellings() {
+    if (m_storage) {
+        return;
+    }
+    m_storage = std::make_unique<ArenaAllocator>(16 * 1024);
+    for (std::string_view& spelling : m_spellings) {
+        spelling = store(spelling);
+    }
+}
+
+std::string_view Interner::store(std::string_view spelling) {
+    std::span<char> copy = m_storage->alloc_array<char>(spelling.size());
+    std::copy(spelling.begin(), spelling.end(), copy.begin());
+    return std::string_view(copy.data(), copy.size());
+}
+
+void Interner::grow() {
+    std::vector<Slot> slots(m_slots.size() * 2, Slot{.hash = 0, .id = empty_slot});
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : m_slots) {
+        if (slot.id == empty_slot) {
+            continue;
+        }
+        size_t i = slot.hash & mask;
+        while (slots[i].id != empty_slot) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+    m_slots = std::move(slots);
+}
+
+std::string_view Interner::spelling(SymbolId id) const {
+    return m_spellings.at(id);
+}
+
+size_t Interner::size() const {
+    return m_spellings.size();
+}
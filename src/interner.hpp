@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "arena.hpp"
+
+
+// Dense id for an interned identifier. Ids are handed out in order of first
+// appearance, starting at 0.
+using SymbolId = uint32_t;
+
+// Maps each distinct identifier spelling to a SymbolId. Spellings are views into the
+// source buffer, so every name is stored exactly once and never copied. Lookups go
+// through a flat open-addressing table so interning allocates only when it grows.
+class Interner {
+public:
+    Interner();
+
+    // Copies every spelling into storage owned by the interner, now and for all later
+    // interns, so the source buffer may change or go away. Needed when the source is
+    // edited in place.
+    void own_spellings();
+    SymbolId intern(std::string_view spelling);
+    std::string_view spelling(SymbolId id) const;
+    size_t size() const;
+
+private:
+    struct Slot {
+        uint32_t hash;
+        SymbolId id;
+    };
+
+    static constexpr SymbolId empty_slot = UINT32_MAX;
+
+    void grow();
+    std::string_view store(std::string_view spelling);
+
+    std::vector<Slot> m_slots;
+    std::vector<std::string_view> m_spellings;
+    std::unique_ptr<ArenaAllocator> m_storage;
+};
@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <utility>
+
+#include "lower.hpp"
+#include "regalloc.hpp"
+#include "target.hpp"
+
+
+// Positions count instructions across the blocks in layout order. Each block
+// makes its phi copies at one position and runs its terminator at the next, and a
+// phi is live from the first copy into it, so that no other value can take its
+// place while any predecessor may still write it.
+SsaAllocation allocate_ssa(const SsaFunction& fn, Target target) {
+    std::vector<LiveInterval> intervals(fn.insts.size(), LiveInterval{.start = 0, .end = 0});
+    std::vector<uint32_t> copy_pos(fn.blocks.size(), 0);
+    auto use = [&](ValueId value, uint32_t pos) {
+        intervals[value].end = std::max(intervals[value].end, pos);
+    };
+    uint32_t pos = 0;
+    for (BlockId block = 0; block < fn.blocks.size(); block++) {
+        const SsaBlock& bb = fn.blocks[block];
+        for (ValueId value : bb.insts) {
+            const SsaInst& inst = fn.insts[value];
+            switch (inst.op) {
+                case SsaOp::phi: {
+                    uint32_t start = UINT32_MAX;
+                    std::span<const ValueId> incoming = fn.phi_incoming(value);
+                    for (size_t p = 0; p < incoming.size(); p++) {
+                        start = std::min(start, copy_pos[bb.preds[p]]);
+                        use(incoming[p], copy_pos[bb.preds[p]]);
+                    }
+                    intervals[value] = LiveInterval{.start = start, .end = start};
+                    break;
+                }
+                case SsaOp::constant:
+                    intervals[value] = LiveInterval{.start = pos, .end = pos};
+                    pos++;
+                    break;
+                case SsaOp::add:
+                case SsaOp::sub:
+                case SsaOp::mul:
+                case SsaOp::div:
+                    use(inst.a, pos);
+                    use(inst.b, pos);
+                    intervals[value] = LiveInterval{.start = pos, .end = pos};
+                    pos++;
+                    break;
+                default:
+                    copy_pos[block] = pos;
+                    if (inst.op != SsaOp::jmp) {
+                        use(inst.a, pos + 1);
+                    }
+                    pos += 2;
+                    break;
+            }
+        }
+    }
+
+    // Phis start before the block that holds them, so the intervals are sorted
+    // here rather than taken in definition order.
+    std::vector<ValueId> order;
+    for (const SsaBlock& bb : fn.blocks) {
+        for (ValueId value : bb.insts) {
+            if (fn.insts[value].type == ValueType::i64) {
+                order.push_back(value);
+            }
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](ValueId lhs, ValueId rhs) {
+        return intervals[lhs].start < intervals[rhs].start;
+    });
+    std::vector<LiveInterval> sorted;
+    sorted.reserve(order.size());
+    for (ValueId value : order) {
+        sorted.push_back(intervals[value]);
+    }
+    RegAllocation allocation = linear_scan(sorted, target_regs(target).allocatable);
+    SsaAllocation result;
+    result.spill_slots = allocation.spill_slots;
+    result.locations.assign(fn.insts.size(), Location{.spilled = false, .index = 0});
+    for (size_t i = 0; i < order.size(); i++) {
+        result.locations[order[i]] = allocation.locations[i];
+    }
+    result.intervals = std::move(intervals);
+    return result;
+}
+
+namespace {
+
+class SsaLowering {
+public:
+    SsaLowering(const SsaFunction& fn, Target target)
+        : m_fn(fn)
+        , m_target(target)
+        , m_regs(target_regs(target))
+    {
+    }
+
+    // Like the generator, the prologue goes in front of the body once the frame is
+    // known: the spill slots from sp up, then the caller's callee-saved registers,
+    // which only need saving if the program can return.
+    MachineCode run() {
+        allocate();
+        m_labelled.assign(m_fn.blocks.size(), false);
+        for (BlockId block = 0; block < m_fn.blocks.size(); block++) {
+            emit_block(block);
+        }
+        std::vector<MInst> body = std::move(m_code.insts);
+
+        bool returns = std::any_of(m_fn.blocks.begin(), m_fn.blocks.end(), [&](const SsaBlock& block) {
+            return m_fn.insts[block.insts.back()].op == SsaOp::ret;
+        });
+        std::vector<PhysReg> saved;
+        if (returns) {
+            for (PhysReg reg : m_regs.allocatable) {
+                if (m_regs.is_callee_saved(reg) && (m_written_regs & 1u << reg) != 0) {
+                    saved.push_back(reg);
+                }
+            }
+        }
+        const size_t saved_offset = m_spill_slots * 8;
+        const size_t frame_bytes = (saved_offset + saved.size() * 8 + 15) / 16 * 16;
+
+        m_code.insts.clear();
+        m_code.insts.reserve(body.size() + saved.size() * 2 + 8);
+        m_code.adjust_sp(MOp::sub_imm, frame_bytes);
+        for (size_t i = 0; i < saved.size(); i++) {
+            m_code.emit(MOp::str, saved[i], 0, 0, static_cast<uint32_t>(saved_offset + i * 8));
+        }
+        m_code.insts.insert(m_code.insts.end(), body.begin(), body.end());
+        if (returns) {
+            m_code.emit(MOp::label, 0, 0, 0, return_label());
+            for (size_t i = 0; i < saved.size(); i++) {
+                m_code.emit(MOp::ldr, saved[i], 0, 0, static_cast<uint32_t>(saved_offset + i * 8));
+            }
+            m_code.adjust_sp(MOp::add_imm, frame_bytes);
+            m_code.emit(MOp::ret);
+        }
+        return std::move(m_code);
+    }
+
+private:
+    void allocate() {
+        SsaAllocation allocation = allocate_ssa(m_fn, m_target);
+        m_locations = std::move(allocation.locations);
+        m_spill_slots = allocation.spill_slots;
+        for (ValueId value = 0; value < m_fn.insts.size(); value++) {
+            if (m_fn.insts[value].type == ValueType::i64 && !m_locations[value].spilled) {
+                m_written_regs |= 1u << m_locations[value].index;
+            }
+        }
+    }
+
+    void emit_block(BlockId block) {
+        if (m_labelled[block]) {
+            m_code.emit(MOp::label, 0, 0, 0, block);
+        }
+        const MReg scratch[] = {m_regs.spill_scratch[0], m_regs.spill_scratch[1]};
+        for (ValueId value : m_fn.blocks[block].insts) {
+            const SsaInst& inst = m_fn.insts[value];
+            const Location location = m_locations[value];
+            const MReg dest_reg = location.spilled ? scratch[0] : static_cast<MReg>(location.index);
+            switch (inst.op) {
+                case SsaOp::phi:
+                    continue;
+                case SsaOp::constant:
+                    m_code.mov_imm(dest_reg, static_cast<uint64_t>(m_fn.constant_value(value)));
+                    break;
+                case SsaOp::add:
+                case SsaOp::sub:
+                case SsaOp::mul:
+                case SsaOp::div: {
+                    static constexpr MOp ops[] = {MOp::add, MOp::sub, MOp::mul, MOp::sdiv};
+                    MReg lhs_reg = operand(m_locations[inst.a], scratch[0]);
+                    MReg rhs_reg = operand(m_locations[inst.b], scratch[1]);
+                    m_code.emit(ops[static_cast<int>(inst.op) - static_cast<int>(SsaOp::add)], dest_reg, lhs_reg, rhs_reg);
+                    break;
+                }
+                default:
+                    emit_copies(block);
+                    emit_terminator(block, inst);
+                    continue;
+            }
+            if (location.spilled) {
+                m_code.emit(MOp::str, dest_reg, 0, 0, location.index * 8);
+            }
+        }
+    }
+
+    void emit_terminator(BlockId block, const SsaInst& inst) {
+        switch (inst.op) {
+            case SsaOp::br: {
+                MReg cond_reg = operand(m_locations[inst.a], m_regs.spill_scratch[0]);
+                // Fall through to whichever side comes next.
+                if (inst.b == block + 1) {
+                    m_code.emit(MOp::cbz, cond_reg, 0, 0, branch_to(inst.c));
+                }
+                else {
+                    m_code.emit(MOp::cbnz, cond_reg, 0, 0, branch_to(inst.b));
+                    if (inst.c != block + 1) {
+                        m_code.emit(MOp::b, 0, 0, 0, branch_to(inst.c));
+                    }
+                }
+                break;
+            }
+            case SsaOp::jmp:
+                if (inst.a != block + 1) {
+                    m_code.emit(MOp::b, 0, 0, 0, branch_to(inst.a));
+                }
+                break;
+            case SsaOp::ret:
+                move(Location{.spilled = false, .index = 0}, m_locations[inst.a]);
+                m_code.emit(MOp::b, 0, 0, 0, return_label());
+                break;
+            default:
+                move(Location{.spilled = false, .index = 0}, m_locations[inst.a]);
+                m_code.emit(MOp::bl_exit);
+                break;
+        }
+    }
+
+    // All the phis of the successors take their incoming values at once, so the moves
+    // are ordered to read every source before it is overwritten. A cycle of moves is
+    // broken by parking one of its values in the second scratch register.
+    void emit_copies(BlockId block) {
+        m_moves.clear();
+        for (BlockId succ : m_fn.successors(block)) {
+            const SsaBlock& bb = m_fn.blocks[succ];
+            auto index = static_cast<size_t>(std::find(bb.preds.begin(), bb.preds.end(), block) - bb.preds.begin());
+            for (ValueId value : bb.insts) {
+                if (m_fn.insts[value].op != SsaOp::phi) {
+                    break;
+                }
+                Location src = m_locations[m_fn.phi_incoming(value)[index]];
+                if (!same(m_locations[value], src)) {
+                    m_moves.emplace_back(m_locations[value], src);
+                }
+            }
+        }
+        while (!m_moves.empty()) {
+            auto ready = std::find_if(m_moves.begin(), m_moves.end(), [&](const auto& candidate) {
+                return std::none_of(m_moves.begin(), m_moves.end(), [&](const auto& other) {
+                    return same(other.second, candidate.first);
+                });
+            });
+            if (ready == m_moves.end()) {
+                const Location parked{.spilled = false, .index = m_regs.spill_scratch[1]};
+                const Location dest = m_moves.front().first;
+                move(parked, dest);
+                for (auto& [to, from] : m_moves) {
+                    if (same(from, dest)) {
+                        from = parked;
+                    }
+                }
+                continue;
+            }
+            move(ready->first, ready->second);
+            m_moves.erase(ready);
+        }
+    }
+
+    void move(const Location& to, const Location& from) {
+        if (same(to, from)) {
+            return;
+        }
+        if (!to.spilled) {
+            const auto to_reg = static_cast<MReg>(to.index);
+            if (from.spilled) {
+                m_code.emit(MOp::ldr, to_reg, 0, 0, from.index * 8);
+            }
+            else {
+                m_code.emit(MOp::mov, to_reg, static_cast<MReg>(from.index));
+            }
+            return;
+        }
+        m_code.emit(MOp::str, operand(from, m_regs.spill_scratch[0]), 0, 0, to.index * 8);
+    }
+
+    MReg operand(const Location& location, MReg scratch_reg) {
+        if (!location.spilled) {
+            return static_cast<MReg>(location.index);
+        }
+        m_code.emit(MOp::ldr, scratch_reg, 0, 0, location.index * 8);
+        return scratch_reg;
+    }
+
+    static bool same(const Location& lhs, const Location& rhs) {
+        return lhs.spilled == rhs.spilled && lhs.index == rhs.index;
+    }
+
+    LabelId branch_to(BlockId block) {
+        m_labelled[block] = true;
+        return block;
+    }
+
+    // Block labels are numbered by block, so the epilogue takes the next number.
+    LabelId return_label() const {
+        return static_cast<LabelId>(m_fn.blocks.size());
+    }
+
+    const SsaFunction& m_fn;
+    Target m_target;
+    const TargetRegs& m_regs;
+    MachineCode m_code;
+    std::vector<Location> m_locations;
+    uint32_t m_spill_slots = 0;
+    // Bit n is set once register n has been written, to know which registers to save.
+    uint32_t m_written_regs = 0;
+    // Blocks some branch jumps to, and so need a label.
+    std::vector<bool> m_labelled;
+    std::vector<std::pair<Location, Location>> m_moves;
+};
+
+} // namespace
+
+MachineCode lower_ssa(const SsaFunction& fn, Target target) {
+    SsaLowering lowering(fn, target);
+    return lowering.run();
+}
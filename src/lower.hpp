@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "machine.hpp"
+#include "regalloc.hpp"
+#include "ssa.hpp"
+#include "target.hpp"
+
+
+// Selects instructions for `fn`, which must pass verify_ssa, using the registers of
+// `target`. Blocks are laid out in order, every value gets a live interval over that
+// layout and a place from linear_scan, and phis become copies at the end of their
+// predecessors.
+MachineCode lower_ssa(const SsaFunction& fn, Target target = Target::arm64);
+
+// The places lower_ssa gives the values of `fn`, indexed by ValueId along with the
+// intervals they were allocated over. Values without an i64 result have empty
+// intervals and no place of their own.
+struct SsaAllocation {
+    std::vector<LiveInterval> intervals;
+    std::vector<Location> locations;
+    uint32_t spill_slots = 0;
+};
+
+SsaAllocation allocate_ssa(const SsaFunction& fn, Target target = Target::arm64);
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <charconv>
+
+#include "machine.hpp"
+
+
+void MachineCode::emit(MOp op, MReg rd, MReg rn, MReg rm, uint32_t imm) {
+    insts.push_back(MInst{.op = op, .rd = rd, .rn = rn, .rm = rm, .imm = imm});
+}
+
+void MachineCode::mov_imm(MReg rd, uint64_t value) {
+    bool started = false;
+    for (uint8_t shift = 0; shift < 64; shift += 16) {
+        auto chunk = static_cast<uint16_t>(value >> shift);
+        if (chunk != 0) {
+            emit(started ? MOp::movk : MOp::movz, rd, shift, 0, chunk);
+            started = true;
+        }
+    }
+    if (!started) {
+        emit(MOp::movz, rd, 0, 0, 0);
+    }
+}
+
+void MachineCode::adjust_sp(MOp op, size_t bytes) {
+    while (bytes > 0) {
+        size_t step = std::min<size_t>(bytes, 4080);
+        emit(op, sp_reg, sp_reg, 0, static_cast<uint32_t>(step));
+        bytes -= step;
+    }
+}
+
+namespace {
+
+// Appends straight into one string, without streams or temporaries.
+class AsmWriter {
+public:
+    explicit AsmWriter(std::string& out)
+        : m_out(out)
+    {
+    }
+
+    void op(std::string_view mnemonic) {
+        m_out += "    ";
+        m_out += mnemonic;
+        m_out += ' ';
+    }
+
+    void reg(MReg reg) {
+        if (reg == sp_reg) {
+            m_out += "sp";
+            return;
+        }
+        m_out += 'x';
+        number(reg);
+    }
+
+    void sep() {
+        m_out += ", ";
+    }
+
+    void number(uint32_t value) {
+        char buffer[10];
+        auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        m_out.append(buffer, end);
+    }
+
+    void hex16(uint32_t value) {
+        static constexpr char digits[] = "0123456789abcdef";
+        char buffer[] = {'#', '0', 'x', digits[value >> 12 & 15], digits[value >> 8 & 15], digits[value >> 4 & 15], digits[value & 15]};
+        m_out.append(buffer, sizeof(buffer));
+    }
+
+    void label(LabelId label) {
+        m_out += "LBB0_";
+        number(label);
+    }
+
+    void sp_offset(uint32_t offset) {
+        m_out += "[sp, #";
+        number(offset);
+        m_out += ']';
+    }
+
+    void end() {
+        m_out += '\n';
+    }
+
+private:
+    std::string& m_out;
+};
+
+} // namespace
+
+std::string print_asm(const MachineCode& code) {
+    static constexpr std::string_view mnemonics[] = {
+        "movz", "movk", "mov", "add", "sub", "mul", "sdiv", "add", "sub",
+        "ldr", "str", "cbz", "cbnz", "b", "bl", "ret",
+    };
+    std::string out;
+    out.reserve(code.insts.size() * 24 + 64);
+    out += ".globl _main\n.p2align 2\n_main:\n";
+    AsmWriter w(out);
+    for (const MInst& inst : code.insts) {
+        if (inst.op == MOp::label) {
+            w.label(inst.imm);
+            out += ":\n";
+            continue;
+        }
+        if (inst.op == MOp::ret) {
+            out += "    ret\n";
+            continue;
+        }
+        w.op(mnemonics[static_cast<size_t>(inst.op)]);
+        switch (inst.op) {
+            case MOp::movz:
+            case MOp::movk:
+                w.reg(inst.rd);
+                w.sep();
+                w.hex16(inst.imm);
+                if (inst.rn != 0) {
+                    out += ", lsl #";
+                    w.number(inst.rn);
+                }
+                break;
+            case MOp::mov:
+                w.reg(inst.rd);
+                w.sep();
+                w.reg(inst.rn);
+                break;
+            case MOp::add:
+            case MOp::sub:
+            case MOp::mul:
+            case MOp::sdiv:
+                w.reg(inst.rd);
+                w.sep();
+                w.reg(inst.rn);
+                w.sep();
+                w.reg(inst.rm);
+                break;
+            case MOp::add_imm:
+            case MOp::sub_imm:
+                w.reg(inst.rd);
+                w.sep();
+                w.reg(inst.rn);
+                out += ", #";
+                w.number(inst.imm);
+                break;
+            case MOp::ldr:
+            case MOp::str:
+                w.reg(inst.rd);
+                w.sep();
+                w.sp_offset(inst.imm);
+                break;
+            case MOp::cbz:
+            case MOp::cbnz:
+                w.reg(inst.rd);
+                w.sep();
+                w.label(inst.imm);
+                break;
+            case MOp::b:
+                w.label(inst.imm);
+                break;
+            default:
+                out += "_exit";
+                break;
+        }
+        w.end();
+    }
+    return out;
+}
+
+namespace {
+
+class AsmReader {
+public:
+    explicit AsmReader(std::string_view line)
+        : m_rest(line)
+    {
+    }
+
+    bool done() const {
+        return m_rest.empty();
+    }
+
+    std::string_view word() {
+        skip();
+        size_t end = m_rest.find_first_of(" ,]");
+        std::string_view word = m_rest.substr(0, end);
+        m_rest.remove_prefix(word.size());
+        return word;
+    }
+
+    MReg reg() {
+        std::string_view name = word();
+        return name == "sp" ? sp_reg : static_cast<MReg>(number(name.substr(1)));
+    }
+
+    uint32_t imm() {
+        std::string_view text = word();
+        text.remove_prefix(1);
+        if (text.starts_with("0x")) {
+            return number(text.substr(2), 16);
+        }
+        return number(text);
+    }
+
+    LabelId label() {
+        return number(word().substr(5));
+    }
+
+    uint32_t sp_offset() {
+        skip();
+        m_rest.remove_prefix(std::string_view("[sp, ").size());
+        uint32_t offset = imm();
+        m_rest.remove_prefix(1);
+        return offset;
+    }
+
+private:
+    void skip() {
+        while (!m_rest.empty() && (m_rest.front() == ' ' || m_rest.front() == ',')) {
+            m_rest.remove_prefix(1);
+        }
+    }
+
+    static uint32_t number(std::string_view text, int base = 10) {
+        uint32_t value = 0;
+        std::from_chars(text.data(), text.data() + text.size(), value, base);
+        return value;
+    }
+
+    std::string_view m_rest;
+};
+
+} // namespace
+
+MachineCode parse_asm(std::string_view text) {
+    MachineCode code;
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        if (line.starts_with("LBB0_") && line.ends_with(':')) {
+            line.remove_suffix(1);
+            code.emit(MOp::label, 0, 0, 0, AsmReader(line).label());
+            continue;
+        }
+        if (!line.starts_with("    ")) {
+            continue;
+        }
+        AsmReader r(line);
+        std::string_view mnemonic = r.word();
+        if (mnemonic == "movz" || mnemonic == "movk") {
+            MReg rd = r.reg();
+            uint32_t chunk = r.imm();
+            MReg shift = 0;
+            if (!r.done()) {
+                r.word();
+                shift = static_cast<MReg>(r.imm());
+            }
+            code.emit(mnemonic == "movz" ? MOp::movz : MOp::movk, rd, shift, 0, chunk);
+        }
+        else if (mnemonic == "mov") {
+            MReg rd = r.reg();
+            MReg rn = r.reg();
+            code.emit(MOp::mov, rd, rn);
+        }
+        else if (mnemonic == "add" || mnemonic == "sub" || mnemonic == "mul" || mnemonic == "sdiv") {
+            MReg rd = r.reg();
+            MReg rn = r.reg();
+            AsmReader peek = r;
+            if (peek.word().starts_with('#')) {
+                code.emit(mnemonic == "add" ? MOp::add_imm : MOp::sub_imm, rd, rn, 0, r.imm());
+                continue;
+            }
+            MReg rm = r.reg();
+            MOp op = mnemonic == "add" ? MOp::add : mnemonic == "sub" ? MOp::sub : mnemonic == "mul" ? MOp::mul : MOp::sdiv;
+            code.emit(op, rd, rn, rm);
+        }
+        else if (mnemonic == "ldr" || mnemonic == "str") {
+            MReg rd = r.reg();
+            code.emit(mnemonic == "ldr" ? MOp::ldr : MOp::str, rd, 0, 0, r.sp_offset());
+        }
+        else if (mnemonic == "cbz" || mnemonic == "cbnz") {
+            MReg rd = r.reg();
+            code.emit(mnemonic == "cbz" ? MOp::cbz : MOp::cbnz, rd, 0, 0, r.label());
+        }
+        else if (mnemonic == "b") {
+            code.emit(MOp::b, 0, 0, 0, r.label());
+        }
+        else if (mnemonic == "bl") {
+            code.emit(MOp::bl_exit);
+        }
+        else if (mnemonic == "ret") {
+            code.emit(MOp::ret);
+        }
+    }
+    return code;
+}
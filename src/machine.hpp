@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// A register of the target by number (see TargetRegs), and sp as 31 where an
+// instruction takes it.
+using MReg = uint8_t;
+
+constexpr MReg sp_reg = 31;
+constexpr MReg no_reg = UINT8_MAX;
+
+// Printed as LBB0_<id>, or .LBB0_<id> on ELF targets.
+using LabelId = uint32_t;
+
+// What each op keeps in its rd / rn / rm / imm slots. Memory is always addressed as
+// an offset from sp.
+enum class MOp : uint8_t {
+    movz,     // rd, imm: 16-bit chunk, rn: left shift (0, 16, 32 or 48)
+    movk,
+    mov,      // rd, rn
+    add,      // rd, rn, rm
+    sub,
+    mul,
+    sdiv,
+    add_imm,  // rd, rn, imm: 12-bit unsigned immediate
+    sub_imm,
+    ldr,      // rd, imm: byte offset from sp
+    str,
+    cbz,      // rd, imm: label
+    cbnz,
+    b,        // imm: label
+    bl_exit,
+    ret,
+    label,    // imm: label
+};
+
+// One instruction or label in 8 bytes, instead of a line of text. The ops are
+// shaped after AArch64's: print_asm writes them one to one, and print_x86_64_asm
+// expands each into the x86-64 instructions that do the same.
+struct MInst {
+    MOp op;
+    MReg rd = 0;
+    MReg rn = 0;
+    MReg rm = 0;
+    uint32_t imm = 0;
+
+    bool operator==(const MInst&) const = default;
+};
+
+static_assert(sizeof(MInst) == 8);
+
+// Code for _main as a contiguous buffer of records, which passes can rewrite before
+// print_asm turns it into text.
+struct MachineCode {
+    std::vector<MInst> insts;
+
+    void emit(MOp op, MReg rd = 0, MReg rn = 0, MReg rm = 0, uint32_t imm = 0);
+    // A movz for the lowest nonzero 16-bit chunk and a movk for each other one.
+    void mov_imm(MReg rd, uint64_t value);
+    // add and sub take a 12-bit immediate, so a large frame is moved in several steps.
+    void adjust_sp(MOp op, size_t bytes);
+};
+
+// ARM64 assembly for Apple's assembler, headed by the directives that export _main.
+std::string print_asm(const MachineCode& code);
+
+// Reads back the instructions and labels print_asm writes, skipping the header, for
+// tests and tools that start from text.
+MachineCode parse_asm(std::string_view text);
@@ -1,42 +1,179 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "arena.hpp"
+#include "bytecode.hpp"
+#include "elf.hpp"
+#include "encoder.hpp"
+#include "flat_ast.hpp"
+#include "fold.hpp"
 #include "generator.hpp"
+#include "lower.hpp"
+#include "machine.hpp"
+#include "optimize.hpp"
 #include "parsing.hpp"
+#include "peephole.hpp"
+#include "resolve.hpp"
+#include "ssa.hpp"
+#include "target.hpp"
 #include "tokenization.hpp"
 
 
+static constexpr size_t parallel_lex_threshold = 4 * 1024 * 1024;
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    // --no-ssa generates straight from the tree instead of going through the SSA form,
+    // and the --no- flags after it each turn off one optimization pass on that form.
+    // The peephole pass runs on the instructions either way, unless --no-peephole.
+    // --target=x86_64 writes x86-64 System V assembly instead of ARM64. --emit-obj
+    // encodes ARM64 into an ELF object, test_files/out.o, instead of writing assembly
+    // for an external assembler. `seabsy run <file_name>.sy` instead runs the program
+    // on the bytecode interpreter and exits with the status it exits with.
+    bool run = argc > 1 && std::string_view(argv[1]) == "run";
+    bool use_ssa = true;
+    SsaPasses passes;
+    bool use_peephole = true;
+    bool peephole_stats = false;
+    bool emit_obj = false;
+    Target target = Target::arm64;
+    bool usage_error = false;
+    char* file_name = nullptr;
+    for (int i = run ? 2 : 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--no-ssa") {
+            use_ssa = false;
+        }
+        else if (arg == "--no-sccp") {
+            passes.constant_propagation = false;
+        }
+        else if (arg == "--no-merge-blocks") {
+            passes.block_merging = false;
+        }
+        else if (arg == "--no-unreachable") {
+            passes.unreachable_blocks = false;
+        }
+        else if (arg == "--no-gvn") {
+            passes.value_numbering = false;
+        }
+        else if (arg == "--no-copy-prop") {
+            passes.copy_propagation = false;
+        }
+        else if (arg == "--no-dce") {
+            passes.dead_values = false;
+        }
+        else if (arg == "--no-peephole") {
+            use_peephole = false;
+        }
+        else if (arg == "--peephole-stats") {
+            peephole_stats = true;
+        }
+        else if (arg == "--emit-obj") {
+            emit_obj = true;
+        }
+        else if (arg.starts_with("--target=")) {
+            std::optional<Target> parsed = parse_target(arg.substr(std::string_view("--target=").size()));
+            usage_error |= !parsed.has_value();
+            target = parsed.value_or(target);
+        }
+        else if (file_name == nullptr) {
+            file_name = argv[i];
+        }
+        else {
+            file_name = nullptr;
+            break;
+        }
+    }
+    if (file_name == nullptr || usage_error || (emit_obj && target != Target::arm64) || (run && argc != 3)) {
         std::cerr << "Incorrect usage." << std::endl;
-        std::cerr << "Correct usage: seabsy <file_name>.sy" << std::endl;
+        std::cerr << "Correct usage: seabsy [--no-ssa] [--no-sccp] [--no-unreachable] [--no-merge-blocks] [--no-gvn] [--no-copy-prop] [--no-dce] [--no-peephole] [--peephole-stats] [--target=x86_64|arm64] [--emit-obj (arm64 only)] <file_name>.sy" << std::endl;
+        std::cerr << "         or: seabsy run <file_name>.sy" << std::endl;
         return EXIT_FAILURE;
     }
 
-    char* file_name = argv[1];
     std::ifstream file;
-    file.open(file_name);
+    file.open(file_name, std::ios::binary | std::ios::ate);
     if (file.fail()){
         std::cerr << "Couldn't open file" << std::endl;
         return EXIT_FAILURE;
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string file_contents;
-    file_contents = buffer.str();
+    // Read straight into the one buffer that every token and AST node borrows from.
+    std::string file_contents(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(file_contents.data(), static_cast<std::streamsize>(file_contents.size()));
     file.close();
 
+    // The parser pulls tokens from the tokenizer as it goes rather than lexing the
+    // whole file up front, unless the file is large enough to lex on every core first.
     Tokenizer tokenizer(file_contents);
-    std::vector<Token> tokens = tokenizer.tokenize();
-    Parser parser(tokens);
-    std::optional<NodeProgram> program = parser.parse_program();
-    std::optional<Generator> generator(program);
+    ArenaAllocator arena;
+    std::optional<NodeProgram> program;
+    unsigned threads = std::thread::hardware_concurrency();
+    if (file_contents.size() >= parallel_lex_threshold && threads > 1) {
+        Parser parser(tokenizer, tokenizer.tokenize_parallel(threads), &arena);
+        program = parser.parse_program();
+    }
+    else {
+        Parser parser(tokenizer, &arena);
+        program = parser.parse_program();
+    }
+    FlatAst ast = flatten(program.value());
+    std::vector<std::string> diagnostics = resolve_names(ast, tokenizer.interner());
+    if (!diagnostics.empty()) {
+        for (const std::string& diagnostic : diagnostics) {
+            std::cerr << diagnostic << std::endl;
+        }
+        return EXIT_FAILURE;
+    }
+    fold_constants(ast);
+    if (run) {
+        return static_cast<int>(run_bytecode(compile_bytecode(ast)));
+    }
+    MachineCode code;
+    if (use_ssa) {
+        SsaFunction fn = build_ssa(ast);
+        optimize_ssa(fn, passes);
+        code = lower_ssa(fn, target);
+    }
+    else {
+        Generator generator(std::move(ast), true, target);
+        code = generator.gen_program();
+    }
+
+    if (use_peephole) {
+        PeepholeStats stats;
+        peephole(code, stats);
+        if (peephole_stats) {
+            std::span<const PeepholeRule> rules = peephole_rules();
+            for (size_t i = 0; i < rules.size(); i++) {
+                std::cerr << rules[i].name << ": " << stats.fired[i] << std::endl;
+            }
+        }
+    }
+
+    if (emit_obj) {
+        std::vector<std::string> errors;
+        ObjectCode object = encode_arm64(code, errors);
+        if (!errors.empty()) {
+            for (const std::string& error : errors) {
+                std::cerr << error << std::endl;
+            }
+            return EXIT_FAILURE;
+        }
+        std::vector<uint8_t> bytes = write_elf_object(object, elf_machine_aarch64);
+        std::ofstream outfile ("test_files/out.o", std::ios::binary);
+        outfile.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        outfile.close();
+        return EXIT_SUCCESS;
+    }
 
     std::ofstream outfile ("test_files/out.asm");
-    outfile << generator->gen_program();
+    outfile << print_target_asm(code, target);
     outfile.close();
 
     return EXIT_SUCCESS;
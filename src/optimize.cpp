@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+
+#include "fold.hpp"
+#include "optimize.hpp"
+
+
+// Rewrites every operand through `replacement`, in which no_value means the value
+// stays. Chains of replacements are followed to the end.
+static void replace_uses(SsaFunction& fn, std::vector<ValueId>& replacement) {
+    auto resolve = [&](ValueId value) {
+        ValueId last = value;
+        while (replacement[last] != no_value) {
+            last = replacement[last];
+        }
+        if (last != value) {
+            replacement[value] = last;
+        }
+        return last;
+    };
+    for (const SsaBlock& block : fn.blocks) {
+        for (ValueId value : block.insts) {
+            SsaInst& inst = fn.insts[value];
+            switch (inst.op) {
+                case SsaOp::add:
+                case SsaOp::sub:
+                case SsaOp::mul:
+                case SsaOp::div:
+                    inst.a = resolve(inst.a);
+                    inst.b = resolve(inst.b);
+                    break;
+                case SsaOp::phi:
+                    for (uint32_t i = inst.a; i < inst.a + inst.b; i++) {
+                        fn.phi_args[i] = resolve(fn.phi_args[i]);
+                    }
+                    break;
+                case SsaOp::br:
+                case SsaOp::ret:
+                case SsaOp::exit:
+                    inst.a = resolve(inst.a);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+// Drops the blocks `keep` leaves out, along with the edges and phi inputs that came
+// from them, and renumbers the rest in their old order.
+static size_t drop_blocks(SsaFunction& fn, const std::vector<bool>& keep) {
+    std::vector<BlockId> renumbered(fn.blocks.size(), no_block);
+    BlockId next = 0;
+    for (BlockId block = 0; block < fn.blocks.size(); block++) {
+        if (keep[block]) {
+            renumbered[block] = next++;
+        }
+    }
+    const size_t removed = fn.blocks.size() - next;
+    if (removed == 0) {
+        return 0;
+    }
+
+    for (BlockId block = 0; block < fn.blocks.size(); block++) {
+        if (!keep[block]) {
+            continue;
+        }
+        SsaBlock& bb = fn.blocks[block];
+        // Phi inputs are kept in predecessor order, so both shrink in step, in place.
+        std::vector<bool> kept_preds(bb.preds.size());
+        for (size_t p = 0; p < bb.preds.size(); p++) {
+            kept_preds[p] = keep[bb.preds[p]];
+        }
+        for (ValueId value : bb.insts) {
+            SsaInst& inst = fn.insts[value];
+            inst.block = renumbered[block];
+            if (inst.op == SsaOp::phi) {
+                uint32_t kept = 0;
+                for (uint32_t p = 0; p < inst.b; p++) {
+                    if (kept_preds[p]) {
+                        fn.phi_args[inst.a + kept++] = fn.phi_args[inst.a + p];
+                    }
+                }
+                inst.b = kept;
+            }
+            else if (inst.op == SsaOp::br) {
+                inst.b = renumbered[inst.b];
+                inst.c = renumbered[inst.c];
+            }
+            else if (inst.op == SsaOp::jmp) {
+                inst.a = renumbered[inst.a];
+            }
+        }
+        size_t kept = 0;
+        for (size_t p = 0; p < bb.preds.size(); p++) {
+            if (kept_preds[p]) {
+                bb.preds[kept++] = renumbered[bb.preds[p]];
+            }
+        }
+        bb.preds.resize(kept);
+        if (renumbered[block] != block) {
+            fn.blocks[renumbered[block]] = std::move(bb);
+        }
+    }
+    fn.blocks.resize(next);
+    return removed;
+}
+
+// Removes the edge from bb.preds[index], and the phi inputs for it.
+static void remove_edge(SsaFunction& fn, BlockId block, size_t index) {
+    SsaBlock& bb = fn.blocks[block];
+    bb.preds.erase(bb.preds.begin() + static_cast<std::ptrdiff_t>(index));
+    for (ValueId value : bb.insts) {
+        SsaInst& inst = fn.insts[value];
+        if (inst.op != SsaOp::phi) {
+            break;
+        }
+        std::copy(fn.phi_args.begin() + inst.a + index + 1, fn.phi_args.begin() + inst.a + inst.b, fn.phi_args.begin() + inst.a + index);
+        inst.b--;
+    }
+}
+
+size_t remove_unreachable_blocks(SsaFunction& fn) {
+    // Predecessors come first, so one forward pass finds every reachable block.
+    std::vector<bool> reachable(fn.blocks.size(), false);
+    reachable[0] = true;
+    for (BlockId block = 1; block < fn.blocks.size(); block++) {
+        for (BlockId pred : fn.blocks[block].preds) {
+            reachable[block] = reachable[block] || reachable[pred];
+        }
+    }
+    return drop_blocks(fn, reachable);
+}
+
+size_t merge_blocks(SsaFunction& fn) {
+    std::vector<bool> keep(fn.blocks.size(), true);
+    std::vector<ValueId> replacement(fn.insts.size(), no_value);
+    size_t merged = 0;
+    for (BlockId block = 0; block < fn.blocks.size(); block++) {
+        if (!keep[block]) {
+            continue;
+        }
+        SsaBlock& bb = fn.blocks[block];
+        while (fn.insts[bb.insts.back()].op == SsaOp::jmp) {
+            const BlockId succ = fn.insts[bb.insts.back()].a;
+            SsaBlock& next = fn.blocks[succ];
+            if (next.preds.size() != 1) {
+                break;
+            }
+            bb.insts.pop_back();
+            for (ValueId value : next.insts) {
+                SsaInst& inst = fn.insts[value];
+                // With one predecessor, a phi is just its input.
+                if (inst.op == SsaOp::phi) {
+                    replacement[value] = fn.phi_args[inst.a];
+                    continue;
+                }
+                inst.block = block;
+                bb.insts.push_back(value);
+            }
+            next.insts.clear();
+            for (BlockId after : fn.successors(block)) {
+                std::replace(fn.blocks[after].preds.begin(), fn.blocks[after].preds.end(), succ, block);
+            }
+            keep[succ] = false;
+            merged++;
+        }
+    }
+    drop_blocks(fn, keep);
+    replace_uses(fn, replacement);
+    return merged;
+}
+
+// The acyclic graph makes a single pass in block order enough: every predecessor is
+// settled before its successors, and every operand before its users. A value starts
+// out unknown, which only stays so in blocks that never run; becomes constant; or
+// varies when no single value fits. A branch on a constant only makes one of its
+// edges live.
+size_t propagate_constants(SsaFunction& fn) {
+    enum class Lattice : uint8_t {
+        unknown,
+        constant,
+        varying,
+    };
+    std::vector<Lattice> state(fn.insts.size(), Lattice::unknown);
+    std::vector<int64_t> values(fn.insts.size(), 0);
+    std::vector<bool> executable(fn.blocks.size(), false);
+    auto edge_live = [&](BlockId pred, BlockId block) {
+        if (!executable[pred]) {
+            return false;
+        }
+        const SsaInst& term = fn.insts[fn.terminator(pred)];
+        if (term.op != SsaOp::br || state[term.a] != Lattice::constant) {
+            return true;
+        }
+        return (values[term.a] != 0 ? term.b : term.c) == block;
+    };
+
+    executable[0] = true;
+    for (BlockId block = 0; block < fn.blocks.size(); block++) {
+        const SsaBlock& bb = fn.blocks[block];
+        for (BlockId pred : bb.preds) {
+            executable[block] = executable[block] || edge_live(pred, block);
+        }
+        if (!executable[block]) {
+            continue;
+        }
+        for (ValueId value : bb.insts) {
+            const SsaInst& inst = fn.insts[value];
+            switch (inst.op) {
+                case SsaOp::constant:
+                    state[value] = Lattice::constant;
+                    values[value] = fn.constant_value(value);
+                    break;
+                case SsaOp::phi: {
+                    std::span<const ValueId> incoming = fn.phi_incoming(value);
+                    for (size_t p = 0; p < incoming.size() && state[value] != Lattice::varying; p++) {
+                        const ValueId arg = incoming[p];
+                        if (!edge_live(bb.preds[p], block) || state[arg] == Lattice::unknown) {
+                            continue;
+                        }
+                        if (state[arg] == Lattice::varying || (state[value] == Lattice::constant && values[value] != values[arg])) {
+                            state[value] = Lattice::varying;
+                        }
+                        else {
+                            state[value] = Lattice::constant;
+                            values[value] = values[arg];
+                        }
+                    }
+                    break;
+                }
+                case SsaOp::add:
+                case SsaOp::sub:
+                case SsaOp::mul:
+                case SsaOp::div: {
+                    const bool lhs_zero = state[inst.a] == Lattice::constant && values[inst.a] == 0;
+                    const bool rhs_zero = state[inst.b] == Lattice::constant && values[inst.b] == 0;
+                    if (state[inst.a] == Lattice::constant && state[inst.b] == Lattice::constant) {
+                        state[value] = Lattice::constant;
+                        values[value] = inst.op == SsaOp::add ? fold_add(values[inst.a], values[inst.b])
+                                      : inst.op == SsaOp::sub ? fold_sub(values[inst.a], values[inst.b])
+                                      : inst.op == SsaOp::mul ? fold_mul(values[inst.a], values[inst.b])
+                                      : fold_div(values[inst.a], values[inst.b]);
+                    }
+                    // Zero times anything, and anything divided by zero, is zero.
+                    else if ((inst.op == SsaOp::mul && (lhs_zero || rhs_zero)) || (inst.op == SsaOp::div && rhs_zero)) {
+                        state[value] = Lattice::constant;
+                        values[value] = 0;
+                    }
+                    else {
+                        state[value] = Lattice::varying;
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    // Constant results become constant instructions where they stand, phis moving
+    // behind the block's remaining phis, and branches on constants become jumps.
+    size_t changed = 0;
+    for (BlockId block = 0; block < fn.blocks.size(); block++) {
+        if (!executable[block]) {
+            continue;
+        }
+        std::vector<ValueId>& insts = fn.blocks[block].insts;
+        for (ValueId value : insts) {
+            SsaInst& inst = fn.insts[value];
+            if (inst.op == SsaOp::constant || state[value] != Lattice::constant) {
+                continue;
+            }
+            auto bits = static_cast<uint64_t>(values[value]);
+            inst.op = SsaOp::constant;
+            inst.a = static_cast<uint32_t>(bits);
+            inst.b = static_cast<uint32_t>(bits >> 32);
+            changed++;
+        }
+        std::stable_partition(insts.begin(), insts.end(), [&](ValueId value) {
+            return fn.insts[value].op == SsaOp::phi;
+        });
+        SsaInst& term = fn.insts[insts.back()];
+        if (term.op == SsaOp::br && state[term.a] == Lattice::constant) {
+            const BlockId taken = values[term.a] != 0 ? term.b : term.c;
+            const BlockId dead = values[term.a] != 0 ? term.c : term.b;
+            const std::vector<BlockId>& preds = fn.blocks[dead].preds;
+            remove_edge(fn, dead, static_cast<size_t>(std::find(preds.begin(), preds.end(), block) - preds.begin()));
+            term = SsaInst{.op = SsaOp::jmp, .type = ValueType::none, .block = block, .a = taken};
+            changed++;
+        }
+    }
+    remove_unreachable_blocks(fn);
+    return changed;
+}
+
+namespace {
+
+struct ValueKey {
+    SsaOp op;
+    uint32_t a;
+    uint32_t b;
+
+    bool operator==(const ValueKey&) const = default;
+};
+
+struct ValueKeyHash {
+    size_t operator()(const ValueKey& key) const {
+        uint64_t hash = static_cast<uint64_t>(key.a) << 32 | key.b;
+        hash ^= static_cast<uint64_t>(key.op) * 0x9e3779b97f4a7c15ull;
+        hash *= 0xff51afd7ed558ccdull;
+        return static_cast<size_t>(hash ^ (hash >> 33));
+    }
+};
+
+} // namespace
+
+// Walks the dominator tree depth first with a scoped table of available values: a
+// block sees exactly the values of the blocks that dominate it, and the table is
+// rolled back on the way out. Operands always dominate their users, so they are
+// numbered before the key that mentions them is built.
+size_t number_values(SsaFunction& fn) {
+    std::vector<BlockId> idom = immediate_dominators(fn);
+    std::vector<std::vector<BlockId>> children(fn.blocks.size());
+    for (BlockId block = 1; block < fn.blocks.size(); block++) {
+        if (idom[block] != no_block) {
+            children[idom[block]].push_back(block);
+        }
+    }
+
+    std::vector<ValueId> replacement(fn.insts.size(), no_value);
+    auto number = [&](ValueId value) {
+        return replacement[value] == no_value ? value : replacement[value];
+    };
+    std::unordered_map<ValueKey, ValueId, ValueKeyHash> available;
+    std::vector<std::pair<ValueKey, ValueId>> undo;
+    // A block is entered when pushed with its undo mark, and left when popped again.
+    std::vector<std::pair<BlockId, size_t>> work = {{0, SIZE_MAX}};
+    size_t removed = 0;
+    while (!work.empty()) {
+        auto [block, mark] = work.back();
+        work.pop_back();
+        if (mark != SIZE_MAX) {
+            while (undo.size() > mark) {
+                auto [key, previous] = undo.back();
+                undo.pop_back();
+                if (previous == no_value) {
+                    available.erase(key);
+                }
+                else {
+                    available[key] = previous;
+                }
+            }
+            continue;
+        }
+        work.emplace_back(block, undo.size());
+        for (auto it = children[block].rbegin(); it != children[block].rend(); ++it) {
+            work.emplace_back(*it, SIZE_MAX);
+        }
+
+        std::vector<ValueId>& insts = fn.blocks[block].insts;
+        size_t kept = 0;
+        for (ValueId value : insts) {
+            const SsaInst& inst = fn.insts[value];
+            ValueKey key{.op = inst.op, .a = inst.a, .b = inst.b};
+            switch (inst.op) {
+                case SsaOp::constant:
+                    break;
+                case SsaOp::add:
+                case SsaOp::mul:
+                    key.a = number(inst.a);
+                    key.b = number(inst.b);
+                    if (key.a > key.b) {
+                        std::swap(key.a, key.b);
+                    }
+                    break;
+                case SsaOp::sub:
+                case SsaOp::div:
+                    key.a = number(inst.a);
+                    key.b = number(inst.b);
+                    break;
+                default:
+                    insts[kept++] = value;
+                    continue;
+            }
+            auto [it, inserted] = available.try_emplace(key, value);
+            if (inserted) {
+                undo.emplace_back(key, no_value);
+                insts[kept++] = value;
+            }
+            else {
+                replacement[value] = it->second;
+                removed++;
+            }
+        }
+        insts.resize(kept);
+    }
+    replace_uses(fn, replacement);
+    return removed;
+}
+
+// Predecessors come first, so a phi whose inputs are trivial phis themselves has
+// had them replaced by the time it is looked at.
+size_t propagate_copies(SsaFunction& fn) {
+    std::vector<ValueId> replacement(fn.insts.size(), no_value);
+    auto resolve = [&](ValueId value) {
+        return replacement[value] == no_value ? value : replacement[value];
+    };
+    size_t removed = 0;
+    for (SsaBlock& block : fn.blocks) {
+        size_t kept = 0;
+        for (ValueId value : block.insts) {
+            const SsaInst& inst = fn.insts[value];
+            if (inst.op == SsaOp::phi && inst.b > 0) {
+                ValueId first = resolve(fn.phi_args[inst.a]);
+                bool trivial = true;
+                for (uint32_t i = inst.a + 1; i < inst.a + inst.b; i++) {
+                    trivial = trivial && resolve(fn.phi_args[i]) == first;
+                }
+                if (trivial) {
+                    replacement[value] = first;
+                    removed++;
+                    continue;
+                }
+            }
+            block.insts[kept++] = value;
+        }
+        block.insts.resize(kept);
+    }
+    replace_uses(fn, replacement);
+    return removed;
+}
+
+// Terminators are the only roots: everything else exists to feed one of them.
+size_t eliminate_dead_values(SsaFunction& fn) {
+    std::vector<bool> live(fn.insts.size(), false);
+    std::vector<ValueId> work;
+    auto mark = [&](ValueId value) {
+        if (!live[value]) {
+            live[value] = true;
+            work.push_back(value);
+        }
+    };
+    for (const SsaBlock& block : fn.blocks) {
+        mark(block.insts.back());
+    }
+    while (!work.empty()) {
+        const SsaInst& inst = fn.insts[work.back()];
+        work.pop_back();
+        switch (inst.op) {
+            case SsaOp::add:
+            case SsaOp::sub:
+            case SsaOp::mul:
+            case SsaOp::div:
+                mark(inst.a);
+                mark(inst.b);
+                break;
+            case SsaOp::phi:
+                for (uint32_t i = inst.a; i < inst.a + inst.b; i++) {
+                    mark(fn.phi_args[i]);
+                }
+                break;
+            case SsaOp::br:
+            case SsaOp::ret:
+            case SsaOp::exit:
+                mark(inst.a);
+                break;
+            default:
+                break;
+        }
+    }
+
+    size_t removed = 0;
+    for (SsaBlock& block : fn.blocks) {
+        size_t kept = 0;
+        for (ValueId value : block.insts) {
+            if (live[value]) {
+                block.insts[kept++] = value;
+            }
+        }
+        removed += block.insts.size() - kept;
+        block.insts.resize(kept);
+    }
+    return removed;
+}
+
+// Constants go first since they prune the most, and blocks are merged once the
+// branches are gone. Numbering values can leave the inputs of a phi all the same, so
+// copies are propagated after it, and dead values go last to pick up whatever the
+// others freed.
+void optimize_ssa(SsaFunction& fn, const SsaPasses& passes) {
+    if (passes.constant_propagation) {
+        propagate_constants(fn);
+    }
+    if (passes.unreachable_blocks) {
+        remove_unreachable_blocks(fn);
+    }
+    if (passes.block_merging) {
+        merge_blocks(fn);
+    }
+    if (passes.value_numbering) {
+        number_values(fn);
+    }
+    if (passes.copy_propagation) {
+        propagate_copies(fn);
+    }
+    if (passes.dead_values) {
+        eliminate_dead_values(fn);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+
+#include "ssa.hpp"
+
+
+// Each pass keeps `fn` valid for verify_ssa and returns how many instructions or
+// blocks it removed. Removed instructions stay in `fn.insts` but leave their block.
+
+// Drops blocks no path from the entry reaches, such as code after an exit or return,
+// along with the phi inputs that came from them.
+size_t remove_unreachable_blocks(SsaFunction& fn);
+
+// Sparse conditional constant propagation: values are followed through phis, over
+// only the edges that can run, and a branch on a constant becomes a jump that leaves
+// the other side to be removed along with everything only it reached.
+size_t propagate_constants(SsaFunction& fn);
+
+// Joins a block to the one it jumps to when it is that block's only predecessor, so
+// that code without branches ends up in one block.
+size_t merge_blocks(SsaFunction& fn);
+
+// Global value numbering: a constant or operator computed by an instruction that
+// dominates it is reused instead of computed again. Addition and multiplication
+// match either operand order.
+size_t number_values(SsaFunction& fn);
+
+// Building the SSA form already turns `let b = a` into a second name for a's value,
+// so the copies left are phis whose incoming values are all the same. Those are
+// replaced by that value.
+size_t propagate_copies(SsaFunction& fn);
+
+// Removes instructions whose value nothing uses. In SSA form this covers both a
+// variable that is never read and a store that is overwritten before it is read.
+size_t eliminate_dead_values(SsaFunction& fn);
+
+struct SsaPasses {
+    bool constant_propagation = true;
+    bool unreachable_blocks = true;
+    bool block_merging = true;
+    bool value_numbering = true;
+    bool copy_propagation = true;
+    bool dead_values = true;
+};
+
+void optimize_ssa(SsaFunction& fn, const SsaPasses& passes = {});
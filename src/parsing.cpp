@@ -1,57 +1,122 @@
+#include <algorithm>
 #include <iostream>
+#include <utility>
 
 #include "parsing.hpp"
 
 
-Parser::Parser(const std::vector<Token> tokens)
-    : m_tokens(tokens)
-    , m_arena(1024 * 1024 * 4)
+Parser::Parser(Tokenizer& tokenizer, ArenaAllocator* arena)
+    : m_tokenizer(tokenizer)
+    , m_tokens(tokenizer)
+    , m_owned_arena(arena == nullptr ? std::make_unique<ArenaAllocator>() : nullptr)
+    , m_arena(arena == nullptr ? *m_owned_arena : *arena)
 {
 }
 
-std::optional<NodeTerm*> Parser::parse_term() {
-    if (auto int_lit = try_consume(TokenType::int_lit)) {
-        NodeTermIntLit* term_int_lit = m_arena.alloc<NodeTermIntLit>();
-        term_int_lit->int_lit = int_lit.value();
-        NodeTerm* term = m_arena.alloc<NodeTerm>();
-        term->variant = term_int_lit;
-        return term;
-    }
-    if (auto ident = try_consume(TokenType::ident)) {
-        NodeTermIdent* term_ident = m_arena.alloc<NodeTermIdent>();
-        term_ident->ident = ident.value();
-        NodeTerm* term = m_arena.alloc<NodeTerm>();
-        term->variant = term_ident;
-        return term;
-    }
-    if (try_consume(TokenType::left_paren)) {
-        std::optional<NodeExpr*> expr = parse_expr();
-        NodeTermParen* term_paren = m_arena.alloc<NodeTermParen>();
-        term_paren->expr = expr.value();
-        NodeTerm* term = m_arena.alloc<NodeTerm>();
-        term->variant = term_paren;
-        try_consume(TokenType::right_paren, "Expected )");
-        return term;
-    }
-    return {};
+Parser::Parser(Tokenizer& tokenizer, std::vector<Token> tokens, ArenaAllocator* arena)
+    : m_tokenizer(tokenizer)
+    , m_tokens(std::move(tokens))
+    , m_owned_arena(arena == nullptr ? std::make_unique<ArenaAllocator>() : nullptr)
+    , m_arena(arena == nullptr ? *m_owned_arena : *arena)
+{
 }
 
-std::optional<NodeScope*> Parser::parse_scope() {
-    try_consume(TokenType::open_curly, "Expected {");
-    auto scope = m_arena.alloc<NodeScope>();
-    while (inspect().has_value() && inspect().value().type != TokenType::close_curly) {
-        if (auto stmt = parse_stmt()) {
-            scope->stmts.push_back(stmt.value());
+Parser::Parser(Tokenizer& tokenizer, std::span<const Token> tokens, ArenaAllocator* arena)
+    : m_tokenizer(tokenizer)
+    , m_tokens(tokens)
+    , m_owned_arena(arena == nullptr ? std::make_unique<ArenaAllocator>() : nullptr)
+    , m_arena(arena == nullptr ? *m_owned_arena : *arena)
+{
+}
+
+void Parser::record_scopes(std::vector<ScopeSpan>* log) {
+    m_scope_log = log;
+}
+
+NodeExpr* Parser::term_expr(NodeTerm* term) {
+    NodeExpr* expr = m_arena.alloc<NodeExpr>();
+    expr->variant = term;
+    return expr;
+}
+
+void Parser::reduce_op() {
+    NodeBinExpr* bin_expr = m_arena.alloc<NodeBinExpr>();
+    bin_expr->op = m_ops.back().op;
+    bin_expr->rhs = m_operands.back();
+    m_operands.pop_back();
+    bin_expr->lhs = m_operands.back();
+    NodeExpr* expr = m_arena.alloc<NodeExpr>();
+    expr->variant = bin_expr;
+    m_operands.back() = expr;
+    m_ops.pop_back();
+}
+
+// Shunting-yard: operators wait on m_ops until one of lower or equal precedence
+// arrives, which keeps binary operators left-associative, and parentheses wait there
+// as markers until they are closed.
+std::optional<NodeExpr*> Parser::parse_expr() {
+    const size_t op_base = m_ops.size();
+    size_t open_parens = 0;
+    while (true) {
+        if (auto left_paren = try_consume(TokenType::left_paren)) {
+            m_ops.push_back(PendingOp{.op = left_paren.value(), .paren = true});
+            open_parens++;
+            continue;
+        }
+        NodeTerm* term = m_arena.alloc<NodeTerm>();
+        if (auto int_lit = try_consume(TokenType::int_lit)) {
+            NodeTermIntLit* term_int_lit = m_arena.alloc<NodeTermIntLit>();
+            term_int_lit->int_lit = m_tokenizer.int_value(int_lit.value());
+            term->variant = term_int_lit;
+        }
+        else if (auto ident = try_consume(TokenType::ident)) {
+            NodeTermIdent* term_ident = m_arena.alloc<NodeTermIdent>();
+            term_ident->ident = ident->symbol();
+            term->variant = term_ident;
+        }
+        else if (m_ops.size() == op_base) {
+            return {};
         }
         else {
-            error_parse("Invalid statment");
+            error_parse("Expected expression");
+        }
+        m_operands.push_back(term_expr(term));
+
+        while (open_parens > 0 && try_consume(TokenType::right_paren)) {
+            while (!m_ops.back().paren) {
+                reduce_op();
+            }
+            m_ops.pop_back();
+            open_parens--;
+            NodeTermParen* term_paren = m_arena.alloc<NodeTermParen>();
+            term_paren->expr = m_operands.back();
+            NodeTerm* paren = m_arena.alloc<NodeTerm>();
+            paren->variant = term_paren;
+            m_operands.back() = term_expr(paren);
         }
+
+        const Token* current_token = inspect();
+        std::optional<int> prec = current_token != nullptr ? bin_prec(current_token->type) : std::nullopt;
+        if (!prec.has_value()) {
+            break;
+        }
+        while (m_ops.size() > op_base && !m_ops.back().paren && bin_prec(m_ops.back().op.type) >= prec) {
+            reduce_op();
+        }
+        m_ops.push_back(PendingOp{.op = consume(), .paren = false});
     }
-    try_consume(TokenType::close_curly, "Expected }");
-    return scope;
+    if (open_parens > 0) {
+        error_parse("Expected )");
+    }
+    while (m_ops.size() > op_base) {
+        reduce_op();
+    }
+    NodeExpr* expr = m_operands.back();
+    m_operands.pop_back();
+    return expr;
 }
 
-std::optional<NodeStmtIf*> Parser::parse_if_stmt() {
+NodeStmtIf* Parser::parse_if_head() {
     try_consume(TokenType::left_paren, "Expected (");
     NodeStmtIf* stmt_if = m_arena.alloc<NodeStmtIf>();
     if (auto expr = parse_expr()) {
@@ -61,75 +126,47 @@ std::optional<NodeStmtIf*> Parser::parse_if_stmt() {
         error_parse("Expected expression");
     }
     try_consume(TokenType::right_paren, "Expected )");
-    if (auto scope = parse_scope()) {
-        stmt_if->scope = scope.value();
-    }
-    else {
-        error_parse("Invalid scope");
-    }
-    stmt_if->pred = parse_if_predicate();
+    stmt_if->scope = open_scope(stmt_if);
     return stmt_if;
 }
 
-std::optional<NodeExpr*> Parser::parse_expr(int min_prec) {
-    auto term = parse_term();
-    if (!term.has_value()) {
-        return {};
-    }
-    auto term_expr = m_arena.alloc<NodeExpr>();
-    term_expr->variant = term.value();
-
-    while (true) {
-        std::optional<Token> current_token = inspect();
-        if (!current_token.has_value()) {
-            break;
-        }
-        auto prec = bin_prec(current_token->type);
-        if (!prec.has_value() || prec < min_prec) {
-            break;
-        }
-
-        consume();
-        int next_min_prec = prec.value() + 1;
-        auto rhs_expr = parse_expr(next_min_prec);
-        if (!rhs_expr.has_value()) {
-            error_parse("Expected expression");
-        }
-
-        auto bin_expr = m_arena.alloc<NodeBinExpr>();
-        auto lhs_expr = m_arena.alloc<NodeExpr>();
-        lhs_expr->variant = term_expr->variant;
-        bin_expr->lhs = lhs_expr;
-        bin_expr->rhs = rhs_expr.value();
-        bin_expr->op = current_token.value();
-        term_expr->variant = bin_expr;
-    }
-    return term_expr;
+NodeScope* Parser::open_scope(NodeStmtIf* stmt_if) {
+    auto open = static_cast<uint32_t>(m_tokens.position());
+    try_consume(TokenType::open_curly, "Expected {");
+    NodeScope* scope = m_arena.alloc<NodeScope>();
+    m_scopes.push_back(ScopeFrame{.scope = scope, .first_stmt = m_pending_stmts.size(), .open = open, .stmt_if = stmt_if});
+    return scope;
 }
 
-std::optional<NodeIfPred*> Parser::parse_if_predicate() {
+void Parser::close_scope() {
+    ScopeFrame frame = m_scopes.back();
+    m_scopes.pop_back();
+    auto close = static_cast<uint32_t>(m_tokens.position());
+    try_consume(TokenType::close_curly, "Expected }");
+    frame.scope->stmts = finish_stmts(frame.first_stmt);
+    if (m_scope_log != nullptr) {
+        m_scope_log->push_back(ScopeSpan{.scope = frame.scope, .open = frame.open, .close = close});
+    }
+    if (frame.stmt_if == nullptr) {
+        return;
+    }
+    // An elif replaces the closed block at the same depth, so a chain of any length
+    // holds at most one frame.
     if (try_consume(TokenType::_elif)) {
         NodeIfPred* ifpred = m_arena.alloc<NodeIfPred>();
-        auto stmt_if = parse_if_stmt();
-        ifpred->variant = stmt_if.value();
-        return ifpred;
+        frame.stmt_if->pred = ifpred;
+        ifpred->variant = parse_if_head();
     }
-    if (try_consume(TokenType::_else)) {
+    else if (try_consume(TokenType::_else)) {
         NodeIfPred* ifpred = m_arena.alloc<NodeIfPred>();
         NodeIfPredElse* ifpred_else = m_arena.alloc<NodeIfPredElse>();
-        if (auto scope = parse_scope()) {
-            ifpred_else->scope = scope.value();
-        }
-        else {
-            error_parse("Invalid scope");
-        }
+        ifpred_else->scope = open_scope();
         ifpred->variant = ifpred_else;
-        return ifpred;
+        frame.stmt_if->pred = ifpred;
     }
-    return {};
 }
 
-std::optional<NodeStmt*> Parser::parse_stmt() {
+bool Parser::begin_stmt() {
     if (try_consume(TokenType::_return)) {
         NodeStmt* stmt = m_arena.alloc<NodeStmt>();
         NodeStmtReturn* stmt_return = m_arena.alloc<NodeStmtReturn>();
@@ -141,7 +178,8 @@ std::optional<NodeStmt*> Parser::parse_stmt() {
         }
         try_consume(TokenType::semi, "Expected ;");
         stmt->variant = stmt_return;
-        return stmt;
+        m_pending_stmts.push_back(stmt);
+        return true;
     }
     if (try_consume(TokenType::_exit)) {
         NodeStmt* stmt = m_arena.alloc<NodeStmt>();
@@ -154,17 +192,18 @@ std::optional<NodeStmt*> Parser::parse_stmt() {
         }
         try_consume(TokenType::semi, "Expected ;");
         stmt->variant = stmt_exit;
-        return stmt;
+        m_pending_stmts.push_back(stmt);
+        return true;
     }
     if (
-        inspect().value().type == TokenType::let &&
-        inspect(1).value().type == TokenType::ident &&
-        inspect(2).value().type == TokenType::eq
+        inspect_is(TokenType::let) &&
+        inspect_is(TokenType::ident, 1) &&
+        inspect_is(TokenType::eq, 2)
     ) {
         NodeStmt* stmt = m_arena.alloc<NodeStmt>();
         NodeStmtLet* stmt_let = m_arena.alloc<NodeStmtLet>();
         consume();
-        stmt_let->ident = consume();
+        stmt_let->ident = consume().symbol();
         consume();
         if (auto node_expr = parse_expr()) {
             stmt_let->expr = node_expr.value();
@@ -174,15 +213,13 @@ std::optional<NodeStmt*> Parser::parse_stmt() {
         }
         try_consume(TokenType::semi, "Expected ;");
         stmt->variant = stmt_let;
-        return stmt;
+        m_pending_stmts.push_back(stmt);
+        return true;
     }
-    if (
-        inspect().has_value() && inspect().value().type == TokenType::ident &&
-        inspect().has_value() && inspect(1).value().type == TokenType::eq
-    ) {
+    if (inspect_is(TokenType::ident) && inspect_is(TokenType::eq, 1)) {
         NodeStmt* stmt = m_arena.alloc<NodeStmt>();
         NodeStmtAssign* stmt_assign = m_arena.alloc<NodeStmtAssign>();
-        stmt_assign->ident = consume();
+        stmt_assign->ident = consume().symbol();
         consume();
         if (auto node_expr = parse_expr()) {
             stmt_assign->expr = node_expr.value();
@@ -192,61 +229,106 @@ std::optional<NodeStmt*> Parser::parse_stmt() {
         }
         try_consume(TokenType::semi, "Expected ;");
         stmt->variant = stmt_assign;
-        return stmt;
+        m_pending_stmts.push_back(stmt);
+        return true;
     }
-    if (inspect().has_value() && inspect().value().type == TokenType::open_curly) {
-        auto scope = parse_scope();
-        auto stmt = m_arena.alloc<NodeStmt>();
-        stmt->variant = scope.value();
-        return stmt;
+    // Blocks and ifs take their place among the enclosing statements now and are
+    // filled in as parse_until_depth works through them.
+    if (inspect_is(TokenType::open_curly)) {
+        NodeStmt* stmt = m_arena.alloc<NodeStmt>();
+        m_pending_stmts.push_back(stmt);
+        stmt->variant = open_scope();
+        return true;
     }
     if (try_consume(TokenType::_if)) {
-        auto stmt_if = parse_if_stmt();
         NodeStmt* stmt = m_arena.alloc<NodeStmt>();
-        stmt->variant = stmt_if.value();
-        return stmt;
+        m_pending_stmts.push_back(stmt);
+        stmt->variant = parse_if_head();
+        return true;
     }
-    return {};
+    return false;
+}
+
+// Parses statements until every block opened above `depth` is closed.
+void Parser::parse_until_depth(size_t depth) {
+    while (m_scopes.size() > depth) {
+        if (inspect() == nullptr || inspect_is(TokenType::close_curly)) {
+            close_scope();
+        }
+        else if (!begin_stmt()) {
+            error_parse("Invalid statment");
+        }
+    }
+}
+
+std::optional<NodeScope*> Parser::parse_scope() {
+    size_t depth = m_scopes.size();
+    NodeScope* scope = open_scope();
+    parse_until_depth(depth);
+    return scope;
+}
+
+std::optional<NodeStmt*> Parser::parse_stmt() {
+    size_t first = m_pending_stmts.size();
+    size_t depth = m_scopes.size();
+    if (!begin_stmt()) {
+        return {};
+    }
+    parse_until_depth(depth);
+    NodeStmt* stmt = m_pending_stmts[first];
+    m_pending_stmts.resize(first);
+    return stmt;
 }
 
 std::optional<NodeProgram> Parser::parse_program() {
     NodeProgram prog;
-    while (inspect().has_value()) {
-        if (auto stmt = parse_stmt()) {
-            prog.stmts.push_back(stmt.value());
-        }
-        else {
+    size_t first = m_pending_stmts.size();
+    size_t depth = m_scopes.size();
+    while (inspect() != nullptr) {
+        if (!begin_stmt()) {
             error_parse("Invalid statement");
         }
+        parse_until_depth(depth);
     }
+    prog.stmts = finish_stmts(first);
     return prog;
 }
 
-std::optional<Token> Parser::inspect(int offset) const {
-    if (m_index + offset >= m_tokens.size()) return {};
-    return m_tokens.at(m_index + offset);
+std::span<NodeStmt*> Parser::finish_stmts(size_t first) {
+    size_t count = m_pending_stmts.size() - first;
+    std::span<NodeStmt*> stmts = m_arena.alloc_array<NodeStmt*>(count);
+    std::copy(m_pending_stmts.begin() + static_cast<std::ptrdiff_t>(first), m_pending_stmts.end(), stmts.begin());
+    m_pending_stmts.resize(first);
+    return stmts;
+}
+
+const Token* Parser::inspect(size_t offset) {
+    return m_tokens.peek(offset);
+}
+
+bool Parser::inspect_is(TokenType type, size_t offset) {
+    const Token* token = inspect(offset);
+    return token != nullptr && token->type == type;
 }
 
 Token Parser::consume() {
-    Token value = m_tokens.at(m_index);
-    m_index++;
-    return value;
+    return m_tokens.consume();
 }
 
 void Parser::error_parse(const std::string& error_msg) {
     std::string location = "end of file";
-    if (auto current = inspect()) {
-        location = "line " + std::to_string(current->line_no);
+    if (const Token* current = inspect()) {
+        location = "line " + std::to_string(m_tokenizer.line_of(*current));
     }
-    else if (m_index > 0 && m_index - 1 < m_tokens.size()) {
-        location = "line " + std::to_string(m_tokens.at(m_index - 1).line_no);
+    else if (const auto& last = m_tokens.last_consumed()) {
+        location = "line " + std::to_string(m_tokenizer.line_of(last.value()));
     }
     std::cerr << "[Parse Error] " << error_msg << " at " << location << std::endl;
     exit(EXIT_FAILURE);
 }
 
 Token Parser::try_consume(TokenType type, const std::string& error_msg) {
-    if (inspect().has_value() && inspect().value().type == type) {
+    if (inspect_is(type)) {
         return consume();
     }
     error_parse(error_msg);
@@ -254,7 +336,7 @@ Token Parser::try_consume(TokenType type, const std::string& error_msg) {
 }
 
 std::optional<Token> Parser::try_consume(TokenType type) {
-    if (inspect().has_value() && inspect().value().type == type) {
+    if (inspect_is(type)) {
         return consume();
     }
     return {};
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -9,27 +12,76 @@
 #include "grammar.hpp"
 
 
+// Where a scope's braces sit, as indices into the token sequence the parser read.
+struct ScopeSpan {
+    NodeScope* scope;
+    uint32_t open;
+    uint32_t close;
+};
+
 class Parser {
 public:
-    explicit Parser(const std::vector<Token> tokens);
+    // AST nodes are allocated in `arena` when one is given, so a caller can reset and
+    // reuse it across compilations; otherwise the parser owns an arena of its own.
+    explicit Parser(Tokenizer& tokenizer, ArenaAllocator* arena = nullptr);
+    // Parses tokens that were already lexed by `tokenizer`.
+    Parser(Tokenizer& tokenizer, std::vector<Token> tokens, ArenaAllocator* arena = nullptr);
+    // Parses tokens the caller keeps alive for as long as the parser is used.
+    Parser(Tokenizer& tokenizer, std::span<const Token> tokens, ArenaAllocator* arena = nullptr);
+
+    // Appends the token range of every scope parsed from now on to `log`, in the order
+    // the scopes are closed.
+    void record_scopes(std::vector<ScopeSpan>* log);
 
-    std::optional<NodeTerm*> parse_term();
+    // Nesting is tracked on heap-allocated stacks rather than the call stack, so
+    // arbitrarily deep parentheses, blocks and elif chains cannot overflow it.
+    std::optional<NodeExpr*> parse_expr();
     std::optional<NodeScope*> parse_scope();
-    std::optional<NodeStmtIf*> parse_if_stmt();
-    std::optional<NodeExpr*> parse_expr(int min_prec = 0);
-    std::optional<NodeIfPred*> parse_if_predicate();
     std::optional<NodeStmt*> parse_stmt();
     std::optional<NodeProgram> parse_program();
 
 private:
-    std::optional<Token> inspect(int offset = 0) const;
+    // A block whose statements are still being parsed.
+    struct ScopeFrame {
+        NodeScope* scope;
+        size_t first_stmt;
+        uint32_t open;
+        // The if statement the block belongs to, whose elif or else follows it.
+        NodeStmtIf* stmt_if;
+    };
+
+    // An entry of the expression operator stack: a binary operator or an open paren.
+    struct PendingOp {
+        Token op;
+        bool paren;
+    };
+
+    NodeExpr* term_expr(NodeTerm* term);
+    void reduce_op();
+    NodeStmtIf* parse_if_head();
+    NodeScope* open_scope(NodeStmtIf* stmt_if = nullptr);
+    void close_scope();
+    bool begin_stmt();
+    void parse_until_depth(size_t depth);
+
+    const Token* inspect(size_t offset = 0);
+    bool inspect_is(TokenType type, size_t offset = 0);
     Token consume();
 
     void error_parse(const std::string& msg);
     Token try_consume(TokenType type, const std::string& error_msg);
     std::optional<Token> try_consume(TokenType type);
+    std::span<NodeStmt*> finish_stmts(size_t first);
 
-    const std::vector<Token> m_tokens;
-    size_t m_index = 0;
-    ArenaAllocator m_arena;
+    Tokenizer& m_tokenizer;
+    TokenStream m_tokens;
+    std::unique_ptr<ArenaAllocator> m_owned_arena;
+    ArenaAllocator& m_arena;
+    // Statements of every scope still being parsed, innermost last. Each scope copies
+    // its own off the top into the arena once it is closed.
+    std::vector<NodeStmt*> m_pending_stmts;
+    std::vector<ScopeFrame> m_scopes;
+    std::vector<PendingOp> m_ops;
+    std::vector<NodeExpr*> m_operands;
+    std::vector<ScopeSpan>* m_scope_log = nullptr;
 };
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <iterator>
+
+#include "peephole.hpp"
+
+
+uint32_t PeepholeMatch::get(uint32_t index) const {
+    return m_values[index];
+}
+
+void PeepholeMatch::set(uint32_t index, uint32_t value) {
+    m_values[index] = value;
+    m_bound |= 1u << index;
+}
+
+// Instructions waiting to be looked at again come first, the most recently pushed
+// first.
+const MInst* PeepholeMatch::after(size_t n) const {
+    if (n < m_pending.size()) {
+        return &m_pending[m_pending.size() - 1 - n];
+    }
+    n -= m_pending.size();
+    return n < m_input.size() ? &m_input[n] : nullptr;
+}
+
+static bool is_one_of(MOp op, std::initializer_list<MOp> options) {
+    return std::find(options.begin(), options.end(), op) != options.end();
+}
+
+// The ops whose result goes to rd and depends on nothing else held in rd.
+static bool writes_rd(MOp op) {
+    return is_one_of(op, {MOp::movz, MOp::mov, MOp::add, MOp::sub, MOp::mul, MOp::sdiv, MOp::add_imm, MOp::sub_imm, MOp::ldr});
+}
+
+static bool reads(const MInst& inst, MReg reg) {
+    switch (inst.op) {
+        case MOp::movk:
+        case MOp::str:
+        case MOp::cbz:
+        case MOp::cbnz:
+            return inst.rd == reg;
+        case MOp::mov:
+        case MOp::add_imm:
+        case MOp::sub_imm:
+            return inst.rn == reg;
+        case MOp::add:
+        case MOp::sub:
+        case MOp::mul:
+        case MOp::sdiv:
+            return inst.rn == reg || inst.rm == reg;
+        default:
+            return false;
+    }
+}
+
+// Whether the value in `reg` is never read again on the way out of the match. A
+// branch could lead anywhere, so it counts as a read, and so does running past a
+// bounded look-ahead.
+static bool dead_after(const PeepholeMatch& match, MReg reg) {
+    for (size_t n = 0; n < 64; n++) {
+        const MInst* inst = match.after(n);
+        if (inst == nullptr || inst->op == MOp::ret || inst->op == MOp::bl_exit) {
+            return true;
+        }
+        if (inst->op == MOp::label) {
+            continue;
+        }
+        if (reads(*inst, reg) || is_one_of(inst->op, {MOp::b, MOp::cbz, MOp::cbnz})) {
+            return false;
+        }
+        if (writes_rd(inst->op) && inst->rd == reg) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Variables of the rules below.
+constexpr PatternField op = var(0);
+constexpr PatternField r = var(1);
+constexpr PatternField s = var(2);
+constexpr PatternField n = var(3);
+constexpr PatternField m = var(4);
+constexpr PatternField k = var(5);
+constexpr PatternField L = var(6);
+constexpr PatternField M = var(7);
+constexpr PatternField a = var(8);
+constexpr PatternField b = var(9);
+constexpr PatternField c = var(10);
+
+static MOp bound_op(const PeepholeMatch& match) {
+    return static_cast<MOp>(match.get(op.value));
+}
+
+static bool is_compare_branch(PeepholeMatch& match) {
+    return is_one_of(bound_op(match), {MOp::cbz, MOp::cbnz});
+}
+
+static bool computes_into_dead_reg(PeepholeMatch& match) {
+    const auto reg = static_cast<MReg>(match.get(r.value));
+    return writes_rd(bound_op(match)) && reg != 0 && reg != sp_reg && dead_after(match, reg);
+}
+
+// add and sub only take a 12-bit immediate.
+static bool merges_sp_adjustments(PeepholeMatch& match) {
+    const uint32_t sum = match.get(a.value) + match.get(b.value);
+    if (!is_one_of(bound_op(match), {MOp::add_imm, MOp::sub_imm}) || sum > 4080) {
+        return false;
+    }
+    match.set(c.value, sum);
+    return true;
+}
+
+constexpr PatternField sp = is(sp_reg);
+
+static const PeepholeRule rules[] = {
+    {"branch to the next line",
+        {{.op = is(MOp::b), .imm = L}, {.op = is(MOp::label), .imm = L}},
+        {{.op = is(MOp::label), .imm = L}}},
+    {"conditional branch to the next line",
+        {{.op = op, .rd = r, .imm = L}, {.op = is(MOp::label), .imm = L}},
+        {{.op = is(MOp::label), .imm = L}},
+        is_compare_branch},
+    {"cbz over a branch",
+        {{.op = is(MOp::cbz), .rd = r, .imm = L}, {.op = is(MOp::b), .imm = M}, {.op = is(MOp::label), .imm = L}},
+        {{.op = is(MOp::cbnz), .rd = r, .imm = M}, {.op = is(MOp::label), .imm = L}}},
+    {"cbnz over a branch",
+        {{.op = is(MOp::cbnz), .rd = r, .imm = L}, {.op = is(MOp::b), .imm = M}, {.op = is(MOp::label), .imm = L}},
+        {{.op = is(MOp::cbz), .rd = r, .imm = M}, {.op = is(MOp::label), .imm = L}}},
+    {"load of the slot just stored",
+        {{.op = is(MOp::str), .rd = r, .imm = m}, {.op = is(MOp::ldr), .rd = r, .imm = m}},
+        {{.op = is(MOp::str), .rd = r, .imm = m}}},
+    {"load of the slot just stored into another register",
+        {{.op = is(MOp::str), .rd = r, .imm = m}, {.op = is(MOp::ldr), .rd = s, .imm = m}},
+        {{.op = is(MOp::str), .rd = r, .imm = m}, {.op = is(MOp::mov), .rd = s, .rn = r}}},
+    {"store of the value just loaded",
+        {{.op = is(MOp::ldr), .rd = r, .imm = m}, {.op = is(MOp::str), .rd = r, .imm = m}},
+        {{.op = is(MOp::ldr), .rd = r, .imm = m}}},
+    {"repeated store",
+        {{.op = is(MOp::str), .rd = r, .imm = m}, {.op = is(MOp::str), .rd = r, .imm = m}},
+        {{.op = is(MOp::str), .rd = r, .imm = m}}},
+    {"move to itself",
+        {{.op = is(MOp::mov), .rd = r, .rn = r}},
+        {}},
+    {"result computed straight into x0",
+        {{.op = op, .rd = r, .rn = n, .rm = m, .imm = k}, {.op = is(MOp::mov), .rd = is(0), .rn = r}},
+        {{.op = op, .rd = is(0), .rn = n, .rm = m, .imm = k}},
+        computes_into_dead_reg},
+    {"sp adjustments that cancel",
+        {{.op = is(MOp::sub_imm), .rd = sp, .rn = sp, .imm = a}, {.op = is(MOp::add_imm), .rd = sp, .rn = sp, .imm = a}},
+        {}},
+    {"consecutive sp adjustments",
+        {{.op = op, .rd = sp, .rn = sp, .imm = a}, {.op = op, .rd = sp, .rn = sp, .imm = b}},
+        {{.op = op, .rd = sp, .rn = sp, .imm = c}},
+        merges_sp_adjustments},
+};
+
+std::span<const PeepholeRule> peephole_rules() {
+    return rules;
+}
+
+class PeepholeRunner {
+public:
+    explicit PeepholeRunner(PeepholeStats& stats)
+        : m_stats(stats)
+    {
+        m_stats.fired.assign(std::size(rules), 0);
+    }
+
+    // Instructions are pushed onto the output one at a time, and every rule is tried
+    // on the instructions that end at the one just pushed. A replacement goes back in
+    // front of the input to be pushed again, so whatever it makes possible is found
+    // too, and the pass stops at a fixpoint after a single walk.
+    void run(MachineCode& code) {
+        const std::vector<MInst> input = std::move(code.insts);
+        m_output.reserve(input.size());
+        size_t next = 0;
+        while (!m_pending.empty() || next < input.size()) {
+            if (!m_pending.empty()) {
+                m_output.push_back(m_pending.back());
+                m_pending.pop_back();
+            }
+            else {
+                m_output.push_back(input[next++]);
+            }
+            std::span<const MInst> rest = std::span<const MInst>(input).subspan(next);
+            for (size_t i = 0; i < std::size(rules); i++) {
+                if (try_rule(i, rest)) {
+                    m_stats.fired[i]++;
+                    break;
+                }
+            }
+        }
+        code.insts = std::move(m_output);
+    }
+
+private:
+    bool try_rule(size_t index, std::span<const MInst> rest) {
+        const PeepholeRule& rule = rules[index];
+        if (rule.match.size() > m_output.size()) {
+            return false;
+        }
+        // Most instructions are ruled out by the last one's op alone.
+        const PatternField& last_op = rule.match.back().op;
+        if (last_op.kind == PatternField::Kind::fixed && last_op.value != static_cast<uint32_t>(m_output.back().op)) {
+            return false;
+        }
+        const size_t first = m_output.size() - rule.match.size();
+        PeepholeMatch match;
+        for (size_t i = 0; i < rule.match.size(); i++) {
+            if (!match_inst(rule.match[i], m_output[first + i], match)) {
+                return false;
+            }
+        }
+        match.m_pending = m_pending;
+        match.m_input = rest;
+        if (rule.guard != nullptr && !rule.guard(match)) {
+            return false;
+        }
+        m_output.resize(first);
+        for (auto it = rule.replace.rbegin(); it != rule.replace.rend(); ++it) {
+            m_pending.push_back(MInst{
+                .op = static_cast<MOp>(substitute(it->op, match)),
+                .rd = static_cast<MReg>(substitute(it->rd, match)),
+                .rn = static_cast<MReg>(substitute(it->rn, match)),
+                .rm = static_cast<MReg>(substitute(it->rm, match)),
+                .imm = substitute(it->imm, match),
+            });
+        }
+        return true;
+    }
+
+    static bool match_inst(const PatternInst& pattern, const MInst& inst, PeepholeMatch& match) {
+        return match_field(pattern.op, static_cast<uint32_t>(inst.op), match) && match_field(pattern.rd, inst.rd, match) &&
+            match_field(pattern.rn, inst.rn, match) && match_field(pattern.rm, inst.rm, match) &&
+            match_field(pattern.imm, inst.imm, match);
+    }
+
+    static bool match_field(const PatternField& field, uint32_t value, PeepholeMatch& match) {
+        switch (field.kind) {
+            case PatternField::Kind::any:
+                return true;
+            case PatternField::Kind::fixed:
+                return field.value == value;
+            default:
+                if ((match.m_bound & 1u << field.value) != 0) {
+                    return match.get(field.value) == value;
+                }
+                match.set(field.value, value);
+                return true;
+        }
+    }
+
+    static uint32_t substitute(const PatternField& field, const PeepholeMatch& match) {
+        switch (field.kind) {
+            case PatternField::Kind::any:
+                return 0;
+            case PatternField::Kind::fixed:
+                return field.value;
+            default:
+                return match.get(field.value);
+        }
+    }
+
+    PeepholeStats& m_stats;
+    std::vector<MInst> m_output;
+    // Replacements to push again, the next one last.
+    std::vector<MInst> m_pending;
+};
+
+void peephole(MachineCode& code, PeepholeStats& stats) {
+    PeepholeRunner runner(stats);
+    runner.run(code);
+}
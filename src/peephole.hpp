@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "machine.hpp"
+
+
+// One field of a pattern instruction. `any` matches every value, `fixed` one value,
+// and `var` binds a variable where it first matches and must match the same value
+// wherever else it appears in the rule. In a replacement, `any` writes 0.
+struct PatternField {
+    enum class Kind : uint8_t {
+        any,
+        fixed,
+        var,
+    };
+    Kind kind = Kind::any;
+    uint32_t value = 0;
+};
+
+constexpr PatternField any_value {};
+
+constexpr PatternField is(uint32_t value) {
+    return PatternField{.kind = PatternField::Kind::fixed, .value = value};
+}
+
+constexpr PatternField is(MOp op) {
+    return is(static_cast<uint32_t>(op));
+}
+
+constexpr PatternField var(uint32_t index) {
+    return PatternField{.kind = PatternField::Kind::var, .value = index};
+}
+
+// An MInst with a pattern in place of each field.
+struct PatternInst {
+    PatternField op;
+    PatternField rd {};
+    PatternField rn {};
+    PatternField rm {};
+    PatternField imm {};
+};
+
+// The variables bound by a match, and the code that follows it for guards that need
+// to know what happens next.
+class PeepholeMatch {
+public:
+    static constexpr size_t max_vars = 16;
+
+    uint32_t get(uint32_t index) const;
+    void set(uint32_t index, uint32_t value);
+    // The nth instruction after the match, or nullptr past the end.
+    const MInst* after(size_t n) const;
+
+private:
+    friend class PeepholeRunner;
+    std::array<uint32_t, max_vars> m_values {};
+    uint32_t m_bound = 0;
+    std::span<const MInst> m_pending;
+    std::span<const MInst> m_input;
+};
+
+// A rewrite of adjacent instructions.
+struct PeepholeRule {
+    const char* name;
+    std::vector<PatternInst> match;
+    std::vector<PatternInst> replace;
+    // Checked once the instructions match, and may bind variables for the
+    // replacement. Without one, a match is enough.
+    bool (*guard)(PeepholeMatch& match) = nullptr;
+};
+
+std::span<const PeepholeRule> peephole_rules();
+
+// How often each rule of peephole_rules() fired, by index.
+struct PeepholeStats {
+    std::vector<size_t> fired;
+};
+
+// Rewrites `code` until no rule matches anywhere.
+void peephole(MachineCode& code, PeepholeStats& stats);
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <queue>
+
+#include "regalloc.hpp"
+
+
+RegAllocation linear_scan(std::span<const LiveInterval> intervals, std::span<const PhysReg> regs) {
+    RegAllocation allocation;
+    allocation.locations.resize(intervals.size());
+
+    // Registers are taken from the back, so reverse them to hand out the first one first.
+    std::vector<PhysReg> free_regs(regs.rbegin(), regs.rend());
+    // Slots whose last interval has ended, with that end point. Slots are freed in
+    // order of their end points, so the list stays sorted by them.
+    using FreeSlot = std::pair<uint32_t, uint32_t>;
+    std::vector<FreeSlot> free_slots;
+    // Intervals currently holding a register, ordered by end point.
+    std::vector<uint32_t> active;
+    using Ending = std::pair<uint32_t, uint32_t>;
+    std::priority_queue<Ending, std::vector<Ending>, std::greater<>> spilled_active;
+
+    auto ends_before = [&](uint32_t a, uint32_t b) {
+        return intervals[a].end < intervals[b].end;
+    };
+    // A victim that held a register is spilled for the whole of its interval, which
+    // began before the slots freed since then were free, so a slot only qualifies if
+    // it was free by the start of the interval being spilled.
+    auto spill = [&](uint32_t vreg) {
+        auto free_by_start = std::upper_bound(free_slots.begin(), free_slots.end(), intervals[vreg].start,
+            [](uint32_t start, const FreeSlot& free) { return start < free.first; });
+        uint32_t slot;
+        if (free_by_start != free_slots.begin()) {
+            slot = std::prev(free_by_start)->second;
+            free_slots.erase(std::prev(free_by_start));
+        }
+        else {
+            slot = allocation.spill_slots++;
+        }
+        allocation.locations[vreg] = Location{.spilled = true, .index = slot};
+        spilled_active.emplace(intervals[vreg].end, slot);
+        allocation.spilled++;
+    };
+
+    for (uint32_t vreg = 0; vreg < intervals.size(); vreg++) {
+        const uint32_t start = intervals[vreg].start;
+        auto expired = std::find_if(active.begin(), active.end(), [&](uint32_t other) {
+            return intervals[other].end > start;
+        });
+        for (auto it = active.begin(); it != expired; ++it) {
+            free_regs.push_back(static_cast<PhysReg>(allocation.locations[*it].index));
+        }
+        active.erase(active.begin(), expired);
+        while (!spilled_active.empty() && spilled_active.top().first <= start) {
+            free_slots.push_back(spilled_active.top());
+            spilled_active.pop();
+        }
+
+        if (free_regs.empty()) {
+            if (!active.empty() && intervals[active.back()].end > intervals[vreg].end) {
+                uint32_t victim = active.back();
+                allocation.locations[vreg] = allocation.locations[victim];
+                active.pop_back();
+                spill(victim);
+                active.insert(std::upper_bound(active.begin(), active.end(), vreg, ends_before), vreg);
+            }
+            else {
+                spill(vreg);
+            }
+            continue;
+        }
+        allocation.locations[vreg] = Location{.spilled = false, .index = free_regs.back()};
+        free_regs.pop_back();
+        active.insert(std::upper_bound(active.begin(), active.end(), vreg, ends_before), vreg);
+    }
+    return allocation;
+}
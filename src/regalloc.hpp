@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+// A register number in the target's own encoding (see TargetRegs).
+using PhysReg = uint8_t;
+
+// A virtual register is live from the instruction that defines it up to and including
+// its last use. A use and a definition at the same instruction do not overlap, since
+// operands are read before the result is written.
+struct LiveInterval {
+    uint32_t start;
+    uint32_t end;
+};
+
+// Where a virtual register lives for the whole of its interval.
+struct Location {
+    bool spilled;
+    // A PhysReg, or a spill slot index when spilled.
+    uint32_t index;
+};
+
+struct RegAllocation {
+    std::vector<Location> locations;
+    uint32_t spill_slots = 0;
+    uint32_t spilled = 0;
+};
+
+// Poletto and Sarkar's linear scan. `intervals` are indexed by virtual register and
+// must be sorted by start. When every register is taken, whichever live interval ends
+// last is spilled, so values that are used soon stay in registers. Spill slots are
+// reused once their interval ends, by intervals that start no earlier.
+RegAllocation linear_scan(std::span<const LiveInterval> intervals, std::span<const PhysReg> regs);
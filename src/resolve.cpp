@@ -0,0 +1,148 @@
+#include <cstdint>
+#include <utility>
+
+#include "resolve.hpp"
+#include "scopes.hpp"
+
+
+namespace {
+
+class Resolver {
+public:
+    Resolver(FlatAst& ast, const Interner& interner)
+        : m_ast(ast)
+        , m_interner(interner)
+        , m_symbols(interner)
+    {
+    }
+
+    std::vector<std::string> run() {
+        push_scope(m_ast.root);
+        while (!m_tasks.empty()) {
+            Task task = m_tasks.back();
+            m_tasks.pop_back();
+            switch (task.action) {
+                case Task::Action::stmt:
+                    resolve_stmt(task.node);
+                    break;
+                case Task::Action::ifpred:
+                    if (m_ast.kinds[task.node] == NodeKind::stmt_if) {
+                        push_if(task.node);
+                    }
+                    else {
+                        push_scope(m_ast.lhs[task.node]);
+                    }
+                    break;
+                case Task::Action::exit_scope:
+                    m_symbols.exitScope();
+                    break;
+            }
+        }
+        return std::move(m_diagnostics);
+    }
+
+private:
+    struct Task {
+        enum class Action : uint8_t {
+            stmt,
+            ifpred,
+            exit_scope,
+        };
+        Action action;
+        NodeIndex node = no_node;
+    };
+
+    void push_scope(NodeIndex scope) {
+        m_symbols.enterScope();
+        m_tasks.push_back(Task{.action = Task::Action::exit_scope});
+        auto stmts = m_ast.stmts(scope);
+        for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+            m_tasks.push_back(Task{.action = Task::Action::stmt, .node = *it});
+        }
+    }
+
+    void push_if(NodeIndex stmt_if) {
+        resolve_expr(m_ast.lhs[stmt_if]);
+        if (m_ast.payloads[stmt_if] != no_node) {
+            m_tasks.push_back(Task{.action = Task::Action::ifpred, .node = m_ast.payloads[stmt_if]});
+        }
+        push_scope(m_ast.rhs[stmt_if]);
+    }
+
+    void resolve_expr(NodeIndex expr) {
+        m_expr_work.push_back(expr);
+        while (!m_expr_work.empty()) {
+            NodeIndex node = m_expr_work.back();
+            m_expr_work.pop_back();
+            switch (m_ast.kinds[node]) {
+                case NodeKind::ident:
+                    if (const Var* var = m_symbols.findSymbol(m_ast.payloads[node])) {
+                        m_ast.rhs[node] = var->decl;
+                    }
+                    else {
+                        report("Undefined symbol ", m_ast.payloads[node]);
+                    }
+                    break;
+                case NodeKind::add:
+                case NodeKind::sub:
+                case NodeKind::mul:
+                case NodeKind::div:
+                    m_expr_work.push_back(m_ast.rhs[node]);
+                    m_expr_work.push_back(m_ast.lhs[node]);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    void resolve_stmt(NodeIndex stmt) {
+        switch (m_ast.kinds[stmt]) {
+            case NodeKind::stmt_return:
+            case NodeKind::stmt_exit:
+                resolve_expr(m_ast.lhs[stmt]);
+                break;
+            case NodeKind::stmt_let:
+                resolve_expr(m_ast.lhs[stmt]);
+                if (!m_symbols.declareSymbol(m_ast.payloads[stmt], stmt)) {
+                    report("Redefinition of ", m_ast.payloads[stmt]);
+                }
+                break;
+            case NodeKind::stmt_assign:
+                if (const Var* var = m_symbols.findSymbol(m_ast.payloads[stmt])) {
+                    m_ast.rhs[stmt] = var->decl;
+                }
+                else {
+                    report("Undeclared identifier ", m_ast.payloads[stmt]);
+                }
+                resolve_expr(m_ast.lhs[stmt]);
+                break;
+            case NodeKind::scope:
+                push_scope(stmt);
+                break;
+            case NodeKind::stmt_if:
+                push_if(stmt);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void report(const char* message, SymbolId ident) {
+        m_diagnostics.push_back(message + std::string(m_interner.spelling(ident)));
+    }
+
+    FlatAst& m_ast;
+    const Interner& m_interner;
+    SymbolManager m_symbols;
+    std::vector<Task> m_tasks;
+    std::vector<NodeIndex> m_expr_work;
+    std::vector<std::string> m_diagnostics;
+};
+
+} // namespace
+
+std::vector<std::string> resolve_names(FlatAst& ast, const Interner& interner) {
+    Resolver resolver(ast, interner);
+    return resolver.run();
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "flat_ast.hpp"
+#include "interner.hpp"
+
+
+// Binds every name to its declaration ahead of code generation, filling the slots
+// NodeKind documents: ident and stmt_assign nodes get the stmt_let they refer to.
+// Where each variable lives is left to layout_frame. Every diagnostic is collected,
+// in source order; only a program with none may be generated.
+std::vector<std::string> resolve_names(FlatAst& ast, const Interner& interner);
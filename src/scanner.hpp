@@ -0,0 +1,260 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Byte-class scanners used by the tokenizer's fast path. Each one looks at a whole
+// vector of source bytes at a time and falls back to a plain loop for the tail of
+// the buffer, or everywhere when no vector unit is available.
+namespace scan {
+
+#if defined(__AVX2__)
+
+struct Vec {
+    __m256i v;
+};
+
+constexpr size_t vec_width = 32;
+// Number of mask bits produced for each byte of a vector.
+constexpr int mask_bits_per_byte = 1;
+
+inline Vec load(const char* p) {
+    return {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))};
+}
+
+inline Vec eq(Vec a, char c) {
+    return {_mm256_cmpeq_epi8(a.v, _mm256_set1_epi8(c))};
+}
+
+// Unsigned lo <= a <= hi, computed as min(a - lo, hi - lo) == a - lo.
+inline Vec in_range(Vec a, char lo, char hi) {
+    __m256i diff = _mm256_sub_epi8(a.v, _mm256_set1_epi8(lo));
+    __m256i width = _mm256_set1_epi8(static_cast<char>(hi - lo));
+    return {_mm256_cmpeq_epi8(_mm256_min_epu8(diff, width), diff)};
+}
+
+inline Vec operator|(Vec a, Vec b) {
+    return {_mm256_or_si256(a.v, b.v)};
+}
+
+inline Vec operator&(Vec a, Vec b) {
+    return {_mm256_and_si256(a.v, b.v)};
+}
+
+inline uint64_t to_mask(Vec a) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(a.v));
+}
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+struct Vec {
+    __m128i v;
+};
+
+constexpr size_t vec_width = 16;
+constexpr int mask_bits_per_byte = 1;
+
+inline Vec load(const char* p) {
+    return {_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))};
+}
+
+inline Vec eq(Vec a, char c) {
+    return {_mm_cmpeq_epi8(a.v, _mm_set1_epi8(c))};
+}
+
+inline Vec in_range(Vec a, char lo, char hi) {
+    __m128i diff = _mm_sub_epi8(a.v, _mm_set1_epi8(lo));
+    __m128i width = _mm_set1_epi8(static_cast<char>(hi - lo));
+    return {_mm_cmpeq_epi8(_mm_min_epu8(diff, width), diff)};
+}
+
+inline Vec operator|(Vec a, Vec b) {
+    return {_mm_or_si128(a.v, b.v)};
+}
+
+inline Vec operator&(Vec a, Vec b) {
+    return {_mm_and_si128(a.v, b.v)};
+}
+
+inline uint64_t to_mask(Vec a) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(a.v));
+}
+
+#elif defined(__ARM_NEON)
+
+struct Vec {
+    uint8x16_t v;
+};
+
+constexpr size_t vec_width = 16;
+// NEON has no movemask; narrowing each 16-bit lane by 4 leaves one nibble per byte.
+constexpr int mask_bits_per_byte = 4;
+
+inline Vec load(const char* p) {
+    return {vld1q_u8(reinterpret_cast<const uint8_t*>(p))};
+}
+
+inline Vec eq(Vec a, char c) {
+    return {vceqq_u8(a.v, vdupq_n_u8(static_cast<uint8_t>(c)))};
+}
+
+inline Vec in_range(Vec a, char lo, char hi) {
+    uint8x16_t diff = vsubq_u8(a.v, vdupq_n_u8(static_cast<uint8_t>(lo)));
+    return {vcleq_u8(diff, vdupq_n_u8(static_cast<uint8_t>(hi - lo)))};
+}
+
+inline Vec operator|(Vec a, Vec b) {
+    return {vorrq_u8(a.v, b.v)};
+}
+
+inline Vec operator&(Vec a, Vec b) {
+    return {vandq_u8(a.v, b.v)};
+}
+
+inline uint64_t to_mask(Vec a) {
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(a.v), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+
+#else
+#define SEABSY_SCAN_SCALAR 1
+constexpr size_t vec_width = 0;
+#endif
+
+inline bool is_digit(char c) {
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+inline bool is_alpha(char c) {
+    return static_cast<unsigned char>((c | 0x20) - 'a') < 26;
+}
+
+inline bool is_alnum(char c) {
+    return is_alpha(c) || is_digit(c);
+}
+
+inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+#ifndef SEABSY_SCAN_SCALAR
+
+// Mask covering every byte of a full vector.
+constexpr uint64_t full_mask = vec_width * mask_bits_per_byte == 64
+    ? ~uint64_t{0}
+    : (uint64_t{1} << (vec_width * mask_bits_per_byte)) - 1;
+
+inline size_t first_byte(uint64_t mask) {
+    return static_cast<size_t>(std::countr_zero(mask)) / mask_bits_per_byte;
+}
+
+#endif
+
+// Returns the first byte in [p, end) that is not a digit.
+inline const char* skip_digits(const char* p, const char* end) {
+#ifndef SEABSY_SCAN_SCALAR
+    while (static_cast<size_t>(end - p) >= vec_width) {
+        uint64_t stop = ~to_mask(in_range(load(p), '0', '9')) & full_mask;
+        if (stop != 0) {
+            return p + first_byte(stop);
+        }
+        p += vec_width;
+    }
+#endif
+    while (p < end && is_digit(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// Returns the first byte in [p, end) that cannot continue an identifier.
+inline const char* skip_ident(const char* p, const char* end) {
+#ifndef SEABSY_SCAN_SCALAR
+    while (static_cast<size_t>(end - p) >= vec_width) {
+        Vec v = load(p);
+        Vec word = in_range(v, '0', '9') | in_range(v, 'a', 'z') | in_range(v, 'A', 'Z');
+        uint64_t stop = ~to_mask(word) & full_mask;
+        if (stop != 0) {
+            return p + first_byte(stop);
+        }
+        p += vec_width;
+    }
+#endif
+    while (p < end && is_alnum(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// Returns the first non-blank byte in [p, end).
+inline const char* skip_blanks(const char* p, const char* end) {
+    // Most runs between tokens are a single space; settle those without a vector load.
+    if (p < end && !is_blank(*p)) {
+        return p;
+    }
+    if (p + 1 < end && *p == ' ' && !is_blank(p[1])) {
+        return p + 1;
+    }
+#ifndef SEABSY_SCAN_SCALAR
+    while (static_cast<size_t>(end - p) >= vec_width) {
+        Vec v = load(p);
+        uint64_t stop = ~to_mask(eq(v, ' ') | eq(v, '\t') | eq(v, '\r') | eq(v, '\n')) & full_mask;
+        if (stop != 0) {
+            return p + first_byte(stop);
+        }
+        p += vec_width;
+    }
+#endif
+    while (p < end && is_blank(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// Returns the first '\n' in [p, end), or end if there is none.
+inline const char* find_newline(const char* p, const char* end) {
+#ifndef SEABSY_SCAN_SCALAR
+    while (static_cast<size_t>(end - p) >= vec_width) {
+        uint64_t nl = to_mask(eq(load(p), '\n'));
+        if (nl != 0) {
+            return p + first_byte(nl);
+        }
+        p += vec_width;
+    }
+#endif
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+// Returns the '*' of the first "*/" in [p, end), or end if the comment is never
+// closed.
+inline const char* find_comment_close(const char* p, const char* end) {
+#ifndef SEABSY_SCAN_SCALAR
+    // The second load reads one byte ahead, so stop a byte early.
+    while (static_cast<size_t>(end - p) > vec_width) {
+        uint64_t close = to_mask(eq(load(p), '*') & eq(load(p + 1), '/'));
+        if (close != 0) {
+            return p + first_byte(close);
+        }
+        p += vec_width;
+    }
+#endif
+    while (p < end) {
+        if (*p == '*' && p + 1 < end && p[1] == '/') {
+            return p;
+        }
+        p++;
+    }
+    return end;
+}
+
+} // namespace scan
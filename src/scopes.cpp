@@ -1,35 +1,43 @@
-#include <iostream>
 #include "scopes.hpp"
 
 
-SymbolManager::SymbolManager() {
+SymbolManager::SymbolManager(const Interner& interner)
+{
+    m_bindings.resize(interner.size(), Binding{.var = {}, .depth = 0});
     enterScope();
 }
 
 void SymbolManager::enterScope() {
-    scopes.emplace_back();
+    m_scope_marks.push_back(m_undo_log.size());
 }
 
 void SymbolManager::exitScope() {
-    scopes.pop_back();
+    size_t mark = m_scope_marks.back();
+    m_scope_marks.pop_back();
+    while (m_undo_log.size() > mark) {
+        const Shadowed& shadowed = m_undo_log.back();
+        m_bindings[shadowed.ident] = shadowed.previous;
+        m_undo_log.pop_back();
+    }
 }
 
-std::optional<Var> SymbolManager::findSymbol(std::string ident) {
-    // Search from innermost scope outward so shadowed bindings are found first
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        Scope& scope = *it;
-        if (scope.contains(ident)) {
-            return scope[ident];
-        }
+const Var* SymbolManager::findSymbol(SymbolId ident) const {
+    if (ident >= m_bindings.size() || m_bindings[ident].depth == 0) {
+        return nullptr;
     }
-    return {};
+    return &m_bindings[ident].var;
 }
 
-void SymbolManager::declareSymbol(std::string ident, size_t stack_position) {
-    Scope& currentScope = scopes.back();
-    if (currentScope.contains(ident)) {
-        std::cerr << "Redefinition of " << ident << std::endl;
-        exit(EXIT_FAILURE);
+bool SymbolManager::declareSymbol(SymbolId ident, uint32_t decl) {
+    if (ident >= m_bindings.size()) {
+        m_bindings.resize(static_cast<size_t>(ident) + 1, Binding{.var = {}, .depth = 0});
+    }
+    Binding& binding = m_bindings[ident];
+    auto depth = static_cast<uint32_t>(m_scope_marks.size());
+    if (binding.depth == depth) {
+        return false;
     }
-    currentScope[ident] = Var{.ident = ident, .stack_position = stack_position};
+    m_undo_log.push_back(Shadowed{.ident = ident, .previous = binding});
+    binding = Binding{.var = Var{.ident = ident, .decl = decl}, .depth = depth};
+    return true;
 }
@@ -1,28 +1,47 @@
 #pragma once
 
 #include <cstddef>
-#include <optional>
-#include <string>
-#include <unordered_map>
+#include <cstdint>
 #include <vector>
 
+#include "interner.hpp"
+
 
 struct Var {
-    std::string ident;
-    size_t stack_position;
+    SymbolId ident;
+    // What the name refers to; the resolver stores the declaring node here.
+    uint32_t decl;
 };
 
-using Scope = std::unordered_map<std::string, Var>;
-
+// One binding slot per symbol, indexed directly by the interner's dense ids, plus an
+// undo log of the bindings each scope shadowed. Entering a scope only records the
+// log's length, exiting restores what the scope's declarations replaced, and a lookup
+// is a single array access.
 class SymbolManager {
 public:
-    SymbolManager();
+    explicit SymbolManager(const Interner& interner);
 
     void enterScope();
     void exitScope();
-    std::optional<Var> findSymbol(std::string ident);
-    void declareSymbol(std::string ident, size_t stack_position);
+    const Var* findSymbol(SymbolId ident) const;
+    // Returns false, leaving the existing binding, if the current scope already declares
+    // `ident`.
+    bool declareSymbol(SymbolId ident, uint32_t decl);
 
 private:
-    std::vector<Scope> scopes;
+    struct Binding {
+        Var var;
+        // Scope depth of the declaration; zero when the symbol is not bound.
+        uint32_t depth;
+    };
+
+    struct Shadowed {
+        SymbolId ident;
+        Binding previous;
+    };
+
+    std::vector<Binding> m_bindings;
+    std::vector<Shadowed> m_undo_log;
+    // Undo log length when each open scope was entered.
+    std::vector<size_t> m_scope_marks;
 };
@@ -0,0 +1,584 @@
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+#include "ssa.hpp"
+
+
+ValueId SsaFunction::add_inst(BlockId block, SsaOp op, uint32_t a, uint32_t b, uint32_t c) {
+    ValueType type = is_terminator(op) ? ValueType::none : ValueType::i64;
+    insts.push_back(SsaInst{.op = op, .type = type, .block = block, .a = a, .b = b, .c = c});
+    auto value = static_cast<ValueId>(insts.size() - 1);
+    blocks[block].insts.push_back(value);
+    return value;
+}
+
+ValueId SsaFunction::add_constant(BlockId block, int64_t value) {
+    auto bits = static_cast<uint64_t>(value);
+    return add_inst(block, SsaOp::constant, static_cast<uint32_t>(bits), static_cast<uint32_t>(bits >> 32));
+}
+
+BlockId SsaFunction::add_block() {
+    blocks.emplace_back();
+    return static_cast<BlockId>(blocks.size() - 1);
+}
+
+int64_t SsaFunction::constant_value(ValueId constant) const {
+    const SsaInst& inst = insts[constant];
+    return static_cast<int64_t>(static_cast<uint64_t>(inst.b) << 32 | inst.a);
+}
+
+std::span<const ValueId> SsaFunction::phi_incoming(ValueId phi) const {
+    return std::span<const ValueId>(phi_args).subspan(insts[phi].a, insts[phi].b);
+}
+
+std::vector<BlockId> SsaFunction::successors(BlockId block) const {
+    const SsaInst& inst = insts[terminator(block)];
+    switch (inst.op) {
+        case SsaOp::br:
+            return {inst.b, inst.c};
+        case SsaOp::jmp:
+            return {inst.a};
+        default:
+            return {};
+    }
+}
+
+ValueId SsaFunction::terminator(BlockId block) const {
+    return blocks[block].insts.back();
+}
+
+size_t SsaFunction::inst_count() const {
+    size_t count = 0;
+    for (const SsaBlock& block : blocks) {
+        count += block.insts.size();
+    }
+    return count;
+}
+
+bool is_terminator(SsaOp op) {
+    return op == SsaOp::br || op == SsaOp::jmp || op == SsaOp::ret || op == SsaOp::exit;
+}
+
+namespace {
+
+// Variables are renamed while walking the program in order: each stmt_let holds the
+// value the variable has at the current point. An if records every rebinding in an
+// undo log so each arm starts from the values before it, and the join gets a phi for
+// each variable the arms leave with different values.
+class SsaBuilder {
+public:
+    explicit SsaBuilder(const FlatAst& ast)
+        : m_ast(ast)
+        , m_defs(ast.size(), no_value)
+        , m_seen(ast.size(), 0)
+    {
+    }
+
+    SsaFunction run() {
+        m_block = m_fn.add_block();
+        push_scope(m_ast.root);
+        while (!m_tasks.empty()) {
+            Task task = m_tasks.back();
+            m_tasks.pop_back();
+            switch (task.action) {
+                case Task::Action::stmt:
+                    build_stmt(task.node);
+                    break;
+                case Task::Action::ifpred:
+                    build_ifpred(task.node);
+                    break;
+                case Task::Action::end_arm:
+                    end_arm();
+                    break;
+                case Task::Action::end_if:
+                    end_if();
+                    break;
+            }
+        }
+        m_fn.add_inst(m_block, SsaOp::exit, m_fn.add_constant(m_block, 0));
+        return std::move(m_fn);
+    }
+
+private:
+    struct Task {
+        enum class Action : uint8_t {
+            stmt,
+            ifpred,
+            end_arm,
+            end_if,
+        };
+        Action action;
+        NodeIndex node = no_node;
+    };
+
+    struct Rebinding {
+        NodeIndex decl;
+        ValueId previous;
+    };
+
+    // An arm that reaches the join, with the variables it left rebound.
+    struct Edge {
+        BlockId block;
+        size_t first;
+        size_t count;
+    };
+
+    struct IfChain {
+        size_t log_mark;
+        // The block ending in the br whose false target is the next link.
+        BlockId pending_br = no_block;
+        std::vector<Edge> edges {};
+        std::vector<std::pair<NodeIndex, ValueId>> rebound {};
+    };
+
+    void push_scope(NodeIndex scope) {
+        auto stmts = m_ast.stmts(scope);
+        for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+            m_tasks.push_back(Task{.action = Task::Action::stmt, .node = *it});
+        }
+    }
+
+    // Tasks run last-in first-out, so the arm's statements run first, then the arm is
+    // closed, then the next link of the chain.
+    void push_arm(NodeIndex scope, NodeIndex next) {
+        m_tasks.push_back(Task{.action = Task::Action::ifpred, .node = next});
+        m_tasks.push_back(Task{.action = Task::Action::end_arm});
+        push_scope(scope);
+    }
+
+    void build_stmt(NodeIndex stmt) {
+        switch (m_ast.kinds[stmt]) {
+            case NodeKind::stmt_return:
+            case NodeKind::stmt_exit: {
+                ValueId value = build_expr(m_ast.lhs[stmt]);
+                m_fn.add_inst(m_block, m_ast.kinds[stmt] == NodeKind::stmt_exit ? SsaOp::exit : SsaOp::ret, value);
+                // Whatever follows is unreachable, but still goes somewhere.
+                m_block = m_fn.add_block();
+                break;
+            }
+            case NodeKind::stmt_let:
+                bind(stmt, build_expr(m_ast.lhs[stmt]));
+                break;
+            case NodeKind::stmt_assign:
+                bind(m_ast.rhs[stmt], build_expr(m_ast.lhs[stmt]));
+                break;
+            case NodeKind::scope:
+                push_scope(stmt);
+                break;
+            case NodeKind::stmt_if:
+                m_chains.push_back(IfChain{.log_mark = m_log.size()});
+                m_tasks.push_back(Task{.action = Task::Action::end_if});
+                build_cond(stmt);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void build_cond(NodeIndex stmt_if) {
+        ValueId cond = build_expr(m_ast.lhs[stmt_if]);
+        BlockId then_block = m_fn.add_block();
+        m_fn.blocks[then_block].preds.push_back(m_block);
+        m_fn.add_inst(m_block, SsaOp::br, cond, then_block, no_block);
+        m_chains.back().pending_br = m_block;
+        m_block = then_block;
+        push_arm(m_ast.rhs[stmt_if], m_ast.payloads[stmt_if]);
+    }
+
+    // The false side of the previous condition gets a block of its own even without an
+    // else, so that every edge into the join comes from a jmp.
+    void build_ifpred(NodeIndex ifpred) {
+        IfChain& chain = m_chains.back();
+        m_block = m_fn.add_block();
+        m_fn.blocks[m_block].preds.push_back(chain.pending_br);
+        m_fn.insts[m_fn.terminator(chain.pending_br)].c = m_block;
+        if (ifpred == no_node) {
+            end_arm();
+        }
+        else if (m_ast.kinds[ifpred] == NodeKind::stmt_if) {
+            build_cond(ifpred);
+        }
+        else {
+            m_tasks.push_back(Task{.action = Task::Action::end_arm});
+            push_scope(m_ast.lhs[ifpred]);
+        }
+    }
+
+    void end_arm() {
+        IfChain& chain = m_chains.back();
+        m_epoch++;
+        Edge edge{.block = m_block, .first = chain.rebound.size(), .count = 0};
+        for (size_t i = chain.log_mark; i < m_log.size(); i++) {
+            const Rebinding& rebinding = m_log[i];
+            if (m_seen[rebinding.decl] == m_epoch) {
+                continue;
+            }
+            m_seen[rebinding.decl] = m_epoch;
+            // Variables declared inside the arm are out of scope at the join.
+            if (rebinding.previous != no_value) {
+                chain.rebound.emplace_back(rebinding.decl, m_defs[rebinding.decl]);
+                edge.count++;
+            }
+        }
+        chain.edges.push_back(edge);
+        while (m_log.size() > chain.log_mark) {
+            m_defs[m_log.back().decl] = m_log.back().previous;
+            m_log.pop_back();
+        }
+    }
+
+    void end_if() {
+        IfChain chain = std::move(m_chains.back());
+        m_chains.pop_back();
+        BlockId join = m_fn.add_block();
+        for (const Edge& edge : chain.edges) {
+            m_fn.add_inst(edge.block, SsaOp::jmp, join);
+            m_fn.blocks[join].preds.push_back(edge.block);
+        }
+        m_block = join;
+
+        m_epoch++;
+        std::vector<ValueId> incoming(chain.edges.size());
+        for (const auto& [decl, unused] : chain.rebound) {
+            if (m_seen[decl] == m_epoch) {
+                continue;
+            }
+            m_seen[decl] = m_epoch;
+            for (size_t i = 0; i < chain.edges.size(); i++) {
+                const Edge& edge = chain.edges[i];
+                incoming[i] = m_defs[decl];
+                for (size_t j = edge.first; j < edge.first + edge.count; j++) {
+                    if (chain.rebound[j].first == decl) {
+                        incoming[i] = chain.rebound[j].second;
+                        break;
+                    }
+                }
+            }
+            if (std::all_of(incoming.begin(), incoming.end(), [&](ValueId value) { return value == incoming[0]; })) {
+                bind(decl, incoming[0]);
+                continue;
+            }
+            auto first = static_cast<uint32_t>(m_fn.phi_args.size());
+            m_fn.phi_args.insert(m_fn.phi_args.end(), incoming.begin(), incoming.end());
+            bind(decl, m_fn.add_inst(join, SsaOp::phi, first, static_cast<uint32_t>(incoming.size())));
+        }
+    }
+
+    void bind(NodeIndex decl, ValueId value) {
+        m_log.push_back(Rebinding{.decl = decl, .previous = m_defs[decl]});
+        m_defs[decl] = value;
+    }
+
+    ValueId build_expr(NodeIndex expr) {
+        m_expr_work.emplace_back(expr, false);
+        while (!m_expr_work.empty()) {
+            auto [node, operands_done] = m_expr_work.back();
+            m_expr_work.pop_back();
+            if (operands_done) {
+                ValueId rhs = m_expr_values.back();
+                m_expr_values.pop_back();
+                ValueId lhs = m_expr_values.back();
+                m_expr_values.back() = m_fn.add_inst(m_block, binary_op(m_ast.kinds[node]), lhs, rhs);
+                continue;
+            }
+            switch (m_ast.kinds[node]) {
+                case NodeKind::int_lit:
+                    m_expr_values.push_back(m_fn.add_constant(m_block, m_ast.int_value(node)));
+                    break;
+                case NodeKind::ident:
+                    m_expr_values.push_back(m_defs[m_ast.rhs[node]]);
+                    break;
+                default:
+                    m_expr_work.emplace_back(node, true);
+                    m_expr_work.emplace_back(m_ast.rhs[node], false);
+                    m_expr_work.emplace_back(m_ast.lhs[node], false);
+                    break;
+            }
+        }
+        ValueId value = m_expr_values.back();
+        m_expr_values.pop_back();
+        return value;
+    }
+
+    static SsaOp binary_op(NodeKind kind) {
+        switch (kind) {
+            case NodeKind::add:
+                return SsaOp::add;
+            case NodeKind::sub:
+                return SsaOp::sub;
+            case NodeKind::mul:
+                return SsaOp::mul;
+            default:
+                return SsaOp::div;
+        }
+    }
+
+    const FlatAst& m_ast;
+    SsaFunction m_fn;
+    BlockId m_block = no_block;
+    std::vector<Task> m_tasks;
+    std::vector<IfChain> m_chains;
+    // The current value of each variable, indexed by its stmt_let.
+    std::vector<ValueId> m_defs;
+    std::vector<Rebinding> m_log;
+    // Marks variables already handled in the current pass over the log.
+    std::vector<uint32_t> m_seen;
+    uint32_t m_epoch = 0;
+    std::vector<std::pair<NodeIndex, bool>> m_expr_work;
+    std::vector<ValueId> m_expr_values;
+};
+
+} // namespace
+
+SsaFunction build_ssa(const FlatAst& ast) {
+    SsaBuilder builder(ast);
+    return builder.run();
+}
+
+// Blocks are in topological order, so one forward pass computes immediate dominators:
+// a block's idom is the nearest common dominator of its reachable predecessors, which
+// are all done by the time it is reached.
+std::vector<BlockId> immediate_dominators(const SsaFunction& fn) {
+    std::vector<BlockId> idom(fn.blocks.size(), no_block);
+    std::vector<uint32_t> depth(fn.blocks.size(), 0);
+    idom[0] = 0;
+    for (BlockId block = 1; block < fn.blocks.size(); block++) {
+        BlockId dom = no_block;
+        for (BlockId pred : fn.blocks[block].preds) {
+            if (pred >= block || idom[pred] == no_block) {
+                continue;
+            }
+            BlockId other = pred;
+            if (dom == no_block) {
+                dom = other;
+            }
+            while (dom != other) {
+                if (depth[dom] >= depth[other]) {
+                    dom = idom[dom];
+                }
+                else {
+                    other = idom[other];
+                }
+            }
+        }
+        idom[block] = dom;
+        depth[block] = dom == no_block ? 0 : depth[dom] + 1;
+    }
+    return idom;
+}
+
+std::vector<std::string> verify_ssa(const SsaFunction& fn) {
+    std::vector<std::string> diagnostics;
+    auto report = [&](BlockId block, const std::string& message) {
+        diagnostics.push_back("bb" + std::to_string(block) + ": " + message);
+    };
+    if (fn.blocks.empty()) {
+        diagnostics.push_back("no entry block");
+        return diagnostics;
+    }
+    if (!fn.blocks[0].preds.empty()) {
+        report(0, "entry block has predecessors");
+    }
+
+    std::vector<uint32_t> position(fn.insts.size(), UINT32_MAX);
+    for (BlockId block = 0; block < fn.blocks.size(); block++) {
+        const std::vector<ValueId>& insts = fn.blocks[block].insts;
+        for (uint32_t i = 0; i < insts.size(); i++) {
+            if (insts[i] >= fn.insts.size() || fn.insts[insts[i]].block != block) {
+                report(block, "lists %" + std::to_string(insts[i]) + " which belongs elsewhere");
+                return diagnostics;
+            }
+            position[insts[i]] = i;
+        }
+    }
+
+    std::vector<BlockId> idom = immediate_dominators(fn);
+    auto dominates = [&](BlockId dom, BlockId block) {
+        while (block != dom && block != 0) {
+            block = idom[block];
+        }
+        return block == dom;
+    };
+    // Whether `value` is available at the end of `block`, or before its instruction
+    // number `index`.
+    auto available = [&](ValueId value, BlockId block, uint32_t index) {
+        if (value >= fn.insts.size() || position[value] == UINT32_MAX || fn.insts[value].type != ValueType::i64) {
+            return false;
+        }
+        BlockId def_block = fn.insts[value].block;
+        if (def_block == block) {
+            return position[value] < index;
+        }
+        return dominates(def_block, block);
+    };
+
+    for (BlockId block = 0; block < fn.blocks.size(); block++) {
+        const SsaBlock& bb = fn.blocks[block];
+        for (BlockId pred : bb.preds) {
+            if (pred >= block) {
+                report(block, "predecessor bb" + std::to_string(pred) + " is not earlier in the order");
+            }
+            else if (!fn.blocks[pred].insts.empty()) {
+                std::vector<BlockId> succs = fn.successors(pred);
+                if (std::find(succs.begin(), succs.end(), block) == succs.end()) {
+                    report(block, "bb" + std::to_string(pred) + " is listed as a predecessor but does not branch here");
+                }
+            }
+        }
+        if (bb.insts.empty() || !is_terminator(fn.insts[bb.insts.back()].op)) {
+            report(block, "does not end in a terminator");
+            continue;
+        }
+        for (BlockId succ : fn.successors(block)) {
+            if (succ >= fn.blocks.size()) {
+                report(block, "branches to a block that does not exist");
+            }
+            else if (std::count(fn.blocks[succ].preds.begin(), fn.blocks[succ].preds.end(), block) != 1) {
+                report(block, "is not listed once among the predecessors of bb" + std::to_string(succ));
+            }
+        }
+        // Dominance is only checked where it means something: in unreachable code
+        // no block dominates another.
+        const bool reachable = idom[block] != no_block;
+        bool phis_done = false;
+        for (uint32_t i = 0; i < bb.insts.size(); i++) {
+            ValueId value = bb.insts[i];
+            const SsaInst& inst = fn.insts[value];
+            const std::string name = "%" + std::to_string(value);
+            if (is_terminator(inst.op) != (i + 1 == bb.insts.size())) {
+                report(block, name + " is a terminator in the middle of the block");
+            }
+            if (inst.type != (is_terminator(inst.op) ? ValueType::none : ValueType::i64)) {
+                report(block, name + " has the wrong type");
+            }
+            auto check_operand = [&](ValueId operand) {
+                if (operand >= fn.insts.size() || fn.insts[operand].type != ValueType::i64) {
+                    report(block, name + " uses something that is not an i64 value");
+                }
+                else if (reachable && !available(operand, block, i)) {
+                    report(block, name + " uses %" + std::to_string(operand) + " before it is defined");
+                }
+            };
+            switch (inst.op) {
+                case SsaOp::phi: {
+                    if (phis_done) {
+                        report(block, name + " is a phi after other instructions");
+                    }
+                    if (static_cast<size_t>(inst.a) + inst.b > fn.phi_args.size() || inst.b != bb.preds.size()) {
+                        report(block, name + " does not have one incoming value per predecessor");
+                        break;
+                    }
+                    std::span<const ValueId> incoming = fn.phi_incoming(value);
+                    for (size_t p = 0; p < incoming.size(); p++) {
+                        const BlockId pred = bb.preds[p];
+                        const bool pred_reachable = pred < fn.blocks.size() && idom[pred] != no_block;
+                        if (incoming[p] >= fn.insts.size() || fn.insts[incoming[p]].type != ValueType::i64) {
+                            report(block, name + " has an incoming value that is not an i64 value");
+                        }
+                        else if (pred_reachable && !available(incoming[p], pred, UINT32_MAX)) {
+                            report(block, name + " takes %" + std::to_string(incoming[p]) + " from bb" + std::to_string(pred) + " where it is not defined");
+                        }
+                    }
+                    break;
+                }
+                case SsaOp::constant:
+                    phis_done = true;
+                    break;
+                case SsaOp::add:
+                case SsaOp::sub:
+                case SsaOp::mul:
+                case SsaOp::div:
+                    phis_done = true;
+                    check_operand(inst.a);
+                    check_operand(inst.b);
+                    break;
+                case SsaOp::br:
+                case SsaOp::ret:
+                case SsaOp::exit:
+                    phis_done = true;
+                    check_operand(inst.a);
+                    break;
+                case SsaOp::jmp:
+                    phis_done = true;
+                    break;
+            }
+        }
+    }
+    return diagnostics;
+}
+
+static const char* op_name(SsaOp op) {
+    switch (op) {
+        case SsaOp::constant:
+            return "const";
+        case SsaOp::add:
+            return "add";
+        case SsaOp::sub:
+            return "sub";
+        case SsaOp::mul:
+            return "mul";
+        case SsaOp::div:
+            return "div";
+        case SsaOp::phi:
+            return "phi";
+        case SsaOp::br:
+            return "br";
+        case SsaOp::jmp:
+            return "jmp";
+        case SsaOp::ret:
+            return "ret";
+        default:
+            return "exit";
+    }
+}
+
+std::string dump_ssa(const SsaFunction& fn) {
+    std::stringstream output;
+    for (BlockId block = 0; block < fn.blocks.size(); block++) {
+        const SsaBlock& bb = fn.blocks[block];
+        output << "bb" << block << ":";
+        if (!bb.preds.empty()) {
+            output << " ; preds";
+            for (BlockId pred : bb.preds) {
+                output << " bb" << pred;
+            }
+        }
+        output << "\n";
+        for (ValueId value : bb.insts) {
+            const SsaInst& inst = fn.insts[value];
+            output << "    ";
+            if (inst.type == ValueType::i64) {
+                output << "%" << value << " = ";
+            }
+            output << op_name(inst.op);
+            switch (inst.op) {
+                case SsaOp::constant:
+                    output << " " << fn.constant_value(value);
+                    break;
+                case SsaOp::phi: {
+                    std::span<const ValueId> incoming = fn.phi_incoming(value);
+                    for (size_t p = 0; p < incoming.size(); p++) {
+                        output << (p == 0 ? " " : ", ") << "[bb" << bb.preds[p] << ": %" << incoming[p] << "]";
+                    }
+                    break;
+                }
+                case SsaOp::br:
+                    output << " %" << inst.a << ", bb" << inst.b << ", bb" << inst.c;
+                    break;
+                case SsaOp::jmp:
+                    output << " bb" << inst.a;
+                    break;
+                case SsaOp::ret:
+                case SsaOp::exit:
+                    output << " %" << inst.a;
+                    break;
+                default:
+                    output << " %" << inst.a << ", %" << inst.b;
+                    break;
+            }
+            output << "\n";
+        }
+    }
+    return output.str();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "flat_ast.hpp"
+
+
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+
+constexpr ValueId no_value = UINT32_MAX;
+constexpr BlockId no_block = UINT32_MAX;
+
+// Every value the language computes is a 64-bit integer. Terminators produce none.
+enum class ValueType : uint8_t {
+    none,
+    i64,
+};
+
+// What each op keeps in its a / b / c slots.
+enum class SsaOp : uint8_t {
+    constant,  // a, b: low and high halves of the value (see constant_value)
+    add,       // a, b: operands
+    sub,
+    mul,
+    div,
+    phi,       // a: first incoming value in phi_args, b: count, one per predecessor in order
+    br,        // a: condition, b: block taken when it is nonzero, c: block taken when zero
+    jmp,       // a: target block
+    ret,       // a: value
+    exit,      // a: value
+};
+
+struct SsaInst {
+    SsaOp op;
+    ValueType type;
+    BlockId block;
+    uint32_t a = no_value;
+    uint32_t b = no_value;
+    uint32_t c = no_value;
+};
+
+struct SsaBlock {
+    // Phis first and exactly one terminator last.
+    std::vector<ValueId> insts;
+    std::vector<BlockId> preds;
+};
+
+// The program as one function in SSA form over basic blocks. A value is named by the
+// index of the instruction that defines it.
+//
+// The language has no loops, so the control-flow graph is acyclic, and blocks are
+// kept in a topological order: every predecessor has a smaller index than its
+// successors, and block 0 is the entry. A forward loop over the blocks therefore
+// sees every definition before any use that is not a phi.
+struct SsaFunction {
+    std::vector<SsaInst> insts;
+    std::vector<SsaBlock> blocks;
+    std::vector<ValueId> phi_args;
+
+    ValueId add_inst(BlockId block, SsaOp op, uint32_t a = no_value, uint32_t b = no_value, uint32_t c = no_value);
+    ValueId add_constant(BlockId block, int64_t value);
+    BlockId add_block();
+    int64_t constant_value(ValueId constant) const;
+    std::span<const ValueId> phi_incoming(ValueId phi) const;
+    // Blocks the terminator of `block` may continue to.
+    std::vector<BlockId> successors(BlockId block) const;
+    ValueId terminator(BlockId block) const;
+    // Instructions still listed in some block; passes leave the ones they remove
+    // behind in `insts`.
+    size_t inst_count() const;
+};
+
+bool is_terminator(SsaOp op);
+
+// `ast` must have been through resolve_names without diagnostics. Variables become
+// values, with phis where the arms of an if assign them differently. Statements after
+// an exit or return still get a block, one with no predecessors.
+SsaFunction build_ssa(const FlatAst& ast);
+
+// The entry is its own immediate dominator, and unreachable blocks have none.
+std::vector<BlockId> immediate_dominators(const SsaFunction& fn);
+
+// Checks the invariants above and that every use is dominated by its definition.
+// Returns a description of each problem found; the function is well formed if none.
+std::vector<std::string> verify_ssa(const SsaFunction& fn);
+
+std::string dump_ssa(const SsaFunction& fn);
@@ -0,0 +1,64 @@
+#include <array>
+
+#include "target.hpp"
+#include "x86_64.hpp"
+
+
+std::optional<Target> parse_target(std::string_view name) {
+    if (name == "arm64") {
+        return Target::arm64;
+    }
+    if (name == "x86_64") {
+        return Target::x86_64;
+    }
+    return std::nullopt;
+}
+
+namespace {
+
+// x0 carries results to return and exit, x16 and x17 are scratch for spill code,
+// x18 is reserved by the platform and x29 and x30 are the frame pointer and link
+// register.
+constexpr std::array<PhysReg, 25> arm64_allocatable = {
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28,
+};
+constexpr std::array<PhysReg, 10> arm64_variables = {19, 20, 21, 22, 23, 24, 25, 26, 27, 28};
+
+// Numbered as in the instruction encoding: rax 0, rcx 1, rdx 2, rbx 3, rsp 4, rbp 5,
+// rsi 6, rdi 7, then r8 to r15. rax carries results and, with rdx, is taken by idiv,
+// and r10 and r11 are scratch for spill code.
+constexpr std::array<PhysReg, 11> x86_64_allocatable = {1, 6, 7, 8, 9, 3, 5, 12, 13, 14, 15};
+constexpr std::array<PhysReg, 6> x86_64_variables = {3, 5, 12, 13, 14, 15};
+
+constexpr uint32_t mask(std::span<const PhysReg> regs) {
+    uint32_t bits = 0;
+    for (PhysReg reg : regs) {
+        bits |= 1u << reg;
+    }
+    return bits;
+}
+
+const TargetRegs arm64_regs = {
+    .allocatable = arm64_allocatable,
+    .spill_scratch = {16, 17},
+    .variables = arm64_variables,
+    .callee_saved = mask(arm64_variables),
+};
+
+const TargetRegs x86_64_regs = {
+    .allocatable = x86_64_allocatable,
+    .spill_scratch = {10, 11},
+    .variables = x86_64_variables,
+    .callee_saved = mask(x86_64_variables),
+};
+
+} // namespace
+
+const TargetRegs& target_regs(Target target) {
+    return target == Target::x86_64 ? x86_64_regs : arm64_regs;
+}
+
+std::string print_target_asm(const MachineCode& code, Target target) {
+    return target == Target::x86_64 ? print_x86_64_asm(code) : print_asm(code);
+}
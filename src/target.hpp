@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "machine.hpp"
+#include "regalloc.hpp"
+
+
+// The code generators, the SSA lowering and the peephole pass all work on the same
+// MachineCode and only differ per target in which registers they may use. Register
+// 0 always carries the result to return or exit with, and sp_reg stands for the
+// stack pointer.
+enum class Target : uint8_t {
+    arm64,
+    x86_64,
+};
+
+std::optional<Target> parse_target(std::string_view name);
+
+struct TargetRegs {
+    // Handed out to temporaries, caller-saved first so that the callee-saved ones,
+    // which cost a save and restore, are only reached under pressure.
+    std::span<const PhysReg> allocatable;
+    // Never allocated, for loading spilled operands and breaking copy cycles.
+    PhysReg spill_scratch[2];
+    // Callee-saved registers that `let` variables are promoted to, in slot order.
+    // Those taken by variables are left out of the temporaries' pool.
+    std::span<const PhysReg> variables;
+    // Bit n is set if register n must be preserved for the caller.
+    uint32_t callee_saved;
+
+    bool is_callee_saved(PhysReg reg) const {
+        return (callee_saved & 1u << reg) != 0;
+    }
+};
+
+const TargetRegs& target_regs(Target target);
+
+// The whole program as assembly for `target`: Apple's ARM64 dialect, or x86-64
+// System V in GNU Intel syntax.
+std::string print_target_asm(const MachineCode& code, Target target);
@@ -1,17 +1,44 @@
-#include <cctype>
-#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <utility>
 
+#include "scanner.hpp"
 #include "tokenization.hpp"
 
 
-static const std::unordered_map<std::string, TokenType> keywords = {
-    {"return", TokenType::_return},
-    {"let", TokenType::let},
-    {"if", TokenType::_if},
-    {"elif", TokenType::_elif},
-    {"else", TokenType::_else},
-    {"exit", TokenType::_exit}
-};
+// Keywords are matched on length first, so a word is compared against at most
+// three spellings and no hashing or allocation takes place.
+static constexpr std::optional<TokenType> keyword(std::string_view word) {
+    switch (word.size()) {
+        case 2:
+            if (word == "if") return TokenType::_if;
+            break;
+        case 3:
+            if (word == "let") return TokenType::let;
+            break;
+        case 4:
+            if (word == "elif") return TokenType::_elif;
+            if (word == "else") return TokenType::_else;
+            if (word == "exit") return TokenType::_exit;
+            break;
+        case 6:
+            if (word == "return") return TokenType::_return;
+            break;
+        default:
+            break;
+    }
+    return {};
+}
+
+static_assert(keyword("return") == TokenType::_return);
+static_assert(keyword("elif") == TokenType::_elif);
+static_assert(!keyword("lets").has_value());
 
 std::optional<int> bin_prec(TokenType type) {
     switch (type) {
@@ -26,120 +53,391 @@ std::optional<int> bin_prec(TokenType type) {
     }
 }
 
-Tokenizer::Tokenizer(const std::string& src)
+// Literals below this bound are stored in the token payload itself; wider ones go
+// to the tokenizer's literal pool and the payload holds the flag plus a pool index.
+static constexpr uint32_t wide_literal_flag = 1u << 23;
+static constexpr uint32_t payload_limit = 1u << 24;
+
+Tokenizer::Tokenizer(std::string_view src)
     : m_src(src)
+    , m_cursor(src.data())
 {
+    if (src.size() > UINT32_MAX) {
+        error_tokenize("Source larger than 4 GiB", src.data());
+    }
 }
 
-void Tokenizer::addToken(TokenType type, std::optional<std::string> value) {
-    tokens.push_back(Token{type, .line_no = line_count, .value = value});
+void Tokenizer::set_source(std::string_view src, size_t offset) {
+    if (src.size() > UINT32_MAX) {
+        error_tokenize("Source larger than 4 GiB", src.data());
+    }
+    m_src = src;
+    m_cursor = src.data() + std::min(offset, src.size());
+    m_line_starts.clear();
+}
+
+Token Tokenizer::make_token(TokenType type, const char* start, uint32_t payload) const {
+    return Token{.type = type, .payload = payload, .offset = static_cast<uint32_t>(start - m_src.data())};
+}
+
+uint32_t Tokenizer::encode_int_lit(const char* start, const char* end) {
+    int64_t value = 0;
+    auto [ptr, ec] = std::from_chars(start, end, value);
+    if (ec != std::errc() || ptr != end) {
+        error_tokenize("Integer literal out of range", start);
+        return 0;
+    }
+    if (value < wide_literal_flag) {
+        return static_cast<uint32_t>(value);
+    }
+    if (m_wide_literals.size() >= wide_literal_flag) {
+        error_tokenize("Too many large integer literals", start);
+        return 0;
+    }
+    m_wide_literals.push_back(value);
+    return wide_literal_flag | static_cast<uint32_t>(m_wide_literals.size() - 1);
 }
 
 std::vector<Token> Tokenizer::tokenize() {
-    tokens.clear();
-    line_count = 1;
-    m_index = 0;
-    std::string buffer;
+    m_cursor = m_src.data();
+    std::vector<Token> tokens;
+    // Sources average several bytes per token; reserving up front saves most of the
+    // regrowth copies of the token array on large inputs.
+    tokens.reserve(m_src.size() / 8);
+    while (auto token = next()) {
+        tokens.push_back(token.value());
+    }
+    return tokens;
+}
+
+// Chunks smaller than this cost more in thread start-up and merging than they save.
+static constexpr size_t min_parallel_chunk = 256 * 1024;
+
+struct Tokenizer::Chunk {
+    size_t begin;
+    size_t end;
+    Tokenizer lexer;
+    std::vector<Token> tokens {};
+    // First token at or after `end`: where the next chunk really starts.
+    std::optional<Token> next {};
+    // Symbols and wide literals of the chunk's own tokens, leaving out `next`.
+    size_t symbol_count = 0;
+    size_t literal_count = 0;
+
+    size_t first_offset() const {
+        if (!tokens.empty()) {
+            return tokens.front().offset;
+        }
+        return next.has_value() ? next->offset : lexer.m_src.size();
+    }
+};
+
+void Tokenizer::lex_chunk(Chunk& chunk, size_t start, bool speculative) {
+    chunk.lexer = Tokenizer(chunk.lexer.m_src);
+    chunk.lexer.m_cursor = chunk.lexer.m_src.data() + start;
+    chunk.lexer.m_speculative = speculative;
+    chunk.tokens.clear();
+    chunk.tokens.reserve((chunk.end - std::min(start, chunk.end)) / 8);
+    chunk.next.reset();
+    chunk.symbol_count = 0;
+    chunk.literal_count = 0;
+    while (auto token = chunk.lexer.next()) {
+        if (token->offset >= chunk.end) {
+            chunk.next = token;
+            break;
+        }
+        chunk.tokens.push_back(token.value());
+        chunk.symbol_count = chunk.lexer.m_interner.size();
+        chunk.literal_count = chunk.lexer.m_wide_literals.size();
+    }
+}
 
-    while (inspect().has_value()) {
-        char c = consume();
+std::vector<Token> Tokenizer::tokenize_parallel(size_t threads) {
+    const size_t chunk_count = std::min(threads, m_src.size() / min_parallel_chunk);
+    if (chunk_count <= 1) {
+        return tokenize();
+    }
+
+    // Chunks end just past a newline, so no identifier or literal is ever split. A
+    // boundary can still fall inside a block comment, which the merge below detects.
+    const char* const end = m_src.data() + m_src.size();
+    std::vector<Chunk> chunks;
+    chunks.reserve(chunk_count);
+    size_t begin = 0;
+    for (size_t i = 1; i <= chunk_count && begin < m_src.size(); i++) {
+        size_t target = i == chunk_count ? m_src.size() : m_src.size() / chunk_count * i;
+        const char* newline = scan::find_newline(m_src.data() + std::max(target, begin), end);
+        size_t chunk_end = newline < end ? static_cast<size_t>(newline + 1 - m_src.data()) : m_src.size();
+        chunks.push_back(Chunk{.begin = begin, .end = chunk_end, .lexer = Tokenizer(m_src)});
+        begin = chunk_end;
+    }
+
+    // Every chunk but the first guesses that lexing may start at its beginning.
+    {
+        std::vector<std::jthread> workers;
+        for (size_t i = 1; i < chunks.size(); i++) {
+            workers.emplace_back([&chunk = chunks[i]] { lex_chunk(chunk, chunk.begin, true); });
+        }
+        lex_chunk(chunks.front(), 0, true);
+    }
+
+    // The guess holds when the chunk's first token is the one its predecessor ran into
+    // past the boundary; from a shared token start, lexing is identical. Otherwise the
+    // boundary was inside a comment and the chunk is lexed again from the right place.
+    size_t start = 0;
+    for (Chunk& chunk : chunks) {
+        if (chunk.lexer.m_failed || chunk.first_offset() != start) {
+            lex_chunk(chunk, start, false);
+        }
+        start = chunk.next.has_value() ? chunk.next->offset : m_src.size();
+    }
+
+    // Symbols are interned chunk by chunk in order of first appearance, which assigns
+    // the same ids as a serial pass, and each chunk's literals land at an offset given by
+    // a prefix sum over the pool sizes. The token arrays are placed the same way.
+    std::vector<std::vector<SymbolId>> symbol_maps(chunks.size());
+    std::vector<uint32_t> literal_bases(chunks.size());
+    std::vector<size_t> token_bases(chunks.size());
+    size_t token_count = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        const Chunk& chunk = chunks[i];
+        symbol_maps[i].reserve(chunk.symbol_count);
+        for (SymbolId local = 0; local < chunk.symbol_count; local++) {
+            symbol_maps[i].push_back(m_interner.intern(chunk.lexer.m_interner.spelling(local)));
+        }
+        literal_bases[i] = static_cast<uint32_t>(m_wide_literals.size());
+        const auto& literals = chunk.lexer.m_wide_literals;
+        m_wide_literals.insert(m_wide_literals.end(), literals.begin(), literals.begin() + static_cast<std::ptrdiff_t>(chunk.literal_count));
+        token_bases[i] = token_count;
+        token_count += chunk.tokens.size();
+    }
+    // Past the payload limits a serial pass reports the first offending token.
+    if (m_interner.size() > payload_limit || m_wide_literals.size() > wide_literal_flag) {
+        return tokenize();
+    }
+
+    std::vector<Token> tokens(token_count);
+    {
+        std::vector<std::jthread> workers;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            workers.emplace_back([&, i] {
+                Token* out = tokens.data() + token_bases[i];
+                for (Token token : chunks[i].tokens) {
+                    if (token.type == TokenType::ident) {
+                        token.payload = symbol_maps[i][token.payload];
+                    }
+                    else if (token.type == TokenType::int_lit && (token.payload & wide_literal_flag)) {
+                        token.payload = wide_literal_flag | (literal_bases[i] + (token.payload & ~wide_literal_flag));
+                    }
+                    *out++ = token;
+                }
+            });
+        }
+    }
+    m_cursor = end;
+    return tokens;
+}
+
+std::optional<Token> Tokenizer::next() {
+    const char* const end = m_src.data() + m_src.size();
+    const char* p = m_cursor;
+
+    while (p < end) {
+        p = scan::skip_blanks(p, end);
+        if (p == end) {
+            break;
+        }
+        const char* start = p;
+        const char c = *p++;
+        m_cursor = p;
         switch (c) {
             case(';'):
-                addToken(TokenType::semi);
-                break;
+                return make_token(TokenType::semi, start);
             case('='):
-                addToken(TokenType::eq);
-                break;
+                return make_token(TokenType::eq, start);
             case('+'):
-                addToken(TokenType::plus);
-                break;
+                return make_token(TokenType::plus, start);
             case('*'):
-                addToken(TokenType::star);
-                break;
+                return make_token(TokenType::star, start);
             case('-'):
-                addToken(TokenType::minus);
-                break;
+                return make_token(TokenType::minus, start);
             case('('):
-                addToken(TokenType::left_paren);
-                break;
+                return make_token(TokenType::left_paren, start);
             case(')'):
-                addToken(TokenType::right_paren);
-                break;
+                return make_token(TokenType::right_paren, start);
             case('{'):
-                addToken(TokenType::open_curly);
-                break;
+                return make_token(TokenType::open_curly, start);
             case('}'):
-                addToken(TokenType::close_curly);
-                break;
+                return make_token(TokenType::close_curly, start);
             case('/'):
-                if (inspect().has_value() && inspect().value() == '/') {
-                    while (inspect().has_value()) {
-                        if (inspect().value() == '\n') {
-                            consume();
-                            line_count++;
-                            break;
-                        }
-                        consume();
-                    }
+                if (p < end && *p == '/') {
+                    p = scan::find_newline(p, end);
+                    p = p < end ? p + 1 : end;
                 }
-                else if (inspect().has_value() && inspect().value() == '*') {
-                    while (inspect().has_value()) {
-                        if (inspect().value() == '*' && inspect(1).has_value() && inspect(1).value() == '/') {
-                            consume();
-                            consume();
-                            break;
-                        }
-                        char next = consume();
-                        if (next == '\n') {
-                            line_count++;
-                        }
-                    }
+                else if (p < end && *p == '*') {
+                    // The search starts on the opening '*', so "/*/" is a complete comment.
+                    p = scan::find_comment_close(p, end);
+                    p = p < end ? p + 2 : end;
                 }
                 else {
-                    addToken(TokenType::fslash);
+                    return make_token(TokenType::fslash, start);
                 }
                 break;
-            case('\n'):
-                line_count++;
-                break;
             default:
-                if (std::isalpha(static_cast<unsigned char>(c))) {
-                    buffer.push_back(c);
-                    while (inspect().has_value() && std::isalnum(static_cast<unsigned char>(inspect().value()))) {
-                        buffer.push_back(consume());
-                    }
-                    if (auto it = keywords.find(buffer); it != keywords.end()) {
-                        addToken(it->second);
-                        buffer.clear();
+                if (scan::is_alpha(c)) {
+                    m_cursor = scan::skip_ident(p, end);
+                    std::string_view word(start, static_cast<size_t>(m_cursor - start));
+                    if (auto type = keyword(word)) {
+                        return make_token(type.value(), start);
                     }
-                    else {
-                        addToken(TokenType::ident, buffer);
-                        buffer.clear();
+                    SymbolId symbol = m_interner.intern(word);
+                    if (symbol >= payload_limit) {
+                        error_tokenize("Too many distinct identifiers", start);
+                        return {};
                     }
+                    return make_token(TokenType::ident, start, symbol);
                 }
-                else if (std::isdigit(static_cast<unsigned char>(c))) {
-                    buffer.push_back(c);
-                    while (inspect().has_value() && std::isdigit(static_cast<unsigned char>(inspect().value()))) {
-                        buffer.push_back(consume());
+                if (scan::is_digit(c)) {
+                    m_cursor = scan::skip_digits(p, end);
+                    uint32_t payload = encode_int_lit(start, m_cursor);
+                    if (m_failed) {
+                        return {};
                     }
-                    addToken(TokenType::int_lit, buffer);
-                    buffer.clear();
+                    return make_token(TokenType::int_lit, start, payload);
                 }
                 break;
         }
     }
 
-    m_index = 0;
-    return Tokenizer::tokens;
+    m_cursor = end;
+    return {};
 }
 
-std::optional<char> Tokenizer::inspect(int offset) const {
-    if (m_index + offset >= m_src.length()) return {};
-    return m_src.at(m_index + offset);
+int64_t Tokenizer::int_value(const Token& token) const {
+    if (token.payload & wide_literal_flag) {
+        return m_wide_literals[token.payload & ~wide_literal_flag];
+    }
+    return token.payload;
 }
 
-char Tokenizer::consume() {
-    char value = m_src.at(m_index);
-    m_index++;
+std::string_view Tokenizer::text(const Token& token) const {
+    if (token.type == TokenType::ident) {
+        return m_interner.spelling(token.symbol());
+    }
+    const char* start = m_src.data() + token.offset;
+    const char* end = m_src.data() + m_src.size();
+    const char* stop = start + 1;
+    if (scan::is_alpha(*start)) {
+        stop = scan::skip_ident(start, end);
+    }
+    else if (scan::is_digit(*start)) {
+        stop = scan::skip_digits(start, end);
+    }
+    return std::string_view(start, static_cast<size_t>(stop - start));
+}
+
+size_t Tokenizer::end_of(const Token& token) const {
+    return token.offset + text(token).size();
+}
+
+int Tokenizer::line_of(const Token& token) const {
+    return line_at(token.offset);
+}
+
+int Tokenizer::line_at(size_t offset) const {
+    // Only diagnostics ask for line numbers, so the newline index is built the first
+    // time one is needed instead of being tracked while lexing.
+    if (m_line_starts.empty()) {
+        const char* const begin = m_src.data();
+        const char* const end = begin + m_src.size();
+        m_line_starts.push_back(0);
+        for (const char* p = scan::find_newline(begin, end); p < end; p = scan::find_newline(p + 1, end)) {
+            m_line_starts.push_back(static_cast<uint32_t>(p + 1 - begin));
+        }
+    }
+    auto line = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), offset);
+    return static_cast<int>(line - m_line_starts.begin());
+}
+
+void Tokenizer::error_tokenize(const std::string& error_msg, const char* at) {
+    if (m_speculative) {
+        m_failed = true;
+        m_cursor = m_src.data() + m_src.size();
+        return;
+    }
+    size_t offset = static_cast<size_t>(at - m_src.data());
+    std::cerr << "[Tokenize Error] " << error_msg << " at line " << line_at(offset) << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+Interner& Tokenizer::interner() {
+    return m_interner;
+}
+
+const Interner& Tokenizer::interner() const {
+    return m_interner;
+}
+
+TokenStream::TokenStream(Tokenizer& tokenizer)
+    : m_tokenizer(&tokenizer)
+{
+}
+
+TokenStream::TokenStream(std::vector<Token> tokens)
+    : m_owned_tokens(std::move(tokens))
+    , m_tokens(m_owned_tokens)
+{
+}
+
+TokenStream::TokenStream(std::span<const Token> tokens)
+    : m_tokens(tokens)
+{
+}
+
+bool TokenStream::fill() {
+    std::optional<Token> token;
+    if (m_tokenizer != nullptr) {
+        token = m_tokenizer->next();
+    }
+    else if (m_index < m_tokens.size()) {
+        token = m_tokens[m_index++];
+    }
+    if (!token.has_value()) {
+        return false;
+    }
+    m_ring[(m_head + m_count) % lookahead] = token.value();
+    m_count++;
+    return true;
+}
+
+const Token* TokenStream::peek(size_t offset) {
+    // Filling past the ring would overwrite tokens that are still to be consumed.
+    assert(offset < lookahead);
+    while (m_count <= offset) {
+        if (!fill()) {
+            return nullptr;
+        }
+    }
+    return &m_ring[(m_head + offset) % lookahead];
+}
+
+Token TokenStream::consume() {
+    if (m_count == 0) {
+        [[maybe_unused]] bool filled = fill();
+        assert(filled && "consume() past the end of the tokens");
+    }
+    Token value = m_ring[m_head];
+    m_head = (m_head + 1) % lookahead;
+    m_count--;
+    m_position++;
+    m_last = value;
     return value;
 }
+
+const std::optional<Token>& TokenStream::last_consumed() const {
+    return m_last;
+}
+
+size_t TokenStream::position() const {
+    return m_position;
+}
@@ -1,11 +1,17 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
-enum class TokenType {
+#include "interner.hpp"
+
+enum class TokenType : uint8_t {
     _return,
     int_lit,
     semi,
@@ -28,24 +34,103 @@ enum class TokenType {
 
 std::optional<int> bin_prec(TokenType type);
 
+// A token packs its kind and a 24-bit payload into one word, next to its byte offset
+// in the source. The payload is the interned SymbolId of an identifier and the
+// encoded value of an integer literal (see Tokenizer::int_value); other kinds leave
+// it zero. Line numbers are derived from the offset only when a diagnostic needs one.
 struct Token {
-    TokenType type;
-    int line_no;
-    std::optional<std::string> value {};
+    TokenType type : 8;
+    uint32_t payload : 24 = 0;
+    uint32_t offset = 0;
+
+    SymbolId symbol() const {
+        return payload;
+    }
 };
 
+static_assert(sizeof(Token) == 8);
+
+// Lexes a source buffer that must outlive the tokenizer. Besides the tokens, the
+// tokenizer keeps what is needed to interpret them later: the identifier interner,
+// the pool of literals too wide for a token payload, and a newline index built on
+// first use.
 class Tokenizer {
 public:
-    explicit Tokenizer(const std::string& src);
+    explicit Tokenizer(std::string_view src);
     std::vector<Token> tokenize();
-    void addToken(TokenType type, std::optional<std::string> value = {});
+    // Lexes the source in chunks on up to `threads` threads. The result, including symbol
+    // ids and the literal pool, is exactly what tokenize() produces.
+    std::vector<Token> tokenize_parallel(size_t threads);
+    // Lexes and returns the next token, or nothing once the source is exhausted.
+    std::optional<Token> next();
+    // Points the tokenizer at a new version of the source, keeping the interner and the
+    // literal pool so tokens lexed earlier stay meaningful. Lexing restarts at `offset`,
+    // which must not be inside a token or comment.
+    void set_source(std::string_view src, size_t offset = 0);
+
+    int64_t int_value(const Token& token) const;
+    std::string_view text(const Token& token) const;
+    // Offset one past the last byte of the token.
+    size_t end_of(const Token& token) const;
+    int line_of(const Token& token) const;
+    Interner& interner();
+    const Interner& interner() const;
+
+private:
+    struct Chunk;
+
+    Token make_token(TokenType type, const char* start, uint32_t payload = 0) const;
+    uint32_t encode_int_lit(const char* start, const char* end);
+    int line_at(size_t offset) const;
+    void error_tokenize(const std::string& msg, const char* at);
+    static void lex_chunk(Chunk& chunk, size_t start, bool speculative);
+
+    std::string_view m_src;
+    Interner m_interner;
+    std::vector<int64_t> m_wide_literals;
+    mutable std::vector<uint32_t> m_line_starts;
+    const char* m_cursor;
+    // Set while lexing a chunk whose start is only a guess: errors then mean the guess
+    // was wrong rather than that the program is, so they stop the chunk instead of
+    // exiting.
+    bool m_speculative = false;
+    bool m_failed = false;
+};
+
+// Bounded-lookahead view of a token sequence. When backed by a Tokenizer, tokens are
+// lexed only as the parser asks for them and at most `lookahead` are held at once,
+// so no token array proportional to the source is ever built.
+class TokenStream {
+public:
+    static constexpr size_t lookahead = 4;
+
+    explicit TokenStream(Tokenizer& tokenizer);
+    explicit TokenStream(std::vector<Token> tokens);
+    // Replays tokens owned by the caller, which must outlive the stream.
+    explicit TokenStream(std::span<const Token> tokens);
+    // An owning stream's span points into its own vector, which a copy or move would
+    // leave behind.
+    TokenStream(const TokenStream&) = delete;
+    TokenStream& operator=(const TokenStream&) = delete;
+
+    // `offset` must be below `lookahead`. Returns nullptr past the last token.
+    const Token* peek(size_t offset = 0);
+    // There must be a token left, as peek() can tell.
+    Token consume();
+    const std::optional<Token>& last_consumed() const;
+    // Number of tokens consumed so far.
+    size_t position() const;
 
 private:
-    std::optional<char> inspect(int offset = 0) const;
-    char consume();
+    bool fill();
 
-    const std::string m_src;
-    std::vector<Token> tokens;
+    Tokenizer* m_tokenizer = nullptr;
+    std::vector<Token> m_owned_tokens;
+    std::span<const Token> m_tokens;
     size_t m_index = 0;
-    int line_count = 1;
+    size_t m_position = 0;
+    std::array<Token, lookahead> m_ring {};
+    size_t m_head = 0;
+    size_t m_count = 0;
+    std::optional<Token> m_last;
 };
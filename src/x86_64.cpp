@@ -0,0 +1,216 @@
+#include <charconv>
+#include <string_view>
+
+#include "x86_64.hpp"
+
+
+namespace {
+
+constexpr MReg rax = 0;
+constexpr MReg rdx = 2;
+
+class X86Writer {
+public:
+    explicit X86Writer(std::string& out)
+        : m_out(out)
+    {
+    }
+
+    // One instruction with up to two operands, each already formatted by the
+    // helpers below.
+    void inst(std::string_view mnemonic, std::string_view dest = {}, std::string_view src = {}) {
+        m_out += "    ";
+        m_out += mnemonic;
+        if (!dest.empty()) {
+            m_out += ' ';
+            m_out += dest;
+        }
+        if (!src.empty()) {
+            m_out += ", ";
+            m_out += src;
+        }
+        m_out += '\n';
+    }
+
+    static std::string_view reg(MReg reg) {
+        static constexpr std::string_view names[] = {
+            "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+            "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+        };
+        return reg == sp_reg ? "rsp" : names[reg];
+    }
+
+    std::string_view number(int64_t value) {
+        auto [end, ec] = std::to_chars(m_number, m_number + sizeof(m_number), value);
+        return std::string_view(m_number, static_cast<size_t>(end - m_number));
+    }
+
+    std::string_view slot(uint32_t offset) {
+        m_slot = "qword ptr [rsp + ";
+        m_slot += number(offset);
+        m_slot += ']';
+        return m_slot;
+    }
+
+    std::string_view label(LabelId label) {
+        m_label = ".LBB0_";
+        m_label += number(label);
+        return m_label;
+    }
+
+    // Labels of the expansion of one instruction, apart from those of the program.
+    std::string local_label(size_t index, std::string_view name) {
+        std::string label = ".Ldiv";
+        label += number(static_cast<int64_t>(index));
+        label += '_';
+        label += name;
+        return label;
+    }
+
+    void define(std::string_view label) {
+        m_out += label;
+        m_out += ":\n";
+    }
+
+    // mov takes a sign-extended 32-bit immediate, movabs any 64-bit one.
+    void mov_imm(MReg rd, uint64_t value) {
+        const auto signed_value = static_cast<int64_t>(value);
+        const bool fits = signed_value >= INT32_MIN && signed_value <= INT32_MAX;
+        inst(fits ? "mov" : "movabs", reg(rd), number(signed_value));
+    }
+
+private:
+    std::string& m_out;
+    char m_number[24];
+    std::string m_slot;
+    std::string m_label;
+};
+
+} // namespace
+
+std::string print_x86_64_asm(const MachineCode& code) {
+    std::string out;
+    out.reserve(code.insts.size() * 32 + 128);
+    out += ".intel_syntax noprefix\n.text\n.globl main\n.p2align 4\nmain:\n";
+    X86Writer w(out);
+    using W = X86Writer;
+    size_t divisions = 0;
+    for (size_t i = 0; i < code.insts.size(); i++) {
+        const MInst& inst = code.insts[i];
+        switch (inst.op) {
+            case MOp::movz: {
+                uint64_t value = uint64_t(inst.imm) << inst.rn;
+                while (i + 1 < code.insts.size() && code.insts[i + 1].op == MOp::movk && code.insts[i + 1].rd == inst.rd) {
+                    const MInst& movk = code.insts[++i];
+                    value = (value & ~(uint64_t(0xffff) << movk.rn)) | uint64_t(movk.imm) << movk.rn;
+                }
+                w.mov_imm(inst.rd, value);
+                break;
+            }
+            case MOp::movk:
+                // Only reached when no movz of the same register comes right before.
+                w.mov_imm(rdx, ~(uint64_t(0xffff) << inst.rn));
+                w.inst("and", W::reg(inst.rd), W::reg(rdx));
+                w.mov_imm(rdx, uint64_t(inst.imm) << inst.rn);
+                w.inst("or", W::reg(inst.rd), W::reg(rdx));
+                break;
+            case MOp::mov:
+                w.inst("mov", W::reg(inst.rd), W::reg(inst.rn));
+                break;
+            case MOp::add:
+            case MOp::mul: {
+                // Both commute, so whichever operand is already in rd stays there.
+                const std::string_view mnemonic = inst.op == MOp::add ? "add" : "imul";
+                if (inst.rd == inst.rn || inst.rd == inst.rm) {
+                    w.inst(mnemonic, W::reg(inst.rd), W::reg(inst.rd == inst.rn ? inst.rm : inst.rn));
+                }
+                else {
+                    w.inst("mov", W::reg(inst.rd), W::reg(inst.rn));
+                    w.inst(mnemonic, W::reg(inst.rd), W::reg(inst.rm));
+                }
+                break;
+            }
+            case MOp::sub:
+                if (inst.rd == inst.rm && inst.rd != inst.rn) {
+                    w.inst("neg", W::reg(inst.rd));
+                    w.inst("add", W::reg(inst.rd), W::reg(inst.rn));
+                    break;
+                }
+                if (inst.rd != inst.rn) {
+                    w.inst("mov", W::reg(inst.rd), W::reg(inst.rn));
+                }
+                w.inst("sub", W::reg(inst.rd), W::reg(inst.rm));
+                break;
+            case MOp::sdiv: {
+                const std::string_view divisor = W::reg(inst.rm);
+                const std::string by_minus_one = w.local_label(divisions, "neg");
+                const std::string by_zero = w.local_label(divisions, "zero");
+                const std::string done = w.local_label(divisions, "done");
+                divisions++;
+                if (inst.rn != rax) {
+                    w.inst("mov", W::reg(rax), W::reg(inst.rn));
+                }
+                w.inst("cmp", divisor, "-1");
+                w.inst("je", by_minus_one);
+                w.inst("test", divisor, divisor);
+                w.inst("je", by_zero);
+                w.inst("cqo");
+                w.inst("idiv", divisor);
+                w.inst("jmp", done);
+                w.define(by_minus_one);
+                w.inst("neg", W::reg(rax));
+                w.inst("jmp", done);
+                w.define(by_zero);
+                w.inst("xor", "eax", "eax");
+                w.define(done);
+                if (inst.rd != rax) {
+                    w.inst("mov", W::reg(inst.rd), W::reg(rax));
+                }
+                break;
+            }
+            case MOp::add_imm:
+            case MOp::sub_imm:
+                if (inst.rd == inst.rn) {
+                    w.inst(inst.op == MOp::add_imm ? "add" : "sub", W::reg(inst.rd), w.number(inst.imm));
+                }
+                else {
+                    std::string address = "[";
+                    address += W::reg(inst.rn);
+                    address += inst.op == MOp::add_imm ? " + " : " - ";
+                    address += w.number(inst.imm);
+                    address += ']';
+                    w.inst("lea", W::reg(inst.rd), address);
+                }
+                break;
+            case MOp::ldr:
+                w.inst("mov", W::reg(inst.rd), w.slot(inst.imm));
+                break;
+            case MOp::str:
+                w.inst("mov", w.slot(inst.imm), W::reg(inst.rd));
+                break;
+            case MOp::cbz:
+            case MOp::cbnz:
+                w.inst("test", W::reg(inst.rd), W::reg(inst.rd));
+                w.inst(inst.op == MOp::cbz ? "je" : "jne", w.label(inst.imm));
+                break;
+            case MOp::b:
+                w.inst("jmp", w.label(inst.imm));
+                break;
+            case MOp::bl_exit:
+                // exit never returns, so the stack is realigned for the call without
+                // being restored.
+                w.inst("mov", "rdi", W::reg(rax));
+                w.inst("and", "rsp", "-16");
+                w.inst("call", "exit@PLT");
+                break;
+            case MOp::ret:
+                w.inst("ret");
+                break;
+            case MOp::label:
+                w.define(w.label(inst.imm));
+                break;
+        }
+    }
+    out += ".section .note.GNU-stack,\"\",@progbits\n";
+    return out;
+}
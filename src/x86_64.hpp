@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+#include "machine.hpp"
+
+
+// x86-64 System V assembly for the GNU assembler in Intel syntax, defining `main`
+// and calling the C library's `exit`. `code` must use the registers of
+// target_regs(Target::x86_64), which leave rax and rdx free for this expansion:
+// three-operand ops become two-operand ones, sdiv goes through rax and rdx with the
+// same results as ARM64 for x / 0 and INT64_MIN / -1 where idiv would trap, and
+// movz / movk sequences become a single mov.
+std::string print_x86_64_asm(const MachineCode& code);
@@ -0,0 +1,103 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <new>
+
+#include "../src/arena.hpp"
+
+
+struct ArenaTestNode {
+    int64_t value;
+    ArenaTestNode* next;
+};
+
+TEST_CASE("Arena grows past its initial block") {
+    ArenaAllocator arena(256);
+    ArenaTestNode* head = nullptr;
+    for (int i = 0; i < 10000; i++) {
+        auto node = arena.alloc<ArenaTestNode>();
+        REQUIRE(node != nullptr);
+        REQUIRE(reinterpret_cast<uintptr_t>(node) % alignof(ArenaTestNode) == 0);
+        node->value = i;
+        node->next = head;
+        head = node;
+    }
+    REQUIRE(arena.block_count() > 1);
+    REQUIRE(arena.bytes_used() >= 10000 * sizeof(ArenaTestNode));
+    REQUIRE(arena.bytes_reserved() >= arena.bytes_used());
+    int64_t expected = 9999;
+    for (auto node = head; node != nullptr; node = node->next) {
+        REQUIRE(node->value == expected--);
+    }
+}
+
+TEST_CASE("Arena rewinds to a mark") {
+    ArenaAllocator arena(256);
+    arena.alloc<ArenaTestNode>();
+    ArenaAllocator::Mark mark = arena.mark();
+    size_t used = arena.bytes_used();
+    auto scratch = arena.alloc<ArenaTestNode>();
+    for (int i = 0; i < 1000; i++) {
+        arena.alloc<ArenaTestNode>();
+    }
+    size_t blocks = arena.block_count();
+    arena.rewind(mark);
+    REQUIRE(arena.bytes_used() == used);
+    REQUIRE(arena.alloc<ArenaTestNode>() == scratch);
+    // Blocks freed up by the rewind are reused rather than allocated again.
+    for (int i = 0; i < 1000; i++) {
+        arena.alloc<ArenaTestNode>();
+    }
+    REQUIRE(arena.block_count() == blocks);
+}
+
+TEST_CASE("Arena reset keeps its blocks") {
+    ArenaAllocator arena(256);
+    auto first = arena.alloc<ArenaTestNode>();
+    for (int i = 0; i < 5000; i++) {
+        arena.alloc<ArenaTestNode>();
+    }
+    size_t blocks = arena.block_count();
+    size_t reserved = arena.bytes_reserved();
+    arena.reset();
+    REQUIRE(arena.bytes_used() == 0);
+    REQUIRE(arena.alloc<ArenaTestNode>() == first);
+    for (int i = 0; i < 5000; i++) {
+        arena.alloc<ArenaTestNode>();
+    }
+    REQUIRE(arena.block_count() == blocks);
+    REQUIRE(arena.bytes_reserved() == reserved);
+}
+
+TEST_CASE("Arena serves allocations larger than a block") {
+    struct Big {
+        std::byte bytes[4096];
+    };
+    ArenaAllocator arena(256);
+    auto big = arena.alloc<Big>();
+    REQUIRE(big != nullptr);
+    big->bytes[4095] = std::byte{1};
+    REQUIRE(arena.bytes_reserved() >= 4096 + 256);
+}
+
+TEST_CASE("Arena allocates contiguous arrays") {
+    ArenaAllocator arena(256);
+    arena.alloc<char>();
+    std::span<ArenaTestNode*> items = arena.alloc_array<ArenaTestNode*>(100);
+    REQUIRE(items.size() == 100);
+    REQUIRE(reinterpret_cast<uintptr_t>(items.data()) % alignof(ArenaTestNode*) == 0);
+    for (ArenaTestNode* item : items) {
+        REQUIRE(item == nullptr);
+    }
+    REQUIRE(arena.alloc_array<ArenaTestNode*>(0).empty());
+}
+
+TEST_CASE("Arena refuses arrays whose size overflows") {
+    ArenaAllocator arena(256);
+    constexpr size_t max = std::numeric_limits<size_t>::max();
+    REQUIRE_THROWS_AS(arena.alloc_array<ArenaTestNode>(max / sizeof(ArenaTestNode) + 1), std::bad_alloc);
+    REQUIRE_THROWS_AS(arena.alloc_array<ArenaTestNode*>(max / sizeof(ArenaTestNode*)), std::bad_alloc);
+    REQUIRE(arena.block_count() == 1);
+    REQUIRE(arena.alloc_array<ArenaTestNode*>(4).size() == 4);
+}
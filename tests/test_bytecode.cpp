@@ -0,0 +1,56 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/bytecode.hpp"
+
+
+int64_t run_source(const std::string& src) {
+    return run_bytecode(compile_bytecode(resolve_flat(src)));
+}
+
+TEST_CASE("Bytecode reads variables and constants in place") {
+    Bytecode bytecode = compile_bytecode(resolve_flat("let a = 7; let b = a * (a - 2) + 7; if (b) { a = b; } exit(a);"));
+    // a and b in r0 and r1, one temporary in r2, and the constants 7, 2 and 0.
+    REQUIRE(dump_bytecode(bytecode) ==
+        "0: mov r0, r3\n"
+        "1: sub r2, r0, r4\n"
+        "2: mul r2, r0, r2\n"
+        "3: add r1, r2, r3\n"
+        "4: jz r1, 6\n"
+        "5: mov r0, r1\n"
+        "6: halt r0\n"
+        "7: halt r5\n");
+    REQUIRE(bytecode.registers == std::vector<int64_t>{0, 0, 0, 7, 2, 0});
+    REQUIRE(run_bytecode(bytecode) == 42);
+}
+
+TEST_CASE("Bytecode keeps the generated code's arithmetic") {
+    REQUIRE(run_source("let a = 5; exit(a / 0);") == 0);
+    REQUIRE(run_source("let a = 0 - 9223372036854775807 - 1; exit(a / (0 - 1));") == INT64_MIN);
+    REQUIRE(run_source("let a = 9223372036854775807; exit(a + 1);") == INT64_MIN);
+    REQUIRE(run_source("let a = 0 - 7; exit(a / 2);") == -3);
+}
+
+TEST_CASE("Bytecode takes one branch of an if chain") {
+    const std::string chain = "if (a - 1) { b = 10; } elif (b) { b = 20; } else { b = 30; } exit(b);";
+    REQUIRE(run_source("let a = 2; let b = 0; " + chain) == 10);
+    REQUIRE(run_source("let a = 1; let b = 5; " + chain) == 20);
+    REQUIRE(run_source("let a = 1; let b = 0; " + chain) == 30);
+    REQUIRE(run_source("let a = 0; let b = 0; if (a) { b = 10; } elif (a) { b = 20; } exit(b);") == 0);
+    REQUIRE(run_source("let a = 0; { let c = 4; return c; } exit(a);") == 4);
+    REQUIRE(run_source("let a = 3;") == 0);
+}
+
+TEST_CASE("Bytecode for a million-deep elif chain and operator nesting") {
+    constexpr int depth = 1000000;
+    std::string src = "let a = 0; if (a) { exit(1); }";
+    src.reserve(depth * 28);
+    for (int i = 0; i < depth; i++) {
+        src += " elif (a) { exit(1); }";
+    }
+    src += " else { " + std::string(depth, '{') + "exit(a";
+    for (int i = 0; i < depth; i++) {
+        src += " - (1";
+    }
+    src += std::string(depth, ')') + ");" + std::string(depth, '}') + " }";
+    REQUIRE(run_source(src) == 0);
+}
@@ -0,0 +1,120 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/elf.hpp"
+#include "../src/encoder.hpp"
+#include "../src/machine.hpp"
+
+
+ObjectCode encode_source(std::string_view assembly) {
+    std::vector<std::string> diagnostics;
+    ObjectCode object = encode_arm64(parse_asm(assembly), diagnostics);
+    REQUIRE(diagnostics.empty());
+    return object;
+}
+
+// Expected bytes are from llvm-mc -triple=aarch64 -show-encoding.
+TEST_CASE("ARM64 instructions encode to known bytes") {
+    ObjectCode object = encode_source(
+        "    movz x0, #0x0010\n"
+        "    movk x3, #0x0001, lsl #32\n"
+        "    movz x5, #0xffff, lsl #48\n"
+        "    mov x4, x3\n"
+        "    add x0, x1, x2\n"
+        "    sub x28, x19, x17\n"
+        "    mul x3, x1, x2\n"
+        "    sdiv x4, x3, x17\n"
+        "    add sp, sp, #4080\n"
+        "    sub sp, sp, #16\n"
+        "    ldr x1, [sp, #8]\n"
+        "    str x3, [sp, #0]\n"
+        "    ldr x28, [sp, #32760]\n"
+        "    ret\n");
+    REQUIRE(object.text == std::vector<uint8_t>{
+        0x00, 0x02, 0x80, 0xd2,
+        0x23, 0x00, 0xc0, 0xf2,
+        0xe5, 0xff, 0xff, 0xd2,
+        0xe4, 0x03, 0x03, 0xaa,
+        0x20, 0x00, 0x02, 0x8b,
+        0x7c, 0x02, 0x11, 0xcb,
+        0x23, 0x7c, 0x02, 0x9b,
+        0x64, 0x0c, 0xd1, 0x9a,
+        0xff, 0xc3, 0x3f, 0x91,
+        0xff, 0x43, 0x00, 0xd1,
+        0xe1, 0x07, 0x40, 0xf9,
+        0xe3, 0x03, 0x00, 0xf9,
+        0xfc, 0xff, 0x7f, 0xf9,
+        0xc0, 0x03, 0x5f, 0xd6,
+    });
+    REQUIRE(object.relocations.empty());
+}
+
+TEST_CASE("ARM64 branches are resolved in both directions") {
+    ObjectCode object = encode_source(
+        "LBB0_1:\n"
+        "    movz x0, #0x0007\n"
+        "    cbz x1, LBB0_1\n"
+        "    cbnz x2, LBB0_2\n"
+        "    b LBB0_2\n"
+        "LBB0_2:\n"
+        "    bl _exit\n"
+        "    b LBB0_1\n");
+    REQUIRE(object.text == std::vector<uint8_t>{
+        0xe0, 0x00, 0x80, 0xd2,
+        0xe1, 0xff, 0xff, 0xb4,
+        0x42, 0x00, 0x00, 0xb5,
+        0x01, 0x00, 0x00, 0x14,
+        0x00, 0x00, 0x00, 0x94,
+        0xfb, 0xff, 0xff, 0x17,
+    });
+    REQUIRE(object.externs == std::vector<std::string>{"exit"});
+    REQUIRE(object.relocations.size() == 1);
+    REQUIRE(object.relocations[0].offset == 16);
+    REQUIRE(object.relocations[0].type == r_aarch64_call26);
+}
+
+TEST_CASE("ARM64 encoding reports what does not fit") {
+    MachineCode code;
+    code.emit(MOp::ldr, 1, 0, 0, 32768);
+    code.emit(MOp::str, 1, 0, 0, 12);
+    code.emit(MOp::add_imm, sp_reg, sp_reg, 0, 4096);
+    code.emit(MOp::b, 0, 0, 0, 7);
+    std::vector<std::string> diagnostics;
+    encode_arm64(code, diagnostics);
+    REQUIRE(diagnostics == std::vector<std::string>{
+        "stack offset 32768 does not fit its field",
+        "stack offset 12 does not fit its field",
+        "add/sub immediate 4096 does not fit its field",
+        "LBB0_7 is never defined",
+    });
+}
+
+TEST_CASE("ELF objects hold the code, main and the relocations") {
+    ObjectCode object = encode_source("    movz x0, #0x0007\n    bl _exit\n");
+    std::vector<uint8_t> elf = write_elf_object(object, elf_machine_aarch64);
+    auto read = [&](size_t offset, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++) {
+            value |= uint64_t(elf[offset + i]) << (8 * i);
+        }
+        return value;
+    };
+    REQUIRE(std::string(elf.begin(), elf.begin() + 4) == "\x7f" "ELF");
+    REQUIRE(read(16, 2) == 1);
+    REQUIRE(read(18, 2) == elf_machine_aarch64);
+    const uint64_t shoff = read(40, 8);
+    REQUIRE(read(60, 2) == 6);
+    REQUIRE(shoff + 6 * 64 == elf.size());
+
+    // Section 1 is .text and starts right after the header.
+    const size_t text_header = shoff + 64;
+    REQUIRE(read(text_header + 24, 8) == 64);
+    REQUIRE(read(text_header + 32, 8) == 8);
+    REQUIRE(std::vector<uint8_t>(elf.begin() + 64, elf.begin() + 72) == object.text);
+
+    // Section 2 is .rela.text, with one CALL26 at offset 4 against symbol 2, exit.
+    const size_t rela_header = shoff + 2 * 64;
+    const uint64_t rela = read(rela_header + 24, 8);
+    REQUIRE(read(rela_header + 32, 8) == 24);
+    REQUIRE(read(rela, 8) == 4);
+    REQUIRE(read(rela + 8, 8) == (uint64_t(2) << 32 | r_aarch64_call26));
+}
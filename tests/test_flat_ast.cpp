@@ -0,0 +1,103 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/flat_ast.hpp"
+#include "../src/parsing.hpp"
+
+
+FlatAst flatten_source(const std::string& src) {
+    Tokenizer tokenizer(src);
+    Parser parser(tokenizer);
+    return flatten(parser.parse_program().value());
+}
+
+TEST_CASE("Flatten binary expression in post-order") {
+    FlatAst ast = flatten_source("return 1 + 2 * 3;");
+    REQUIRE(ast.size() == 7);
+    REQUIRE(ast.kinds[0] == NodeKind::int_lit);
+    REQUIRE(ast.int_value(0) == 1);
+    REQUIRE(ast.kinds[3] == NodeKind::mul);
+    REQUIRE(ast.lhs[3] == 1);
+    REQUIRE(ast.rhs[3] == 2);
+    REQUIRE(ast.int_value(2) == 3);
+    REQUIRE(ast.kinds[4] == NodeKind::add);
+    REQUIRE(ast.lhs[4] == 0);
+    REQUIRE(ast.rhs[4] == 3);
+    REQUIRE(ast.kinds[5] == NodeKind::stmt_return);
+    REQUIRE(ast.lhs[5] == 4);
+    REQUIRE(ast.root == 6);
+    REQUIRE(ast.kinds[ast.root] == NodeKind::scope);
+    REQUIRE(ast.stmts(ast.root).size() == 1);
+    REQUIRE(ast.stmts(ast.root)[0] == 5);
+}
+
+TEST_CASE("Flatten keeps full 64-bit literals") {
+    FlatAst ast = flatten_source("exit(9223372036854775807);");
+    REQUIRE(ast.int_value(0) == 9223372036854775807);
+}
+
+TEST_CASE("Flatten drops parentheses") {
+    FlatAst ast = flatten_source("exit((((7))));");
+    REQUIRE(ast.size() == 3);
+    REQUIRE(ast.kinds[0] == NodeKind::int_lit);
+    REQUIRE(ast.int_value(0) == 7);
+    REQUIRE(ast.kinds[1] == NodeKind::stmt_exit);
+}
+
+TEST_CASE("Flatten statements with identifiers") {
+    FlatAst ast = flatten_source("let x = 5; x = x - 1;");
+    auto stmts = ast.stmts(ast.root);
+    REQUIRE(stmts.size() == 2);
+    REQUIRE(ast.kinds[stmts[0]] == NodeKind::stmt_let);
+    REQUIRE(ast.kinds[stmts[1]] == NodeKind::stmt_assign);
+    REQUIRE(ast.payloads[stmts[0]] == ast.payloads[stmts[1]]);
+    NodeIndex sub = ast.lhs[stmts[1]];
+    REQUIRE(ast.kinds[sub] == NodeKind::sub);
+    REQUIRE(ast.kinds[ast.lhs[sub]] == NodeKind::ident);
+    REQUIRE(ast.payloads[ast.lhs[sub]] == ast.payloads[stmts[0]]);
+}
+
+TEST_CASE("Flatten if chains with children before parents") {
+    FlatAst ast = flatten_source("if (1) { let a = 1; } elif (2) { { let b = 2; } } else { exit(3); }");
+    auto stmts = ast.stmts(ast.root);
+    REQUIRE(stmts.size() == 1);
+    NodeIndex node_if = stmts[0];
+    REQUIRE(ast.kinds[node_if] == NodeKind::stmt_if);
+    NodeIndex node_elif = ast.payloads[node_if];
+    REQUIRE(ast.kinds[node_elif] == NodeKind::stmt_if);
+    REQUIRE(ast.int_value(ast.lhs[node_elif]) == 2);
+    NodeIndex node_else = ast.payloads[node_elif];
+    REQUIRE(ast.kinds[node_else] == NodeKind::pred_else);
+    REQUIRE(ast.kinds[ast.stmts(ast.lhs[node_else])[0]] == NodeKind::stmt_exit);
+    for (NodeIndex node = 0; node < ast.size(); node++) {
+        switch (ast.kinds[node]) {
+            case NodeKind::scope:
+                for (NodeIndex child : ast.stmts(node)) {
+                    REQUIRE(child < node);
+                }
+                break;
+            case NodeKind::stmt_if:
+                REQUIRE(ast.lhs[node] < node);
+                REQUIRE(ast.rhs[node] < node);
+                REQUIRE((ast.payloads[node] == no_node || ast.payloads[node] < node));
+                break;
+            case NodeKind::int_lit:
+            case NodeKind::ident:
+                break;
+            default:
+                REQUIRE(ast.lhs[node] < node);
+                break;
+        }
+    }
+}
+
+TEST_CASE("Flat AST is several times smaller than the pointer AST") {
+    std::string src = "let x = 1;\n";
+    for (int i = 0; i < 2000; i++) {
+        src += "x = (x + " + std::to_string(i) + ") * 3 - x / (2 + x);\n";
+    }
+    Tokenizer tokenizer(src);
+    ArenaAllocator arena;
+    Parser parser(tokenizer, &arena);
+    FlatAst ast = flatten(parser.parse_program().value());
+    REQUIRE(ast.memory_bytes() * 3 < arena.bytes_used());
+}
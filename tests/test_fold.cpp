@@ -0,0 +1,61 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <climits>
+
+#include "../src/flat_ast.hpp"
+#include "../src/fold.hpp"
+#include "../src/generator.hpp"
+#include "../src/parsing.hpp"
+#include "../src/resolve.hpp"
+
+
+// Folds the program and returns the expression of its last statement.
+NodeIndex fold_last_expr(FlatAst& ast) {
+    fold_constants(ast);
+    return ast.lhs[ast.stmts(ast.root).back()];
+}
+
+TEST_CASE("Fold nested constant expression into one literal") {
+    FlatAst ast = flatten_source("exit((1 + 2) * (10 - 4) / 3);");
+    REQUIRE(fold_constants(ast) == 4);
+    NodeIndex expr = ast.lhs[ast.stmts(ast.root)[0]];
+    REQUIRE(ast.kinds[expr] == NodeKind::int_lit);
+    REQUIRE(ast.int_value(expr) == 6);
+}
+
+TEST_CASE("Fold constant operands around a variable") {
+    FlatAst ast = flatten_source("let x = 1; exit(x + 2 * 3);");
+    NodeIndex expr = fold_last_expr(ast);
+    REQUIRE(ast.kinds[expr] == NodeKind::add);
+    REQUIRE(ast.kinds[ast.lhs[expr]] == NodeKind::ident);
+    REQUIRE(ast.kinds[ast.rhs[expr]] == NodeKind::int_lit);
+    REQUIRE(ast.int_value(ast.rhs[expr]) == 6);
+}
+
+TEST_CASE("Fold with defined overflow and division semantics") {
+    REQUIRE(fold_add(INT64_MAX, 1) == INT64_MIN);
+    REQUIRE(fold_sub(INT64_MIN, 1) == INT64_MAX);
+    REQUIRE(fold_mul(INT64_MAX, 2) == -2);
+    REQUIRE(fold_div(7, 0) == 0);
+    REQUIRE(fold_div(INT64_MIN, -1) == INT64_MIN);
+    REQUIRE(fold_div(-7, 2) == -3);
+
+    FlatAst ast = flatten_source("exit(9223372036854775807 + 1);");
+    REQUIRE(ast.int_value(fold_last_expr(ast)) == INT64_MIN);
+    ast = flatten_source("exit(5 / (3 - 3));");
+    REQUIRE(ast.int_value(fold_last_expr(ast)) == 0);
+}
+
+TEST_CASE("Generate folded expression as a single immediate") {
+    std::string src = "let x = 2; exit(x * (4 - 1) + 100 / 5 / 2);";
+    Tokenizer tokenizer(src);
+    Parser parser(tokenizer);
+    FlatAst ast = flatten(parser.parse_program().value());
+    REQUIRE(resolve_names(ast, tokenizer.interner()).empty());
+    fold_constants(ast);
+    std::string asm_out = print_asm(Generator(std::move(ast)).gen_program());
+    REQUIRE(asm_out.find("#0x0003") != std::string::npos);
+    REQUIRE(asm_out.find("#0x000a") != std::string::npos);
+    REQUIRE(asm_out.find("sdiv") == std::string::npos);
+    REQUIRE(asm_out.find("    sub x") == std::string::npos);
+}
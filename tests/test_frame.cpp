@@ -0,0 +1,146 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../src/flat_ast.hpp"
+#include "../src/frame.hpp"
+#include "../src/generator.hpp"
+#include "../src/parsing.hpp"
+#include "../src/resolve.hpp"
+#include "../src/target.hpp"
+#include "../src/x86_64.hpp"
+
+
+FlatAst resolve_flat(const std::string& src) {
+    Tokenizer tokenizer(src);
+    Parser parser(tokenizer);
+    FlatAst ast = flatten(parser.parse_program().value());
+    REQUIRE(resolve_names(ast, tokenizer.interner()).empty());
+    return ast;
+}
+
+std::vector<NodeIndex> lets_of(const FlatAst& ast) {
+    std::vector<NodeIndex> lets;
+    for (NodeIndex node = 0; node < ast.size(); node++) {
+        if (ast.kinds[node] == NodeKind::stmt_let) {
+            lets.push_back(node);
+        }
+    }
+    return lets;
+}
+
+// Assembles and links x86-64 `assembly` with the system C compiler and runs it,
+// giving its exit status, or nothing on other hosts or without a compiler.
+std::optional<int> native_exit_status(const std::string& assembly) {
+#if defined(__x86_64__) && defined(__linux__)
+    static const bool have_cc = std::system("cc --version > /dev/null 2>&1") == 0;
+    if (!have_cc) {
+        return std::nullopt;
+    }
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::string stem = (dir / ("seabsy_native_" + std::to_string(::getpid()))).string();
+    std::ofstream(stem + ".s") << assembly;
+    if (std::system(("cc -x assembler " + stem + ".s -o " + stem + " 2> /dev/null").c_str()) != 0) {
+        return -1;
+    }
+    const int status = std::system(stem.c_str());
+    std::filesystem::remove(stem + ".s");
+    std::filesystem::remove(stem);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#else
+    (void)assembly;
+    return std::nullopt;
+#endif
+}
+
+TEST_CASE("Frame layout shares slots between sibling scopes") {
+    FlatAst ast = resolve_flat("let a = 1; { let b = a; exit(b); } { let c = a; exit(c); } exit(a);");
+    FrameLayout layout = layout_frame(ast, {});
+    std::vector<NodeIndex> lets = lets_of(ast);
+    REQUIRE(layout.slots == 2);
+    REQUIRE(layout.location(lets[0]).spilled);
+    REQUIRE(layout.location(lets[1]).index == layout.location(lets[2]).index);
+    REQUIRE(layout.location(lets[0]).index != layout.location(lets[1]).index);
+}
+
+TEST_CASE("Frame layout shares slots between variables that are dead") {
+    FlatAst ast = resolve_flat("let a = 1; let b = a + 1; let c = b * 2; a = 5; exit(c);");
+    FrameLayout layout = layout_frame(ast, {});
+    std::vector<NodeIndex> lets = lets_of(ast);
+    // a is assigned after b's last use, so only b and c can share.
+    REQUIRE(layout.slots == 2);
+    REQUIRE(layout.location(lets[1]).index == layout.location(lets[2]).index);
+    REQUIRE(layout.location(lets[0]).index != layout.location(lets[2]).index);
+}
+
+TEST_CASE("Frame layout keeps variables live across branches apart") {
+    FlatAst ast = resolve_flat("let a = 1; if (a) { let b = 2; exit(b); } else { let c = 3; exit(c); } exit(a);");
+    FrameLayout layout = layout_frame(ast, {});
+    std::vector<NodeIndex> lets = lets_of(ast);
+    REQUIRE(layout.slots == 2);
+    REQUIRE(layout.location(lets[1]).index == layout.location(lets[2]).index);
+}
+
+TEST_CASE("Frame layout prefers registers and spills the longest lived") {
+    FlatAst ast = resolve_flat("let a = 1; let b = 2; let c = 3; exit(c + b); exit(a);");
+    const PhysReg regs[] = {19, 20};
+    FrameLayout layout = layout_frame(ast, regs);
+    std::vector<NodeIndex> lets = lets_of(ast);
+    REQUIRE(layout.location(lets[0]).spilled);
+    REQUIRE(!layout.location(lets[1]).spilled);
+    REQUIRE(!layout.location(lets[2]).spilled);
+    REQUIRE(layout.slots == 1);
+    REQUIRE(layout.used_regs == std::vector<PhysReg>{19, 20});
+}
+
+TEST_CASE("Generate one prologue and one epilogue") {
+    std::string asm_out = generate_source("let a = 1; { let b = 2; a = a + b; } if (a) { return a; } elif (a - 1) { return 2; } return 3;", false);
+    REQUIRE(count_occurrences(asm_out, "sub sp") == 1);
+    REQUIRE(count_occurrences(asm_out, "add sp") == 1);
+    REQUIRE(count_occurrences(asm_out, "ret") == 1);
+    REQUIRE(asm_out.find("sub sp, sp, #16") != std::string::npos);
+}
+
+TEST_CASE("Generate no frame for programs in registers that never return") {
+    std::string asm_out = generate_source("let a = 1; { let b = 2; a = a + b; } exit(a);");
+    REQUIRE(asm_out.find("sp") == std::string::npos);
+}
+
+TEST_CASE("Variables whose lifetimes cross keep their values under spill pressure") {
+    const std::string src = "let v0 = 0; let v1 = v0 + 1; let v2 = v1 + 2; let v3 = v2 + 3; let v4 = v2 + 4; "
+        "let v5 = v3 + 5; let v6 = v1 + 6; let v7 = v6 + 7; let v8 = v5 + 8; let v9 = v0 + 9; let v10 = v3 + 10; "
+        "let v11 = v1 + 11; let v12 = v5 + 12; let v13 = v4 + 13; let v14 = v2 + 14; let v15 = v8 + 15; "
+        "let v16 = v6 + 16; let w6 = (((((((v9 + v13) + v14) + v9) + v12) + v8) + v12) + v11); "
+        "let w8 = ((w6 + v10) + v12); exit(((w8 + v16) + v6));";
+    FlatAst ast = resolve_flat(src);
+    FrameLayout layout = layout_frame(ast, target_regs(Target::x86_64).variables);
+    std::vector<NodeIndex> lets = lets_of(ast);
+    std::vector<NodeIndex> last_use(ast.size(), 0);
+    for (NodeIndex node = 0; node < ast.size(); node++) {
+        if (ast.kinds[node] == NodeKind::ident) {
+            last_use[ast.rhs[node]] = node;
+        }
+    }
+    REQUIRE(layout.slots > 1);
+    for (size_t a = 0; a < lets.size(); a++) {
+        for (size_t b = a + 1; b < lets.size(); b++) {
+            const Location& la = layout.location(lets[a]);
+            const Location& lb = layout.location(lets[b]);
+            if (lets[b] < last_use[lets[a]]) {
+                REQUIRE((la.spilled != lb.spilled || la.index != lb.index));
+            }
+        }
+    }
+
+    std::optional<int> status = native_exit_status(print_x86_64_asm(Generator(std::move(ast), true, Target::x86_64).gen_program()));
+    if (status.has_value()) {
+        REQUIRE(status.value() == 201);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+#include <sstream>
+
+#include "../src/flat_ast.hpp"
+#include "../src/incremental.hpp"
+
+
+// Renders the program with identifier spellings instead of ids, so trees built by
+// different interners compare equal when they describe the same program.
+std::string describe_program(const NodeProgram& prog, const Interner& interner) {
+    FlatAst ast = flatten(prog);
+    std::stringstream out;
+    for (NodeIndex i = 0; i < ast.size(); i++) {
+        out << static_cast<int>(ast.kinds[i]) << ' ';
+        switch (ast.kinds[i]) {
+            case NodeKind::int_lit:
+                out << ast.int_value(i);
+                break;
+            case NodeKind::ident:
+                out << interner.spelling(ast.payloads[i]);
+                break;
+            case NodeKind::stmt_let:
+            case NodeKind::stmt_assign:
+                out << ast.lhs[i] << ' ' << interner.spelling(ast.payloads[i]);
+                break;
+            case NodeKind::scope:
+                for (NodeIndex stmt : ast.stmts(i)) {
+                    out << stmt << ' ';
+                }
+                break;
+            default:
+                out << ast.lhs[i] << ' ' << ast.rhs[i] << ' ' << ast.payloads[i];
+                break;
+        }
+        out << '\n';
+    }
+    return out.str();
+}
+
+std::string describe_source(const std::string& src) {
+    Tokenizer tokenizer(src);
+    Parser parser(tokenizer);
+    return describe_program(parser.parse_program().value(), tokenizer.interner());
+}
+
+void require_matches_fresh_parse(const IncrementalParser& doc) {
+    std::string src(doc.source());
+    REQUIRE(describe_program(doc.program(), doc.tokenizer().interner()) == describe_source(src));
+    Tokenizer tokenizer(src);
+    std::vector<Token> expected = tokenizer.tokenize();
+    REQUIRE(doc.tokens().size() == expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        REQUIRE(doc.tokens()[i].type == expected[i].type);
+        REQUIRE(doc.tokens()[i].offset == expected[i].offset);
+    }
+}
+
+NodeScope* nth_scope_stmt(const NodeProgram& prog, size_t index) {
+    return std::get<NodeScope*>(prog.stmts[index]->variant);
+}
+
+TEST_CASE("Incremental edit reparses only the enclosing scope") {
+    IncrementalParser doc("let a = 1; { let b = 2; } { let c = 3; exit(c); } exit(a);");
+    NodeScope* first = nth_scope_stmt(doc.program(), 1);
+    NodeScope* second = nth_scope_stmt(doc.program(), 2);
+    NodeStmt* first_stmt = first->stmts[0];
+
+    size_t at = doc.source().find("3");
+    doc.apply(TextEdit{.offset = at, .removed = 1, .inserted = "42"});
+
+    REQUIRE(doc.source() == "let a = 1; { let b = 2; } { let c = 42; exit(c); } exit(a);");
+    REQUIRE(doc.relexed_tokens() == 1);
+    REQUIRE(doc.reparsed_tokens() == 12);
+    REQUIRE(nth_scope_stmt(doc.program(), 1) == first);
+    REQUIRE(first->stmts[0] == first_stmt);
+    REQUIRE(nth_scope_stmt(doc.program(), 2) == second);
+    require_matches_fresh_parse(doc);
+}
+
+TEST_CASE("Incremental edit extends an adjacent identifier") {
+    IncrementalParser doc("exit(0); { let ab = 1; exit(ab); }");
+    doc.apply(TextEdit{.offset = 17, .removed = 0, .inserted = "c"});
+    doc.apply(TextEdit{.offset = 31, .removed = 0, .inserted = "c"});
+    REQUIRE(doc.source() == "exit(0); { let abc = 1; exit(abc); }");
+    REQUIRE(doc.reparsed_tokens() < doc.tokens().size());
+    require_matches_fresh_parse(doc);
+}
+
+TEST_CASE("Incremental edit that opens a comment relexes to the end") {
+    IncrementalParser doc("let a = 1; { let b = 2; } exit(a);");
+    doc.apply(TextEdit{.offset = 11, .removed = 0, .inserted = "/*"});
+    REQUIRE(doc.program().stmts.size() == 1);
+    require_matches_fresh_parse(doc);
+
+    doc.apply(TextEdit{.offset = 11, .removed = 2, .inserted = ""});
+    REQUIRE(doc.program().stmts.size() == 3);
+    require_matches_fresh_parse(doc);
+}
+
+TEST_CASE("Incremental edit that unbalances braces widens to the parent") {
+    IncrementalParser doc("{ { let a = 1; } { let b = 2; } }");
+    NodeScope* outer = nth_scope_stmt(doc.program(), 0);
+    // Merge the two inner blocks into one by deleting "} {".
+    size_t at = doc.source().find("} {");
+    doc.apply(TextEdit{.offset = at, .removed = 3, .inserted = ""});
+    REQUIRE(nth_scope_stmt(doc.program(), 0) == outer);
+    REQUIRE(outer->stmts.size() == 1);
+    require_matches_fresh_parse(doc);
+}
+
+TEST_CASE("Incremental edits match a fresh parse") {
+    std::string src;
+    for (int i = 0; i < 40; i++) {
+        src += "let v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+        src += "if (v" + std::to_string(i) + ") { let w = 1; { w = w + 2; } } else { exit(3); }\n";
+    }
+    IncrementalParser doc(src);
+    const std::string snippets[] = {"{ let q = 7; }", "let z = 5;", "exit(1);", "{ { } }", "if (1) { }"};
+
+    std::mt19937 rng(1234);
+    for (int round = 0; round < 300; round++) {
+        std::string current(doc.source());
+        // Edits land on statement boundaries or replace a literal so the program stays valid.
+        if (round % 3 == 0) {
+            size_t digit = current.find_first_of("0123456789", rng() % current.size());
+            if (digit == std::string::npos) {
+                continue;
+            }
+            doc.apply(TextEdit{.offset = digit, .removed = 1, .inserted = std::to_string(rng() % 1000)});
+        }
+        else if (round % 3 == 1) {
+            size_t semi = current.find(';', rng() % current.size());
+            if (semi == std::string::npos) {
+                continue;
+            }
+            doc.apply(TextEdit{.offset = semi + 1, .removed = 0, .inserted = snippets[rng() % std::size(snippets)]});
+        }
+        else {
+            size_t start = current.find("let z = 5;", rng() % current.size());
+            if (start == std::string::npos) {
+                continue;
+            }
+            doc.apply(TextEdit{.offset = start, .removed = 10, .inserted = ""});
+        }
+        require_matches_fresh_parse(doc);
+    }
+}
@@ -1,2 +1,16 @@
 #include "../tests/test_tokenization.cpp"
-#include "../tests/test_parsing.cpp"
\ No newline at end of file
+#include "../tests/test_parsing.cpp"
+#include "../tests/test_arena.cpp"
+#include "../tests/test_flat_ast.cpp"
+#include "../tests/test_incremental.cpp"
+#include "../tests/test_scopes.cpp"
+#include "../tests/test_resolve.cpp"
+#include "../tests/test_fold.cpp"
+#include "../tests/test_regalloc.cpp"
+#include "../tests/test_frame.cpp"
+#include "../tests/test_ssa.cpp"
+#include "../tests/test_optimize.cpp"
+#include "../tests/test_peephole.cpp"
+#include "../tests/test_encoder.cpp"
+#include "../tests/test_target.cpp"
+#include "../tests/test_bytecode.cpp"
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/optimize.hpp"
+#include "../src/peephole.hpp"
+
+
+TEST_CASE("Unreachable block removal drops code after exit and return") {
+    SsaFunction fn = build_source("let a = 1; if (a) { return a; a = 2; } exit(a); a = 3; exit(a);");
+    REQUIRE(fn.blocks.size() == 7);
+    REQUIRE(fn.inst_count() == 12);
+    REQUIRE(remove_unreachable_blocks(fn) == 3);
+    REQUIRE(verify_ssa(fn).empty());
+    REQUIRE(fn.blocks.size() == 4);
+    REQUIRE(fn.inst_count() == 6);
+    // The join lost the arm that could not reach it, so its phi is down to one input.
+    REQUIRE(count_ops(fn, SsaOp::phi) == 1);
+    REQUIRE(fn.blocks[3].preds == std::vector<BlockId>{2});
+}
+
+TEST_CASE("Value numbering reuses a computation that dominates its repeat") {
+    SsaFunction fn = build_source("let x = 3; let y = x * x; let z = x * x; exit(y + z);");
+    REQUIRE(fn.inst_count() == 7);
+    REQUIRE(number_values(fn) == 1);
+    REQUIRE(verify_ssa(fn).empty());
+    REQUIRE(fn.inst_count() == 6);
+    REQUIRE(count_ops(fn, SsaOp::mul) == 1);
+}
+
+TEST_CASE("Value numbering matches commuted operands but not across sibling arms") {
+    SsaFunction fn = build_source("let a = 2; let b = 3; let c = a + b; let d = b + a; let e = a - b; let f = b - a; exit(c + d + e + f);");
+    REQUIRE(number_values(fn) == 1);
+    REQUIRE(count_ops(fn, SsaOp::add) == 4);
+    REQUIRE(count_ops(fn, SsaOp::sub) == 2);
+
+    fn = build_source("let a = 2; if (a) { a = a * 5; } else { a = a * 5; } exit(a * 5);");
+    const size_t before = fn.inst_count();
+    // The 5 and a * 5 of each arm repeat the other arm's, and the 5 after the join
+    // repeats both, but neither arm dominates the other or the join, so nothing goes.
+    REQUIRE(number_values(fn) == 0);
+    REQUIRE(fn.inst_count() == before);
+}
+
+TEST_CASE("Copy propagation removes phis whose inputs agree") {
+    SsaFunction fn = build_source("let a = 2; let b = a + 1; if (a) { b = a + 1; } exit(b);");
+    REQUIRE(count_ops(fn, SsaOp::phi) == 1);
+    REQUIRE(propagate_copies(fn) == 0);
+    REQUIRE(number_values(fn) == 2);
+    REQUIRE(propagate_copies(fn) == 1);
+    REQUIRE(verify_ssa(fn).empty());
+    REQUIRE(count_ops(fn, SsaOp::phi) == 0);
+}
+
+TEST_CASE("Dead value elimination removes unread variables and overwritten stores") {
+    SsaFunction fn = build_source("let a = 1; let unused = a * 9; a = 2; a = a + 3; exit(a);");
+    REQUIRE(fn.inst_count() == 9);
+    REQUIRE(eliminate_dead_values(fn) == 3);
+    REQUIRE(verify_ssa(fn).empty());
+    REQUIRE(fn.inst_count() == 6);
+    REQUIRE(count_ops(fn, SsaOp::mul) == 0);
+}
+
+TEST_CASE("SSA passes can be turned off one at a time") {
+    const std::string src = "let x = 4; let y = x * x; let z = x * x; let w = 1; let unused = x + 7; if (x) { w = y; exit(z); } exit(y + z + w);";
+    const size_t baseline = build_source(src).inst_count();
+    auto optimized = [&](const SsaPasses& passes) {
+        SsaFunction fn = build_source(src);
+        optimize_ssa(fn, passes);
+        REQUIRE(verify_ssa(fn).empty());
+        return fn.inst_count();
+    };
+    const size_t all = optimized({});
+    REQUIRE(all < baseline);
+    // Constant propagation decides the if on its own, so the other passes are
+    // compared without it.
+    const size_t without_constants = optimized({.constant_propagation = false});
+    REQUIRE(without_constants > all);
+    REQUIRE(optimized({.constant_propagation = false, .unreachable_blocks = false}) > without_constants);
+    REQUIRE(optimized({.constant_propagation = false, .block_merging = false}) > without_constants);
+    REQUIRE(optimized({.constant_propagation = false, .value_numbering = false}) > without_constants);
+    // Merging a block into its only predecessor also drops its phis.
+    REQUIRE(optimized({.constant_propagation = false, .block_merging = false, .copy_propagation = false}) >
+            optimized({.constant_propagation = false, .block_merging = false}));
+    REQUIRE(optimized({.constant_propagation = false, .dead_values = false}) > without_constants);
+    REQUIRE(optimized({false, false, false, false, false, false}) == baseline);
+}
+
+TEST_CASE("Constant propagation follows variables through the arms of an if") {
+    SsaFunction fn = build_source("let n = 4; let a = 7; if (n - 4) { a = 1; exit(9); } elif (n) { a = a * 3; } else { a = 2; } exit(a + n);");
+    REQUIRE(fn.blocks.size() == 8);
+    REQUIRE(propagate_constants(fn) == 6);
+    REQUIRE(verify_ssa(fn).empty());
+    // Only the elif arm can run, and everything else is pruned with the branches.
+    REQUIRE(fn.blocks.size() == 4);
+    REQUIRE(count_ops(fn, SsaOp::br) == 0);
+    REQUIRE(count_ops(fn, SsaOp::phi) == 0);
+    REQUIRE(fn.insts[fn.blocks[3].insts.back()].op == SsaOp::exit);
+    REQUIRE(fn.constant_value(fn.insts[fn.blocks[3].insts.back()].a) == 25);
+}
+
+TEST_CASE("Constant propagation keeps values that depend on which arm ran") {
+    SsaFunction fn = build_source("let a = 2; let b = a * 0; if (a - 2) { b = 5; } else { b = b + 5; } if (a) { a = b; } exit(a);");
+    propagate_constants(fn);
+    REQUIRE(verify_ssa(fn).empty());
+    // Both ifs are decided, and b is 5 whichever way.
+    REQUIRE(count_ops(fn, SsaOp::br) == 0);
+    REQUIRE(count_ops(fn, SsaOp::phi) == 0);
+
+    fn = build_source("let a = 2; let b = 3; if (a - 2) { b = 4; } else { b = 5; } let c = b; { let d = 1; if (d) { c = 6; } } exit(c);");
+    propagate_constants(fn);
+    REQUIRE(verify_ssa(fn).empty());
+    REQUIRE(count_ops(fn, SsaOp::br) == 0);
+
+    fn = build_source("let a = 2; if (a - 2) { a = 4; } let x = 9; let y = x / (a - a); if (y) { exit(1); } exit(a - 1);");
+    REQUIRE(propagate_constants(fn) > 0);
+    REQUIRE(count_ops(fn, SsaOp::ret) == 0);
+}
+
+TEST_CASE("Fully constant programs reduce to a direct exit") {
+    SsaFunction fn = build_source("let w = 3; let h = 4; let area = w * h; if (area - 12) { return 0; } elif (w) { area = area + h; } exit(area);");
+    optimize_ssa(fn);
+    REQUIRE(verify_ssa(fn).empty());
+    REQUIRE(fn.blocks.size() == 1);
+    REQUIRE(fn.inst_count() == 2);
+    REQUIRE(fn.constant_value(fn.blocks[0].insts[0]) == 16);
+    MachineCode code = lower_ssa(fn);
+    PeepholeStats stats;
+    peephole(code, stats);
+    REQUIRE(print_asm(code) == ".globl _main\n.p2align 2\n_main:\n    movz x0, #0x0010\n    bl _exit\n");
+}
+
+TEST_CASE("Block merging joins straight-line blocks") {
+    SsaFunction fn = build_source("let a = 1; if (a) { a = 2; } exit(a);");
+    propagate_constants(fn);
+    REQUIRE(fn.blocks.size() == 3);
+    REQUIRE(merge_blocks(fn) == 2);
+    REQUIRE(verify_ssa(fn).empty());
+    REQUIRE(fn.blocks.size() == 1);
+}
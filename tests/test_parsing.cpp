@@ -1,6 +1,9 @@
 #include <catch2/catch_test_macros.hpp>
 
+#include "../src/flat_ast.hpp"
+#include "../src/generator.hpp"
 #include "../src/parsing.hpp"
+#include "../src/resolve.hpp"
 
 
 template <typename T, typename N>
@@ -10,26 +13,50 @@ T* expectNode(N& node) {
     return *stmt_ptr;
 }
 
-std::optional<NodeProgram> parse_stmt(std::string prog_str) {
-    Tokenizer tokenizer = Tokenizer(prog_str);
-    std::vector<Token> tokens = tokenizer.tokenize();
-    Parser parser(tokens);
-    return parser.parse_program();
+// Tokens and AST nodes borrow from the source buffer and the parser's arena, so both
+// have to stay alive for as long as a test inspects the program.
+class ParsedProgram {
+public:
+    explicit ParsedProgram(std::string src)
+        : m_src(std::move(src))
+        , m_tokenizer(m_src)
+        , m_parser(m_tokenizer, m_tokenizer.tokenize())
+        , m_prog(m_parser.parse_program())
+    {
+    }
+
+    const NodeProgram* operator->() const {
+        return &m_prog.value();
+    }
+
+    std::string_view spelling(SymbolId ident) const {
+        return m_tokenizer.interner().spelling(ident);
+    }
+
+private:
+    std::string m_src;
+    Tokenizer m_tokenizer;
+    Parser m_parser;
+    std::optional<NodeProgram> m_prog;
+};
+
+ParsedProgram parse_stmt(std::string prog_str) {
+    return ParsedProgram(std::move(prog_str));
 }
 
 TEST_CASE("Parse return statement") {
     std::string prog_str = "return 1;";
-    std::optional<NodeProgram> prog = parse_stmt(prog_str);
+    ParsedProgram prog = parse_stmt(prog_str);
     REQUIRE(prog->stmts.size() == 1);
     auto node_return = expectNode<NodeStmtReturn>(*(prog->stmts[0]));
     auto node_term = expectNode<NodeTerm>(*(node_return->expr));
     auto node_int_lit = expectNode<NodeTermIntLit>(*node_term);
-    REQUIRE(node_int_lit->int_lit.value == std::to_string(1));
+    REQUIRE(node_int_lit->int_lit == 1);
 }
 
 TEST_CASE("Parse binary expression") {
     std::string prog_string = "return 1 + 2 - 3 * 4 / 5;";
-    std::optional<NodeProgram> prog = parse_stmt(prog_string);
+    ParsedProgram prog = parse_stmt(prog_string);
     REQUIRE(prog->stmts.size() == 1);
     auto node_return = expectNode<NodeStmtReturn>(*(prog->stmts[0]));
     auto node_expr = expectNode<NodeBinExpr>(*(node_return->expr));
@@ -38,63 +65,62 @@ TEST_CASE("Parse binary expression") {
     REQUIRE(node_lhs->op.type == TokenType::plus);
     auto node_lhs_term1 = expectNode<NodeTerm>(*(node_lhs->lhs));
     auto node_lhs_int_lit1 = expectNode<NodeTermIntLit>(*node_lhs_term1);
-    REQUIRE(node_lhs_int_lit1->int_lit.value == std::to_string(1));
+    REQUIRE(node_lhs_int_lit1->int_lit == 1);
     auto node_lhs_term2 = expectNode<NodeTerm>(*(node_lhs->rhs));
     auto node_lhs_int_lit2 = expectNode<NodeTermIntLit>(*node_lhs_term2);
-    REQUIRE(node_lhs_int_lit2->int_lit.value == std::to_string(2));
+    REQUIRE(node_lhs_int_lit2->int_lit == 2);
     auto node_rhs = expectNode<NodeBinExpr>(*node_expr->rhs);
     REQUIRE(node_rhs->op.type == TokenType::fslash);
     auto node_rhs_expr1 = expectNode<NodeBinExpr>(*(node_rhs->lhs));
     REQUIRE(node_rhs_expr1->op.type == TokenType::star);
     auto node_rhs_term_expr1 = expectNode<NodeTerm>(*node_rhs_expr1->lhs);
     auto node_rhs_term_int_lit1 = expectNode<NodeTermIntLit>(*node_rhs_term_expr1);
-    REQUIRE(node_rhs_term_int_lit1->int_lit.value == std::to_string(3));
+    REQUIRE(node_rhs_term_int_lit1->int_lit == 3);
     auto node_rhs_term_expr2 = expectNode<NodeTerm>(*node_rhs_expr1->rhs);
     auto node_rhs_term_int_lit2 = expectNode<NodeTermIntLit>(*node_rhs_term_expr2);
-    REQUIRE(node_rhs_term_int_lit2->int_lit.value == std::to_string(4));
+    REQUIRE(node_rhs_term_int_lit2->int_lit == 4);
     auto node_last_term = expectNode<NodeTerm>(*node_rhs->rhs);
     auto node_last_term_intlit1 = expectNode<NodeTermIntLit>(*node_last_term);
-    REQUIRE(node_last_term_intlit1->int_lit.value == std::to_string(5));
+    REQUIRE(node_last_term_intlit1->int_lit == 5);
 }
 
 TEST_CASE("Parse let expression") {
     std::string prog_string = "let x = 5;";
-    std::optional<NodeProgram> prog = parse_stmt(prog_string);
+    ParsedProgram prog = parse_stmt(prog_string);
     REQUIRE(prog->stmts.size() == 1);
     auto node_let = expectNode<NodeStmtLet>(*(prog->stmts[0]));
-    REQUIRE(node_let->ident.type == TokenType::ident);
-    REQUIRE(node_let->ident.value.value() == "x");
+    REQUIRE(prog.spelling(node_let->ident) == "x");
     auto node_term = expectNode<NodeTerm>(*(node_let->expr));
     auto node_int_lit = expectNode<NodeTermIntLit>(*node_term);
-    REQUIRE(node_int_lit->int_lit.value == std::to_string(5));
+    REQUIRE(node_int_lit->int_lit == 5);
 }
 
 TEST_CASE("Parse exit") {
     std::string prog_string = "exit(1);";
-    std::optional<NodeProgram> prog = parse_stmt(prog_string);
+    ParsedProgram prog = parse_stmt(prog_string);
     REQUIRE(prog->stmts.size() == 1);
     auto node_exit = expectNode<NodeStmtExit>(*(prog->stmts[0]));
     auto node_term = expectNode<NodeTerm>(*(node_exit->expr));
     auto node_term_paren = expectNode<NodeTermParen>(*node_term);
     auto node_term2 = expectNode<NodeTerm>(*(node_term_paren->expr));
     auto node_int_lit = expectNode<NodeTermIntLit>(*node_term2);
-    REQUIRE(node_int_lit->int_lit.value == std::to_string(1));
+    REQUIRE(node_int_lit->int_lit == 1);
 }
 
 TEST_CASE("Parse scopes") {
     std::string prog_string = "{return 5;}";
-    std::optional<NodeProgram> prog = parse_stmt(prog_string);
+    ParsedProgram prog = parse_stmt(prog_string);
     REQUIRE(prog->stmts.size() == 1);
     auto node_scope = expectNode<NodeScope>(*(prog->stmts[0]));
     auto node_return = expectNode<NodeStmtReturn>(*(node_scope->stmts[0]));
     auto node_term = expectNode<NodeTerm>(*(node_return->expr));
     auto node_int_lit = expectNode<NodeTermIntLit>(*node_term);
-    REQUIRE(node_int_lit->int_lit.value == std::to_string(5));
+    REQUIRE(node_int_lit->int_lit == 5);
 }
 
 TEST_CASE("Parse nested scopes") {
     std::string prog_string = "{let x = 1; {return x;}}";
-    std::optional<NodeProgram> prog = parse_stmt(prog_string);
+    ParsedProgram prog = parse_stmt(prog_string);
     REQUIRE(prog->stmts.size() == 1);
     // Outer scope
     auto out_scope_node = expectNode<NodeScope>(*(prog->stmts[0]));
@@ -106,48 +132,129 @@ TEST_CASE("Parse nested scopes") {
     auto node_return = expectNode<NodeStmtReturn>(*(inner_scope_node->stmts[0]));
     auto node_return_term = expectNode<NodeTerm>(*(node_return->expr));
     auto node_return_ident = expectNode<NodeTermIdent>(*node_return_term);
-    REQUIRE(node_return_ident->ident.value.value() == "x");
-    REQUIRE(node_return_ident->ident.type == TokenType::ident);
+    REQUIRE(prog.spelling(node_return_ident->ident) == "x");
 }
 
 TEST_CASE("Parse if statement") {
     std::string prog_string = "if(0){return 0;} elif(1) {return 1;} else {return 2;}";
-    std::optional<NodeProgram> prog = parse_stmt(prog_string);
+    ParsedProgram prog = parse_stmt(prog_string);
     REQUIRE(prog->stmts.size() == 1);
     // IF statement
     auto node_if = expectNode<NodeStmtIf>(*(prog->stmts[0]));
     auto node_if_term = expectNode<NodeTerm>(*(node_if->expr));
     auto node_if_int_lit = expectNode<NodeTermIntLit>(*node_if_term);
-    REQUIRE(node_if_int_lit->int_lit.value == std::to_string(0));
+    REQUIRE(node_if_int_lit->int_lit == 0);
     auto node_if_return = expectNode<NodeStmtReturn>(*(node_if->scope->stmts[0]));
     auto node_if_return_term = expectNode<NodeTerm>(*(node_if_return->expr));
     auto node_if_return_int_lit = expectNode<NodeTermIntLit>(*node_if_return_term);
-    REQUIRE(node_if_return_int_lit->int_lit.value == std::to_string(0));
+    REQUIRE(node_if_return_int_lit->int_lit == 0);
     // ELIF statement
     auto node_elif = expectNode<NodeStmtIf>(*(node_if->pred.value()));
     auto node_elif_term = expectNode<NodeTerm>(*(node_elif->expr));
     auto node_elif_int_lit = expectNode<NodeTermIntLit>(*node_elif_term);
-    REQUIRE(node_elif_int_lit->int_lit.value == std::to_string(1));
+    REQUIRE(node_elif_int_lit->int_lit == 1);
     auto node_elif_return = expectNode<NodeStmtReturn>(*(node_elif->scope->stmts[0]));
     auto node_elif_return_term = expectNode<NodeTerm>(*(node_elif_return->expr));
     auto node_elif_return_int_lit = expectNode<NodeTermIntLit>(*node_elif_return_term);
-    REQUIRE(node_elif_return_int_lit->int_lit.value == std::to_string(1));
+    REQUIRE(node_elif_return_int_lit->int_lit == 1);
     // ELSE statement
     auto node_else = expectNode<NodeIfPredElse>(*(node_elif->pred.value()));
     auto node_else_return = expectNode<NodeStmtReturn>(*(node_else->scope->stmts[0]));
     auto node_else_return_term = expectNode<NodeTerm>(*(node_else_return->expr));
     auto node_else_return_int_lit = expectNode<NodeTermIntLit>(*node_else_return_term);
-    REQUIRE(node_else_return_int_lit->int_lit.value == std::to_string(2));
+    REQUIRE(node_else_return_int_lit->int_lit == 2);
 }
 
 TEST_CASE("Parse variable assignment") {
     std::string prog_string = "let x = 5; x = 2;";
-    std::optional<NodeProgram> prog = parse_stmt(prog_string);
+    ParsedProgram prog = parse_stmt(prog_string);
     REQUIRE(prog->stmts.size() == 2);
     auto node_assign = expectNode<NodeStmtAssign>(*(prog->stmts[1]));
-    REQUIRE(node_assign->ident.type == TokenType::ident);
-    REQUIRE(node_assign->ident.value.value() == "x");
+    REQUIRE(prog.spelling(node_assign->ident) == "x");
     auto node_term = expectNode<NodeTerm>(*(node_assign->expr));
     auto node_int_lit = expectNode<NodeTermIntLit>(*node_term);
-    REQUIRE(node_int_lit->int_lit.value == std::to_string(2));
-}
\ No newline at end of file
+    REQUIRE(node_int_lit->int_lit == 2);
+}
+TEST_CASE("Parse directly from the tokenizer") {
+    std::string prog_string = "let x = 5; if (x) { x = x * 2; } else { return x; }";
+    Tokenizer tokenizer = Tokenizer(prog_string);
+    Parser parser(tokenizer);
+    std::optional<NodeProgram> prog = parser.parse_program();
+    REQUIRE(prog->stmts.size() == 2);
+    auto node_let = expectNode<NodeStmtLet>(*(prog->stmts[0]));
+    REQUIRE(tokenizer.interner().spelling(node_let->ident) == "x");
+    auto node_if = expectNode<NodeStmtIf>(*(prog->stmts[1]));
+    auto node_assign = expectNode<NodeStmtAssign>(*(node_if->scope->stmts[0]));
+    auto node_bin = expectNode<NodeBinExpr>(*(node_assign->expr));
+    REQUIRE(node_bin->op.type == TokenType::star);
+    expectNode<NodeIfPredElse>(*(node_if->pred.value()));
+}
+
+TEST_CASE("Parse identifiers to shared symbol ids") {
+    std::string prog_string = "let x = 1; let y = x; x = y;";
+    ParsedProgram prog = parse_stmt(prog_string);
+    REQUIRE(prog->stmts.size() == 3);
+    auto let_x = expectNode<NodeStmtLet>(*(prog->stmts[0]));
+    auto let_y = expectNode<NodeStmtLet>(*(prog->stmts[1]));
+    auto use_x = expectNode<NodeTermIdent>(*expectNode<NodeTerm>(*(let_y->expr)));
+    auto assign_x = expectNode<NodeStmtAssign>(*(prog->stmts[2]));
+    auto use_y = expectNode<NodeTermIdent>(*expectNode<NodeTerm>(*(assign_x->expr)));
+    REQUIRE(let_x->ident == use_x->ident);
+    REQUIRE(let_x->ident == assign_x->ident);
+    REQUIRE(let_y->ident == use_y->ident);
+    REQUIRE(let_x->ident != let_y->ident);
+}
+
+// Each of these would need a native stack frame per nesting level, and a million
+// levels overflow the stack many times over.
+TEST_CASE("Parse and generate a million-deep elif chain") {
+    constexpr int depth = 1000000;
+    std::string src = "let x = 3; if (x - 1) { x = 1; }";
+    src.reserve(depth * 24);
+    for (int i = 0; i < depth; i++) {
+        src += " elif (x) { x = 2; }";
+    }
+    src += " else { exit(x); }";
+    ParsedProgram prog = parse_stmt(src);
+    REQUIRE(prog->stmts.size() == 2);
+    FlatAst ast = flatten(*prog.operator->());
+    REQUIRE(ast.kinds[ast.stmts(ast.root)[1]] == NodeKind::stmt_if);
+    Tokenizer tokenizer(src);
+    Parser parser(tokenizer);
+    FlatAst generated = flatten(parser.parse_program().value());
+    REQUIRE(resolve_names(generated, tokenizer.interner()).empty());
+    Generator generator(std::move(generated));
+    std::string asm_out = print_asm(generator.gen_program());
+    REQUIRE(asm_out.find("LBB0_1000002:") != std::string::npos);
+}
+
+TEST_CASE("Parse and generate a million nested parentheses") {
+    constexpr int depth = 1000000;
+    std::string src = "exit(" + std::string(depth, '(') + "7" + std::string(depth, ')') + ");";
+    ParsedProgram prog = parse_stmt(src);
+    auto node_exit = expectNode<NodeStmtExit>(*(prog->stmts[0]));
+    REQUIRE(node_exit->expr != nullptr);
+    Tokenizer tokenizer(src);
+    Parser parser(tokenizer);
+    FlatAst generated = flatten(parser.parse_program().value());
+    REQUIRE(resolve_names(generated, tokenizer.interner()).empty());
+    Generator generator(std::move(generated));
+    REQUIRE(print_asm(generator.gen_program()).find("movz x0, #0x0007") != std::string::npos);
+}
+
+TEST_CASE("Parse a million nested scopes and right-nested operators") {
+    constexpr int depth = 1000000;
+    std::string src = std::string(depth, '{') + "let a = 1;" + std::string(depth, '}');
+    src += "exit(1";
+    for (int i = 0; i < depth; i++) {
+        src += " - (2";
+    }
+    src += std::string(depth, ')') + ");";
+    ParsedProgram prog = parse_stmt(src);
+    REQUIRE(prog->stmts.size() == 2);
+    FlatAst ast = flatten(*prog.operator->());
+    REQUIRE(ast.kinds[ast.stmts(ast.root)[0]] == NodeKind::scope);
+    NodeIndex exit_stmt = ast.stmts(ast.root)[1];
+    REQUIRE(ast.kinds[exit_stmt] == NodeKind::stmt_exit);
+    REQUIRE(ast.kinds[ast.lhs[exit_stmt]] == NodeKind::sub);
+}
@@ -0,0 +1,97 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/machine.hpp"
+#include "../src/peephole.hpp"
+
+
+size_t fired(const PeepholeStats& stats, std::string_view name) {
+    std::span<const PeepholeRule> rules = peephole_rules();
+    for (size_t i = 0; i < rules.size(); i++) {
+        if (rules[i].name == name) {
+            return stats.fired[i];
+        }
+    }
+    FAIL("no rule named " << name);
+    return 0;
+}
+
+// The peephole over the instructions written in `assembly`, printed back without
+// the header.
+std::string rewrite(std::string_view assembly, PeepholeStats& stats) {
+    MachineCode code = parse_asm(assembly);
+    peephole(code, stats);
+    return print_asm(code).substr(std::string_view(".globl _main\n.p2align 2\n_main:\n").size());
+}
+
+TEST_CASE("Instructions print as assembly and parse back") {
+    MachineCode code;
+    code.adjust_sp(MOp::sub_imm, 4096);
+    code.mov_imm(3, 0x1'0000'0002);
+    code.emit(MOp::str, 3, 0, 0, 8);
+    code.emit(MOp::sdiv, 4, 3, 17);
+    code.emit(MOp::cbnz, 4, 0, 0, 12);
+    code.emit(MOp::label, 0, 0, 0, 12);
+    code.emit(MOp::bl_exit);
+    const std::string text = print_asm(code);
+    REQUIRE(text == ".globl _main\n.p2align 2\n_main:\n"
+        "    sub sp, sp, #4080\n    sub sp, sp, #16\n    movz x3, #0x0002\n    movk x3, #0x0001, lsl #32\n"
+        "    str x3, [sp, #8]\n    sdiv x4, x3, x17\n    cbnz x4, LBB0_12\nLBB0_12:\n    bl _exit\n");
+    REQUIRE(parse_asm(text).insts == code.insts);
+}
+
+TEST_CASE("Peephole removes branches to the next line") {
+    PeepholeStats stats;
+    REQUIRE(rewrite("    b LBB0_1\nLBB0_1:\n    cbz x1, LBB0_2\nLBB0_2:\n    b LBB0_3\nLBB0_4:\n", stats) ==
+        "LBB0_1:\nLBB0_2:\n    b LBB0_3\nLBB0_4:\n");
+    REQUIRE(fired(stats, "branch to the next line") == 1);
+    REQUIRE(fired(stats, "conditional branch to the next line") == 1);
+}
+
+TEST_CASE("Peephole inverts a conditional branch over a branch") {
+    PeepholeStats stats;
+    REQUIRE(rewrite("    cbz x2, LBB0_1\n    b LBB0_2\nLBB0_1:\n", stats) == "    cbnz x2, LBB0_2\nLBB0_1:\n");
+    REQUIRE(fired(stats, "cbz over a branch") == 1);
+}
+
+TEST_CASE("Peephole forwards a store to the load after it") {
+    PeepholeStats stats;
+    REQUIRE(rewrite("    str x1, [sp, #8]\n    ldr x1, [sp, #8]\n    str x3, [sp, #0]\n    ldr x4, [sp, #0]\n    ldr x4, [sp, #16]\n", stats) ==
+        "    str x1, [sp, #8]\n    str x3, [sp, #0]\n    mov x4, x3\n    ldr x4, [sp, #16]\n");
+    REQUIRE(fired(stats, "load of the slot just stored") == 1);
+    REQUIRE(fired(stats, "load of the slot just stored into another register") == 1);
+}
+
+TEST_CASE("Peephole computes into x0 only when the register dies") {
+    PeepholeStats stats;
+    REQUIRE(rewrite("    add x3, x1, x2\n    mov x0, x3\n    bl _exit\n", stats) == "    add x0, x1, x2\n    bl _exit\n");
+    REQUIRE(fired(stats, "result computed straight into x0") == 1);
+
+    const std::string live = "    add x3, x1, x2\n    mov x0, x3\n    str x3, [sp, #0]\n    bl _exit\n";
+    REQUIRE(rewrite(live, stats) == live);
+    const std::string branch = "    movz x3, #0x0001\n    mov x0, x3\n    b LBB0_1\n";
+    REQUIRE(rewrite(branch, stats) == branch);
+    // movk keeps the other bits of its register, so it cannot move to x0 on its own.
+    const std::string partial = "    movz x3, #0x0001\n    movk x3, #0x0001, lsl #16\n    mov x0, x3\n    bl _exit\n";
+    REQUIRE(rewrite(partial, stats) == partial);
+}
+
+TEST_CASE("Peephole merges stack pointer adjustments within the immediate range") {
+    PeepholeStats stats;
+    REQUIRE(rewrite("    sub sp, sp, #16\n    sub sp, sp, #32\n    sub sp, sp, #4080\n", stats) ==
+        "    sub sp, sp, #48\n    sub sp, sp, #4080\n");
+    REQUIRE(fired(stats, "consecutive sp adjustments") == 1);
+    REQUIRE(rewrite("    sub sp, sp, #16\n    add sp, sp, #16\n    ret\n", stats) == "    ret\n");
+    REQUIRE(fired(stats, "sp adjustments that cancel") == 1);
+}
+
+TEST_CASE("Peephole runs its rules to a fixpoint") {
+    PeepholeStats stats;
+    // Removing the move to itself leaves a branch to the next line.
+    REQUIRE(rewrite("    b LBB0_1\n    mov x1, x1\nLBB0_1:\n    ret\n", stats) == "LBB0_1:\n    ret\n");
+    REQUIRE(fired(stats, "move to itself") == 1);
+    REQUIRE(fired(stats, "branch to the next line") == 1);
+
+    REQUIRE(rewrite("    str x2, [sp, #8]\n    ldr x2, [sp, #8]\n    str x2, [sp, #8]\n    ldr x2, [sp, #8]\n", stats) == "    str x2, [sp, #8]\n");
+    REQUIRE(fired(stats, "load of the slot just stored") == 2);
+    REQUIRE(fired(stats, "repeated store") == 1);
+}
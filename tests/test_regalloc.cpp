@@ -0,0 +1,160 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+
+#include "../src/fold.hpp"
+#include "../src/generator.hpp"
+#include "../src/parsing.hpp"
+#include "../src/regalloc.hpp"
+#include "../src/resolve.hpp"
+
+
+std::string generate_source(const std::string& src, bool promote_variables = true) {
+    Tokenizer tokenizer(src);
+    Parser parser(tokenizer);
+    FlatAst ast = flatten(parser.parse_program().value());
+    REQUIRE(resolve_names(ast, tokenizer.interner()).empty());
+    fold_constants(ast);
+    return print_asm(Generator(std::move(ast), promote_variables).gen_program());
+}
+
+size_t count_occurrences(const std::string& text, const std::string& needle) {
+    size_t count = 0;
+    for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1)) {
+        count++;
+    }
+    return count;
+}
+
+// Whether two intervals that are live at once were given the same spill slot.
+bool spill_slots_overlap(std::span<const LiveInterval> intervals, const RegAllocation& allocation) {
+    for (size_t a = 0; a < intervals.size(); a++) {
+        for (size_t b = a + 1; b < intervals.size(); b++) {
+            const Location& la = allocation.locations[a];
+            const Location& lb = allocation.locations[b];
+            if (la.spilled && lb.spilled && la.index == lb.index &&
+                intervals[a].start < intervals[b].end && intervals[b].start < intervals[a].end) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+TEST_CASE("Linear scan reuses registers of expired intervals") {
+    const LiveInterval intervals[] = {{0, 2}, {1, 2}, {2, 4}, {3, 4}, {4, 5}};
+    const PhysReg regs[] = {1, 2};
+    RegAllocation allocation = linear_scan(intervals, regs);
+    REQUIRE(allocation.spilled == 0);
+    REQUIRE(allocation.locations[0].index == 1);
+    REQUIRE(allocation.locations[1].index == 2);
+    REQUIRE(allocation.locations[2].index != allocation.locations[3].index);
+    REQUIRE(!allocation.locations[4].spilled);
+}
+
+TEST_CASE("Linear scan spills the interval that ends last") {
+    const LiveInterval intervals[] = {{0, 10}, {1, 3}, {2, 3}, {3, 4}};
+    const PhysReg regs[] = {1, 2};
+    RegAllocation allocation = linear_scan(intervals, regs);
+    REQUIRE(allocation.locations[0].spilled);
+    REQUIRE(!allocation.locations[1].spilled);
+    REQUIRE(!allocation.locations[2].spilled);
+    REQUIRE(allocation.locations[1].index != allocation.locations[2].index);
+    REQUIRE(!allocation.locations[3].spilled);
+    REQUIRE(allocation.spilled == 1);
+    REQUIRE(allocation.spill_slots == 1);
+}
+
+TEST_CASE("Linear scan reuses spill slots") {
+    const LiveInterval intervals[] = {{0, 2}, {1, 2}, {2, 3}, {3, 5}, {4, 5}};
+    const PhysReg regs[] = {1};
+    RegAllocation allocation = linear_scan(intervals, regs);
+    REQUIRE(allocation.spilled == 2);
+    REQUIRE(allocation.spill_slots == 1);
+}
+
+TEST_CASE("Linear scan keeps crossing spilled intervals apart") {
+    // {2, 10} holds the register until {6, 7} takes it and is only spilled then,
+    // after {1, 5} has freed its slot but over points where {1, 5} was still live.
+    const LiveInterval intervals[] = {{0, 2}, {1, 5}, {2, 10}, {6, 7}};
+    const PhysReg regs[] = {1};
+    RegAllocation allocation = linear_scan(intervals, regs);
+    REQUIRE(allocation.locations[1].spilled);
+    REQUIRE(allocation.locations[2].spilled);
+    REQUIRE(allocation.locations[1].index != allocation.locations[2].index);
+    REQUIRE(!spill_slots_overlap(intervals, allocation));
+
+    // A slot freed before the victim started is still shared.
+    const LiveInterval earlier[] = {{0, 1}, {0, 2}, {1, 2}, {2, 10}, {6, 7}};
+    allocation = linear_scan(earlier, regs);
+    REQUIRE(allocation.locations[1].spilled);
+    REQUIRE(allocation.locations[3].spilled);
+    REQUIRE(allocation.spill_slots == 1);
+    REQUIRE(!spill_slots_overlap(earlier, allocation));
+
+    std::mt19937 rng(15);
+    for (int round = 0; round < 200; round++) {
+        std::vector<LiveInterval> random(40);
+        for (uint32_t i = 0; i < random.size(); i++) {
+            random[i] = {i, i + 1 + static_cast<uint32_t>(rng() % 12)};
+        }
+        const PhysReg few[] = {1, 2, 3};
+        REQUIRE(!spill_slots_overlap(random, linear_scan(random, few)));
+    }
+}
+
+TEST_CASE("Generate without spills when registers suffice") {
+    std::string asm_out = generate_source("let x = 1; exit(x * (x + (x - (x / x))));", false);
+    REQUIRE(asm_out.find("x19") == std::string::npos);
+    REQUIRE(asm_out.find("x16") == std::string::npos);
+    REQUIRE(count_occurrences(asm_out, "sub sp") == 1);
+}
+
+TEST_CASE("Generate wide expressions by spilling") {
+    // Every operand stays live until the innermost operator, so the expression needs
+    // one register per level.
+    std::string src = "let x = 1; exit(";
+    for (int i = 0; i < 60; i++) {
+        src += "x + (";
+    }
+    src += "x" + std::string(60, ')') + ");";
+    std::string asm_out = generate_source(src, false);
+    REQUIRE(asm_out.find("x28") != std::string::npos);
+    REQUIRE(asm_out.find("str x16") != std::string::npos);
+    REQUIRE(asm_out.find("ldr x16") != std::string::npos);
+    REQUIRE(count_occurrences(asm_out, "add x") == 60);
+}
+
+TEST_CASE("Promote variables to callee-saved registers") {
+    std::string asm_out = generate_source("let x = 6; let y = x * 7; x = y - x; { let z = x + y; y = z; } exit(y / x);");
+    REQUIRE(asm_out.find("ldr x") == std::string::npos);
+    REQUIRE(asm_out.find("str x") == std::string::npos);
+    REQUIRE(asm_out.find("mul x20, x19, x1") != std::string::npos);
+    REQUIRE(asm_out.find("sub x19, x20, x19") != std::string::npos);
+    REQUIRE(asm_out.find("add x21, x19, x20") != std::string::npos);
+    REQUIRE(asm_out.find("sdiv x0, x20, x19") != std::string::npos);
+}
+
+TEST_CASE("Promoted variables are restored before returning") {
+    std::string asm_out = generate_source("let x = 1; let y = 2; return x + y;");
+    REQUIRE(asm_out.find("str x19, [sp, #0]") != std::string::npos);
+    REQUIRE(asm_out.find("str x20, [sp, #8]") != std::string::npos);
+    size_t restore = asm_out.find("ldr x19, [sp, #0]");
+    REQUIRE(restore != std::string::npos);
+    REQUIRE(restore < asm_out.find("ret"));
+}
+
+TEST_CASE("Variables beyond the promoted registers stay on the stack") {
+    std::string src;
+    std::string sum = "exit(0";
+    for (int i = 0; i < 12; i++) {
+        std::string name = "v" + std::string(1, static_cast<char>('a' + i));
+        src += "let " + name + " = " + std::to_string(i) + "; ";
+        sum += " + " + name;
+    }
+    std::string asm_out = generate_source(src + sum + ");");
+    REQUIRE(count_occurrences(asm_out, "sub sp, sp, #16") == 1);
+    REQUIRE(count_occurrences(asm_out, "str x") == 2);
+    REQUIRE(count_occurrences(asm_out, "ldr x") == 2);
+    REQUIRE(asm_out.find("x28") != std::string::npos);
+}
@@ -0,0 +1,57 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/flat_ast.hpp"
+#include "../src/parsing.hpp"
+#include "../src/resolve.hpp"
+
+
+struct ResolvedProgram {
+    FlatAst ast;
+    std::vector<std::string> diagnostics;
+};
+
+ResolvedProgram resolve_source(const std::string& src) {
+    Tokenizer tokenizer(src);
+    Parser parser(tokenizer);
+    ResolvedProgram resolved {.ast = flatten(parser.parse_program().value()), .diagnostics = {}};
+    resolved.diagnostics = resolve_names(resolved.ast, tokenizer.interner());
+    return resolved;
+}
+
+TEST_CASE("Resolve names to their declarations") {
+    ResolvedProgram prog = resolve_source("let x = 1; let y = x; { let x = 2; y = x; } exit(x);");
+    REQUIRE(prog.diagnostics.empty());
+    const FlatAst& ast = prog.ast;
+    auto stmts = ast.stmts(ast.root);
+    NodeIndex outer_x = stmts[0];
+    NodeIndex y = stmts[1];
+    REQUIRE(ast.rhs[ast.lhs[y]] == outer_x);
+
+    auto inner = ast.stmts(stmts[2]);
+    NodeIndex inner_x = inner[0];
+    REQUIRE(ast.rhs[inner[1]] == y);
+    REQUIRE(ast.rhs[ast.lhs[inner[1]]] == inner_x);
+
+    NodeIndex exit_stmt = stmts[3];
+    REQUIRE(ast.rhs[ast.lhs[exit_stmt]] == outer_x);
+}
+
+TEST_CASE("Resolve a let before its own name is bound") {
+    ResolvedProgram prog = resolve_source("let a = 1; { let a = a + 1; }");
+    REQUIRE(prog.diagnostics.empty());
+    auto stmts = prog.ast.stmts(prog.ast.root);
+    NodeIndex inner_let = prog.ast.stmts(stmts[1])[0];
+    NodeIndex add = prog.ast.lhs[inner_let];
+    REQUIRE(prog.ast.rhs[prog.ast.lhs[add]] == stmts[0]);
+}
+
+TEST_CASE("Resolve reports every diagnostic in source order") {
+    ResolvedProgram prog = resolve_source("let a = b; a = 1; c = a; let a = 2; if (d) { exit(e); }");
+    REQUIRE(prog.diagnostics == std::vector<std::string>{
+        "Undefined symbol b",
+        "Undeclared identifier c",
+        "Redefinition of a",
+        "Undefined symbol d",
+        "Undefined symbol e",
+    });
+}
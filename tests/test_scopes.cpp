@@ -0,0 +1,68 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/scopes.hpp"
+
+
+TEST_CASE("Symbol lookup finds the innermost binding") {
+    Interner interner;
+    SymbolId x = interner.intern("x");
+    SymbolId y = interner.intern("y");
+    SymbolManager symbols(interner);
+    REQUIRE(symbols.findSymbol(x) == nullptr);
+
+    symbols.declareSymbol(x, 1);
+    symbols.enterScope();
+    REQUIRE(symbols.findSymbol(x)->decl == 1);
+    symbols.declareSymbol(x, 2);
+    symbols.declareSymbol(y, 3);
+    REQUIRE(symbols.findSymbol(x)->decl == 2);
+    REQUIRE(symbols.findSymbol(y)->decl == 3);
+
+    symbols.exitScope();
+    REQUIRE(symbols.findSymbol(x)->decl == 1);
+    REQUIRE(symbols.findSymbol(y) == nullptr);
+}
+
+TEST_CASE("Symbols declared after the table was built are found") {
+    Interner interner;
+    SymbolManager symbols(interner);
+    SymbolId late = interner.intern("late");
+    REQUIRE(symbols.findSymbol(late) == nullptr);
+    symbols.enterScope();
+    symbols.declareSymbol(late, 4);
+    REQUIRE(symbols.findSymbol(late)->ident == late);
+    symbols.exitScope();
+    REQUIRE(symbols.findSymbol(late) == nullptr);
+}
+
+TEST_CASE("Deep scope nesting restores every shadowed binding") {
+    Interner interner;
+    SymbolId v = interner.intern("v");
+    SymbolManager symbols(interner);
+    constexpr uint32_t depth = 100000;
+    for (uint32_t i = 0; i < depth; i++) {
+        symbols.enterScope();
+        if (i % 2 == 0) {
+            symbols.declareSymbol(v, static_cast<uint32_t>(i));
+        }
+    }
+    REQUIRE(symbols.findSymbol(v)->decl == depth - 2);
+    for (uint32_t i = depth; i-- > 0;) {
+        symbols.exitScope();
+        if (i > 0) {
+            REQUIRE(symbols.findSymbol(v)->decl == (i - 1) / 2 * 2);
+        }
+    }
+    REQUIRE(symbols.findSymbol(v) == nullptr);
+}
+
+TEST_CASE("Redeclaring in the same scope is refused") {
+    Interner interner;
+    SymbolId x = interner.intern("x");
+    SymbolManager symbols(interner);
+    REQUIRE(symbols.declareSymbol(x, 1));
+    REQUIRE_FALSE(symbols.declareSymbol(x, 2));
+    REQUIRE(symbols.findSymbol(x)->decl == 1);
+    symbols.enterScope();
+    REQUIRE(symbols.declareSymbol(x, 3));
+}
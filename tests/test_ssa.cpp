@@ -0,0 +1,209 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+
+#include "../src/lower.hpp"
+#include "../src/optimize.hpp"
+#include "../src/ssa.hpp"
+
+
+SsaFunction build_source(const std::string& src) {
+    FlatAst ast = resolve_flat(src);
+    SsaFunction fn = build_ssa(ast);
+    REQUIRE(verify_ssa(fn).empty());
+    return fn;
+}
+
+size_t count_ops(const SsaFunction& fn, SsaOp op) {
+    size_t count = 0;
+    for (const SsaBlock& block : fn.blocks) {
+        for (ValueId value : block.insts) {
+            count += fn.insts[value].op == op;
+        }
+    }
+    return count;
+}
+
+TEST_CASE("SSA renames variables to the values assigned to them") {
+    SsaFunction fn = build_source("let a = 7; let b = a + a; a = b * 2; exit(a);");
+    REQUIRE(dump_ssa(fn) ==
+        "bb0:\n"
+        "    %0 = const 7\n"
+        "    %1 = add %0, %0\n"
+        "    %2 = const 2\n"
+        "    %3 = mul %1, %2\n"
+        "    exit %3\n"
+        "bb1:\n"
+        "    %5 = const 0\n"
+        "    exit %5\n");
+}
+
+TEST_CASE("SSA puts a phi at the join of an if and else that assign differently") {
+    SsaFunction fn = build_source("let a = 1; if (a) { a = 2; } else { a = 3; } exit(a);");
+    REQUIRE(dump_ssa(fn) ==
+        "bb0:\n"
+        "    %0 = const 1\n"
+        "    br %0, bb1, bb2\n"
+        "bb1: ; preds bb0\n"
+        "    %2 = const 2\n"
+        "    jmp bb3\n"
+        "bb2: ; preds bb0\n"
+        "    %3 = const 3\n"
+        "    jmp bb3\n"
+        "bb3: ; preds bb1 bb2\n"
+        "    %6 = phi [bb1: %2], [bb2: %3]\n"
+        "    exit %6\n"
+        "bb4:\n"
+        "    %8 = const 0\n"
+        "    exit %8\n");
+}
+
+TEST_CASE("SSA only makes phis for outer variables the arms disagree on") {
+    // b is left alone by every arm, c is declared inside one, and a keeps its value
+    // along the missing else.
+    SsaFunction fn = build_source("let a = 1; let b = 2; if (b) { let c = 3; a = c; } elif (a) { b = b; } exit(a + b);");
+    REQUIRE(count_ops(fn, SsaOp::phi) == 1);
+    const SsaBlock& join = fn.blocks[fn.blocks.size() - 2];
+    REQUIRE(join.preds.size() == 3);
+    REQUIRE(fn.insts[join.insts[0]].op == SsaOp::phi);
+}
+
+TEST_CASE("SSA gives code after exit a block without predecessors") {
+    SsaFunction fn = build_source("let a = 1; if (a) { return 2; a = 5; } exit(a);");
+    REQUIRE(count_ops(fn, SsaOp::ret) == 1);
+    REQUIRE(fn.blocks[2].preds.empty());
+    // The unreachable rest of the arm still flows into the join.
+    REQUIRE(count_ops(fn, SsaOp::phi) == 1);
+}
+
+TEST_CASE("SSA builds long elif chains and deep nesting without recursion") {
+    std::string chain = "let a = 0; if (a) { a = 1; }";
+    for (int i = 0; i < 20000; i++) {
+        chain += " elif (a) { a = " + std::to_string(i) + "; }";
+    }
+    chain += " exit(a);";
+    SsaFunction fn = build_source(chain);
+    REQUIRE(count_ops(fn, SsaOp::br) == 20001);
+
+    std::string nested = "let a = 0;";
+    for (int i = 0; i < 20000; i++) {
+        nested += " if (a) { a = a + 1;";
+    }
+    nested += std::string(20000, '}') + " exit(a);";
+    fn = build_source(nested);
+    REQUIRE(count_ops(fn, SsaOp::phi) == 20000);
+}
+
+TEST_CASE("SSA verifier reports malformed functions") {
+    SsaFunction fn;
+    BlockId entry = fn.add_block();
+    ValueId one = fn.add_constant(entry, 1);
+    fn.add_inst(entry, SsaOp::add, one, one + 5);
+    REQUIRE(verify_ssa(fn) == std::vector<std::string>{"bb0: does not end in a terminator"});
+
+    fn.add_inst(entry, SsaOp::exit, one);
+    std::vector<std::string> diagnostics = verify_ssa(fn);
+    REQUIRE(diagnostics.size() == 1);
+    REQUIRE(diagnostics[0] == "bb0: %1 uses something that is not an i64 value");
+
+    SsaFunction join;
+    entry = join.add_block();
+    BlockId block = join.add_block();
+    join.add_inst(entry, SsaOp::jmp, block);
+    ValueId late = join.add_constant(block, 2);
+    join.phi_args.push_back(late);
+    ValueId phi = join.add_inst(block, SsaOp::phi, 0, 1);
+    join.add_inst(block, SsaOp::exit, phi);
+    diagnostics = verify_ssa(join);
+    REQUIRE(diagnostics.size() == 3);
+    REQUIRE(diagnostics[0] == "bb0: is not listed once among the predecessors of bb1");
+    REQUIRE(diagnostics[1] == "bb1: %2 is a phi after other instructions");
+    REQUIRE(diagnostics[2] == "bb1: %2 does not have one incoming value per predecessor");
+
+    join.blocks[block].preds.push_back(entry);
+    diagnostics = verify_ssa(join);
+    REQUIRE(diagnostics.size() == 2);
+    REQUIRE(diagnostics[1] == "bb1: %2 takes %1 from bb0 where it is not defined");
+}
+
+TEST_CASE("SSA lowering copies into phis on the way to the join") {
+    SsaFunction fn = build_source("let a = 1; let b = 2; if (a) { a = b + 5; } exit(a * b);");
+    std::string assembly = print_asm(lower_ssa(fn));
+    REQUIRE(assembly.find("cbz x1, LBB0_2") != std::string::npos);
+    REQUIRE(assembly.find("LBB0_3:") != std::string::npos);
+    REQUIRE(assembly.find("    b LBB0_3\n") != std::string::npos);
+    REQUIRE(assembly.find("mov x") != std::string::npos);
+    REQUIRE(assembly.find("    ret\n") == std::string::npos);
+}
+
+// A program of lets whose values are read long after they are set, and if chains
+// that reassign them so that phis start early, enough to keep more values live than
+// x86-64 has registers for. Some branches return early.
+std::string random_program(std::mt19937& rng) {
+    std::vector<std::string> names;
+    auto operand = [&] {
+        return names.empty() || rng() % 4 == 0 ? std::to_string(rng() % 30) : names[rng() % names.size()];
+    };
+    auto expr = [&] {
+        std::string e = operand();
+        for (uint32_t i = rng() % 4; i > 0; i--) {
+            const char op = "+-*+-*/"[rng() % 7];
+            e = "(" + e + " " + op + " " + operand() + ")";
+        }
+        return e;
+    };
+    auto assigns = [&] {
+        std::string body = "{ ";
+        for (uint32_t i = rng() % 3 + 1; i > 0; i--) {
+            body += names[rng() % names.size()] + " = ";
+            body += expr() + "; ";
+        }
+        if (rng() % 8 == 0) {
+            body += "return " + expr() + "; ";
+        }
+        return body + "}";
+    };
+    std::string src;
+    for (int i = 0; i < 30; i++) {
+        if (names.size() > 2 && rng() % 3 == 0) {
+            src += "if (" + expr() + ") ";
+            src += assigns() + " elif (";
+            src += expr() + ") ";
+            src += assigns() + " else ";
+            src += assigns() + " ";
+        }
+        else {
+            const std::string value = expr();
+            names.push_back("v" + std::to_string(i));
+            src += "let " + names.back() + " = " + value + "; ";
+        }
+    }
+    return src + "exit(" + expr() + ");";
+}
+
+TEST_CASE("SSA lowering never gives values live at once the same place") {
+    std::mt19937 rng(18);
+    for (int round = 0; round < 100; round++) {
+        SsaFunction fn = build_source(random_program(rng));
+        optimize_ssa(fn, SsaPasses{.constant_propagation = false});
+
+        SsaAllocation allocation = allocate_ssa(fn, Target::x86_64);
+        std::vector<ValueId> values;
+        for (ValueId value = 0; value < fn.insts.size(); value++) {
+            if (fn.insts[value].type == ValueType::i64) {
+                values.push_back(value);
+            }
+        }
+        for (size_t a = 0; a < values.size(); a++) {
+            for (size_t b = a + 1; b < values.size(); b++) {
+                const LiveInterval& ia = allocation.intervals[values[a]];
+                const LiveInterval& ib = allocation.intervals[values[b]];
+                const Location& la = allocation.locations[values[a]];
+                const Location& lb = allocation.locations[values[b]];
+                if (ia.start < ib.end && ib.start < ia.end) {
+                    REQUIRE((la.spilled != lb.spilled || la.index != lb.index));
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/bytecode.hpp"
+#include "../src/fold.hpp"
+#include "../src/generator.hpp"
+#include "../src/lower.hpp"
+#include "../src/optimize.hpp"
+#include "../src/peephole.hpp"
+#include "../src/target.hpp"
+#include "../src/x86_64.hpp"
+
+
+// Whether every register `code` names is one that `target` lets the code generators
+// use, or the result register, or sp.
+bool uses_only_target_regs(const MachineCode& code, Target target) {
+    const TargetRegs& regs = target_regs(target);
+    auto allowed = [&](MReg reg) {
+        return reg == 0 || reg == sp_reg || reg == regs.spill_scratch[0] || reg == regs.spill_scratch[1] ||
+            std::find(regs.allocatable.begin(), regs.allocatable.end(), reg) != regs.allocatable.end();
+    };
+    for (const MInst& inst : code.insts) {
+        switch (inst.op) {
+            case MOp::add:
+            case MOp::sub:
+            case MOp::mul:
+            case MOp::sdiv:
+                if (!allowed(inst.rm)) {
+                    return false;
+                }
+                [[fallthrough]];
+            case MOp::mov:
+            case MOp::add_imm:
+            case MOp::sub_imm:
+                if (!allowed(inst.rn)) {
+                    return false;
+                }
+                [[fallthrough]];
+            case MOp::movz:
+            case MOp::movk:
+            case MOp::ldr:
+            case MOp::str:
+            case MOp::cbz:
+            case MOp::cbnz:
+                if (!allowed(inst.rd)) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("Targets are chosen by name") {
+    REQUIRE(parse_target("arm64") == Target::arm64);
+    REQUIRE(parse_target("x86_64") == Target::x86_64);
+    REQUIRE(!parse_target("riscv64").has_value());
+    REQUIRE(target_regs(Target::x86_64).is_callee_saved(3));
+    REQUIRE(!target_regs(Target::x86_64).is_callee_saved(1));
+    REQUIRE(target_regs(Target::arm64).is_callee_saved(19));
+}
+
+TEST_CASE("x86-64 expands three-operand instructions") {
+    MachineCode code;
+    code.mov_imm(1, 0x1'0000'0002);
+    code.mov_imm(6, static_cast<uint64_t>(-5));
+    code.emit(MOp::sub, 7, 1, 7);
+    code.emit(MOp::mul, 8, 1, 6);
+    code.emit(MOp::add, 6, 1, 6);
+    code.emit(MOp::ldr, 10, 0, 0, 16);
+    code.emit(MOp::cbz, 10, 0, 0, 3);
+    code.emit(MOp::label, 0, 0, 0, 3);
+    code.emit(MOp::mov, 0, 8);
+    code.emit(MOp::bl_exit);
+    REQUIRE(print_x86_64_asm(code) ==
+        ".intel_syntax noprefix\n.text\n.globl main\n.p2align 4\nmain:\n"
+        "    movabs rcx, 4294967298\n"
+        "    mov rsi, -5\n"
+        "    neg rdi\n"
+        "    add rdi, rcx\n"
+        "    mov r8, rcx\n"
+        "    imul r8, rsi\n"
+        "    add rsi, rcx\n"
+        "    mov r10, qword ptr [rsp + 16]\n"
+        "    test r10, r10\n"
+        "    je .LBB0_3\n"
+        ".LBB0_3:\n"
+        "    mov rax, r8\n"
+        "    mov rdi, rax\n"
+        "    and rsp, -16\n"
+        "    call exit@PLT\n"
+        ".section .note.GNU-stack,\"\",@progbits\n");
+}
+
+TEST_CASE("x86-64 division keeps the ARM64 results where idiv traps") {
+    MachineCode code;
+    code.emit(MOp::sdiv, 9, 1, 6);
+    code.emit(MOp::sdiv, 0, 9, 6);
+    const std::string assembly = print_x86_64_asm(code);
+    REQUIRE(assembly.find(
+        "    mov rax, rcx\n"
+        "    cmp rsi, -1\n"
+        "    je .Ldiv0_neg\n"
+        "    test rsi, rsi\n"
+        "    je .Ldiv0_zero\n"
+        "    cqo\n"
+        "    idiv rsi\n"
+        "    jmp .Ldiv0_done\n"
+        ".Ldiv0_neg:\n"
+        "    neg rax\n"
+        "    jmp .Ldiv0_done\n"
+        ".Ldiv0_zero:\n"
+        "    xor eax, eax\n"
+        ".Ldiv0_done:\n"
+        "    mov r9, rax\n"
+        "    mov rax, r9\n") != std::string::npos);
+    REQUIRE(assembly.find(".Ldiv1_done:\n.section") != std::string::npos);
+}
+
+TEST_CASE("Code for x86-64 keeps to its registers") {
+    // Enough values live at once to spill, and enough variables to promote all six
+    // callee-saved registers.
+    std::string src = "let a = 1; let b = 2; let c = 3; let d = 4; let e = 5; let f = 6; let g = 7;";
+    src += "if (a) { return a / b; } exit(";
+    for (int i = 0; i < 20; i++) {
+        src += "a * (b - (c + (d / (e + (f * (";
+    }
+    src += "g" + std::string(120, ')') + ");";
+    FlatAst ast = resolve_flat(src);
+
+    MachineCode code = Generator(ast, true, Target::x86_64).gen_program();
+    REQUIRE(uses_only_target_regs(code, Target::x86_64));
+    REQUIRE(!uses_only_target_regs(Generator(ast, true, Target::arm64).gen_program(), Target::x86_64));
+    const std::string assembly = print_x86_64_asm(code);
+    REQUIRE(assembly.find("mov qword ptr [rsp + ") != std::string::npos);
+    REQUIRE(assembly.find("r15") != std::string::npos);
+
+    SsaFunction fn = build_ssa(ast);
+    REQUIRE(uses_only_target_regs(lower_ssa(fn, Target::x86_64), Target::x86_64));
+}
+
+// The exit status of `src` built for x86-64 the way main builds it, going through
+// SSA with `passes` or straight from the tree without `passes`.
+std::optional<int> native_x86_64_status(const std::string& src, std::optional<SsaPasses> passes) {
+    FlatAst ast = resolve_flat(src);
+    fold_constants(ast);
+    MachineCode code;
+    if (passes.has_value()) {
+        SsaFunction fn = build_ssa(ast);
+        optimize_ssa(fn, passes.value());
+        code = lower_ssa(fn, Target::x86_64);
+    }
+    else {
+        code = Generator(std::move(ast), true, Target::x86_64).gen_program();
+    }
+    PeepholeStats stats;
+    peephole(code, stats);
+    return native_exit_status(print_x86_64_asm(code));
+}
+
+TEST_CASE("Native x86-64 code exits as the bytecode interpreter does") {
+    const std::optional<SsaPasses> pipelines[] = {SsaPasses{}, SsaPasses{.constant_propagation = false}, std::nullopt};
+    std::mt19937 rng(24);
+    for (int round = 0; round < 20; round++) {
+        const std::string src = random_program(rng);
+        FlatAst ast = resolve_flat(src);
+        fold_constants(ast);
+        const int expected = static_cast<int>(run_bytecode(compile_bytecode(ast)) & 0xff);
+        for (const std::optional<SsaPasses>& passes : pipelines) {
+            std::optional<int> status = native_x86_64_status(src, passes);
+            if (!status.has_value()) {
+                return;
+            }
+            INFO(src);
+            REQUIRE(status.value() == expected);
+        }
+    }
+}
\ No newline at end of file
@@ -10,7 +10,8 @@ TEST_CASE("Tokenize return statement") {
     REQUIRE(tokens.size() == 3);
     REQUIRE(tokens[0].type == TokenType::_return);
     REQUIRE(tokens[1].type == TokenType::int_lit);
-    REQUIRE(tokens[1].value.value() == std::to_string(1));
+    REQUIRE(tokenizer.text(tokens[1]) == "1");
+    REQUIRE(tokenizer.int_value(tokens[1]) == 1);
     REQUIRE(tokens[2].type == TokenType::semi);
 }
 
@@ -96,4 +97,156 @@ TEST_CASE("Tokenize if statement") {
     REQUIRE(tokens[21].type == TokenType::int_lit);
     REQUIRE(tokens[22].type == TokenType::semi);
     REQUIRE(tokens[23].type == TokenType::close_curly);
-}
\ No newline at end of file
+}
+TEST_CASE("Tokenize identifiers longer than a vector block") {
+    std::string ident(70, 'a');
+    ident += "Z9";
+    std::string stmt = "let " + ident + " = 0000000000000000000000000000009223372036854775807;";
+    Tokenizer tokenizer = Tokenizer(stmt);
+    std::vector<Token> tokens = tokenizer.tokenize();
+    REQUIRE(tokens.size() == 5);
+    REQUIRE(tokens[1].type == TokenType::ident);
+    REQUIRE(tokenizer.text(tokens[1]) == ident);
+    REQUIRE(tokens[3].type == TokenType::int_lit);
+    REQUIRE(tokenizer.int_value(tokens[3]) == 9223372036854775807);
+}
+
+TEST_CASE("Tokenize keywords only on exact matches") {
+    std::string stmt = "lets iff elif1 exit return";
+    Tokenizer tokenizer = Tokenizer(stmt);
+    std::vector<Token> tokens = tokenizer.tokenize();
+    REQUIRE(tokens.size() == 5);
+    REQUIRE(tokens[0].type == TokenType::ident);
+    REQUIRE(tokens[1].type == TokenType::ident);
+    REQUIRE(tokens[2].type == TokenType::ident);
+    REQUIRE(tokens[3].type == TokenType::_exit);
+    REQUIRE(tokens[4].type == TokenType::_return);
+}
+
+TEST_CASE("Tokenize comments and track line numbers") {
+    std::string stmt =
+        "let x = 1; // a line comment that runs on for quite a while\n"
+        "/* a block comment\n"
+        "   spanning                                     several\n"
+        "   lines */ x = 2;\n"
+        "\t\t\t                                                  \n"
+        "return x;";
+    Tokenizer tokenizer = Tokenizer(stmt);
+    std::vector<Token> tokens = tokenizer.tokenize();
+    REQUIRE(tokens.size() == 12);
+    REQUIRE(tokenizer.line_of(tokens[0]) == 1);
+    REQUIRE(tokens[5].type == TokenType::ident);
+    REQUIRE(tokenizer.line_of(tokens[5]) == 4);
+    REQUIRE(tokens[9].type == TokenType::_return);
+    REQUIRE(tokenizer.line_of(tokens[9]) == 6);
+}
+
+TEST_CASE("Tokenize unterminated block comment") {
+    std::string stmt = "return 1; /* never closed\n\n";
+    Tokenizer tokenizer = Tokenizer(stmt);
+    std::vector<Token> tokens = tokenizer.tokenize();
+    REQUIRE(tokens.size() == 3);
+}
+
+TEST_CASE("Token stream pulls tokens lazily with bounded lookahead") {
+    std::string stmt = "let x = 5; x = x + 1;";
+    Tokenizer tokenizer = Tokenizer(stmt);
+    TokenStream stream(tokenizer);
+    REQUIRE(stream.peek(2)->type == TokenType::eq);
+    REQUIRE(stream.peek(1)->type == TokenType::ident);
+    REQUIRE(stream.consume().type == TokenType::let);
+    REQUIRE(stream.consume().type == TokenType::ident);
+    REQUIRE(stream.peek(3)->type == TokenType::ident);
+    std::vector<TokenType> rest;
+    while (stream.peek() != nullptr) {
+        rest.push_back(stream.consume().type);
+    }
+    REQUIRE(rest.size() == 9);
+    REQUIRE(rest.back() == TokenType::semi);
+    REQUIRE(stream.peek() == nullptr);
+    REQUIRE(stream.last_consumed()->type == TokenType::semi);
+}
+
+TEST_CASE("Token stream replays pre-lexed tokens") {
+    std::string stmt = "return 1;";
+    Tokenizer tokenizer = Tokenizer(stmt);
+    TokenStream stream(tokenizer.tokenize());
+    REQUIRE(stream.peek(2)->type == TokenType::semi);
+    REQUIRE(stream.consume().type == TokenType::_return);
+    REQUIRE(tokenizer.int_value(stream.consume()) == 1);
+    REQUIRE(stream.consume().type == TokenType::semi);
+    REQUIRE(stream.peek() == nullptr);
+    STATIC_REQUIRE(!std::is_copy_constructible_v<TokenStream>);
+    STATIC_REQUIRE(!std::is_move_constructible_v<TokenStream>);
+}
+
+TEST_CASE("Tokenize identifiers into interned symbols") {
+    std::string stmt = "let alpha = beta; alpha = alpha + beta;";
+    Tokenizer tokenizer = Tokenizer(stmt);
+    std::vector<Token> tokens = tokenizer.tokenize();
+    REQUIRE(tokenizer.interner().size() == 2);
+    REQUIRE(tokens[1].symbol() == tokens[5].symbol());
+    REQUIRE(tokens[1].symbol() == tokens[7].symbol());
+    REQUIRE(tokens[3].symbol() == tokens[9].symbol());
+    REQUIRE(tokens[1].symbol() != tokens[3].symbol());
+    REQUIRE(tokenizer.interner().spelling(tokens[1].symbol()) == "alpha");
+    REQUIRE(tokenizer.interner().spelling(tokens[3].symbol()) == "beta");
+}
+
+TEST_CASE("Tokenize integer literals into packed payloads") {
+    std::string stmt = "0 8388607 8388608 4294967296 9223372036854775807";
+    Tokenizer tokenizer = Tokenizer(stmt);
+    std::vector<Token> tokens = tokenizer.tokenize();
+    REQUIRE(tokens.size() == 5);
+    REQUIRE(tokenizer.int_value(tokens[0]) == 0);
+    REQUIRE(tokenizer.int_value(tokens[1]) == 8388607);
+    REQUIRE(tokenizer.int_value(tokens[2]) == 8388608);
+    REQUIRE(tokenizer.int_value(tokens[3]) == 4294967296);
+    REQUIRE(tokenizer.int_value(tokens[4]) == 9223372036854775807);
+    REQUIRE(tokens[4].offset == 29);
+    REQUIRE(tokenizer.text(tokens[4]) == "9223372036854775807");
+}
+
+void require_same_as_serial(const std::string& src, size_t threads) {
+    Tokenizer serial(src);
+    std::vector<Token> expected = serial.tokenize();
+    Tokenizer parallel(src);
+    std::vector<Token> tokens = parallel.tokenize_parallel(threads);
+    REQUIRE(tokens.size() == expected.size());
+    for (size_t i = 0; i < tokens.size(); i++) {
+        REQUIRE(tokens[i].type == expected[i].type);
+        REQUIRE(tokens[i].payload == expected[i].payload);
+        REQUIRE(tokens[i].offset == expected[i].offset);
+    }
+    REQUIRE(parallel.interner().size() == serial.interner().size());
+    for (SymbolId id = 0; id < serial.interner().size(); id++) {
+        REQUIRE(parallel.interner().spelling(id) == serial.interner().spelling(id));
+    }
+    REQUIRE(parallel.int_value(tokens.back()) == serial.int_value(expected.back()));
+}
+
+TEST_CASE("Parallel tokenization matches the serial tokenizer") {
+    std::string src;
+    for (int i = 0; src.size() < 3 * 1024 * 1024; i++) {
+        src += "let name" + std::to_string(i % 5000) + " = " + std::to_string(i * 104729LL * 1000) + ";\n";
+        if (i % 100 == 0) {
+            // Block comments that span lines, holding text that would not lex on its own.
+            src += "/* let\n 99999999999999999999999 \n*/\n";
+        }
+    }
+    src += "exit(9223372036854775807);";
+    require_same_as_serial(src, 2);
+    require_same_as_serial(src, 5);
+    require_same_as_serial(src, 16);
+}
+
+TEST_CASE("Parallel tokenization survives a comment spanning several chunks") {
+    std::string src = "let a = 1;\n/*\n";
+    for (int i = 0; i < 200000; i++) {
+        src += "let hidden = 99999999999999999999999;\n";
+    }
+    src += "*/ exit(a);\n";
+    require_same_as_serial(src, 8);
+    Tokenizer tokenizer(src);
+    REQUIRE(tokenizer.tokenize_parallel(8).size() == 10);
+}